@@ -0,0 +1,287 @@
+/*
+ * GPL 2
+ */
+
+#include <stdlib.h>
+#include <glib.h>
+
+#include "af_follow.h"
+
+/* Looks for a better transmitter of the same station among the alternative
+ * frequencies it announces, once the current one fades. Up to AF_MEASURE
+ * candidates get a quick signal measurement; then, strongest first, the
+ * ones clearly better than the current frequency are checked for the same
+ * PI code, and the first that has it wins. Nobody hears anything
+ * meanwhile, so the whole check gives up after AF_BUDGET_MS.
+ *
+ * What is found is remembered per PI and frequency: frequencies that carry
+ * some other station are not even measured again, those known to carry
+ * this one are switched to without waiting for RDS, and the last signal
+ * measured picks which candidates are measured next time. */
+
+#define AF_TICK_MS        20
+#define AF_PI_TIMEOUT_MS  400  /* A few groups' worth */
+#define AF_PI_CONFIRM     2    /* Times the same PI has to be received */
+#define AF_MAX_VERIFY     2
+#define AF_MEASURE        5
+#define AF_BUDGET_MS      600
+#define AF_MARGIN         (65536 / 20)
+#define AF_SAME_CHANNEL   50000 /* Hz; the current one, maybe fine tuned */
+#define AF_MAX            25
+
+#define AF_CACHE_KEY(pi, freq) GUINT_TO_POINTER(((guint) (pi) << 16) | ((freq) / 100000))
+
+/* Cache values: the AfResult, a flag telling whether the frequency has
+ * been measured, and the signal it had then. */
+#define AF_CACHE_RESULT_MSK 0x3
+#define AF_CACHE_MEASURED   0x4
+#define AF_CACHE_SIGNAL(v)  ((v) >> 8)
+
+typedef enum {
+	AF_UNKNOWN = 0,
+	AF_SAME_PI,
+	AF_OTHER_PI
+} AfResult;
+
+typedef enum {
+	PHASE_MEASURE,
+	PHASE_VERIFY
+} AfPhase;
+
+typedef struct {
+	gulong freq;
+	guint signal; /* Until measured, what decides whether it will be */
+} AfCandidate;
+
+struct _CFmAfFollow {
+	CFmTunerBackend *backend;
+	GHashTable *cache;
+	CFmAfFollowFunc func;
+	gpointer user_data;
+
+	guint16 pi;
+	gulong current;
+	guint current_signal;
+	gint64 deadline;
+
+	AfCandidate cand[AF_MAX];
+	guint n, pos;
+	guint verified;
+
+	AfPhase phase;
+	gboolean tuned;
+	guint ticks;
+	guint16 pi_received;
+	guint pi_count;
+
+	guint timer;
+};
+
+static guint af_cache_get(CFmAfFollow *af, gulong freq)
+{
+	return GPOINTER_TO_UINT(g_hash_table_lookup(af->cache, AF_CACHE_KEY(af->pi, freq)));
+}
+
+static AfResult af_cache_lookup(CFmAfFollow *af, gulong freq)
+{
+	return af_cache_get(af, freq) & AF_CACHE_RESULT_MSK;
+}
+
+static void af_cache_store(CFmAfFollow *af, gulong freq, AfResult result)
+{
+	const guint v = af_cache_get(af, freq);
+	g_hash_table_insert(af->cache, AF_CACHE_KEY(af->pi, freq),
+		GUINT_TO_POINTER((v & ~AF_CACHE_RESULT_MSK) | result));
+}
+
+static void af_cache_store_signal(CFmAfFollow *af, gulong freq, guint signal)
+{
+	const guint v = af_cache_get(af, freq);
+	g_hash_table_insert(af->cache, AF_CACHE_KEY(af->pi, freq),
+		GUINT_TO_POINTER((v & AF_CACHE_RESULT_MSK) | AF_CACHE_MEASURED | (signal << 8)));
+}
+
+static gint af_compare_signal(gconstpointer a, gconstpointer b)
+{
+	const AfCandidate *x = a, *y = b;
+	return x->signal > y->signal ? -1 : x->signal < y->signal ? 1 : 0;
+}
+
+static void af_finish(CFmAfFollow *af, gboolean switched)
+{
+	gulong freq = af->current;
+
+	if (switched) {
+		freq = af->cand[af->pos].freq;
+		g_debug("AF: PI %04X moved from %lu to %lu Hz (signal %u to %u)\n",
+			af->pi, af->current, freq, af->current_signal, af->cand[af->pos].signal);
+	} else {
+		cfm_tuner_backend_tune(af->backend, af->current);
+	}
+
+	af->timer = 0;
+	af->func(af, freq, switched, af->user_data);
+	g_slice_free(CFmAfFollow, af);
+}
+
+/* Tunes to the next candidate worth a PI check, if any is left. */
+static gboolean af_verify_next(CFmAfFollow *af)
+{
+	guint8 buf[256];
+
+	for (; af->pos < af->n; af->pos++) {
+		const AfCandidate *c = &af->cand[af->pos];
+
+		if (c->signal < af->current_signal + AF_MARGIN) {
+			break; /* Sorted, so nothing better comes after this */
+		}
+		if (af->verified >= AF_MAX_VERIFY || cfm_monotonic_ms() >= af->deadline) {
+			break;
+		}
+
+		cfm_tuner_backend_tune(af->backend, c->freq);
+		if (af_cache_lookup(af, c->freq) == AF_SAME_PI) {
+			af_finish(af, TRUE);
+			return FALSE;
+		}
+
+		/* Whatever is queued was received on some other frequency. */
+		while (cfm_tuner_backend_read_rds_blocks(af->backend, buf, sizeof(buf)) > 0);
+		af->verified++;
+		af->ticks = 0;
+		af->pi_count = 0;
+		return TRUE;
+	}
+
+	af_finish(af, FALSE);
+	return FALSE;
+}
+
+static gboolean af_verify_tick(CFmAfFollow *af)
+{
+	const AfCandidate *c = &af->cand[af->pos];
+
+	if (af->pi_count >= AF_PI_CONFIRM) {
+		const gboolean same = af->pi_received == af->pi;
+		af_cache_store(af, c->freq, same ? AF_SAME_PI : AF_OTHER_PI);
+		if (same) {
+			af_finish(af, TRUE);
+			return FALSE;
+		}
+		g_debug("AF: %lu Hz carries PI %04X, not %04X\n", c->freq, af->pi_received, af->pi);
+	} else if (++af->ticks * AF_TICK_MS < AF_PI_TIMEOUT_MS && cfm_monotonic_ms() < af->deadline) {
+		return TRUE;
+	}
+
+	/* Some other station, or no RDS at all; next one. */
+	af->pos++;
+	return af_verify_next(af);
+}
+
+static gboolean af_tick(gpointer data)
+{
+	CFmAfFollow *af = data;
+	CFmTunerStatus status;
+
+	if (af->phase == PHASE_VERIFY) {
+		return af_verify_tick(af);
+	}
+
+	if (!af->tuned) {
+		cfm_tuner_backend_tune(af->backend, af->cand[af->pos].freq);
+		af->tuned = TRUE;
+		return TRUE;
+	}
+
+	af->cand[af->pos].signal = cfm_tuner_backend_get_status(af->backend, &status) ?
+		MIN(status.signal, G_MAXUINT16) : 0;
+	af_cache_store_signal(af, af->cand[af->pos].freq, af->cand[af->pos].signal);
+	af->tuned = FALSE;
+	if (++af->pos < af->n) {
+		return TRUE;
+	}
+
+	qsort(af->cand, af->n, sizeof(AfCandidate), af_compare_signal);
+	af->phase = PHASE_VERIFY;
+	af->pos = 0;
+	return af_verify_next(af);
+}
+
+/* Starts checking the alternative frequencies of the station with code
+ * "pi", currently received at "current" with "signal". The backend has to
+ * hand out raw RDS blocks, and the caller, who is reading them, has to pass
+ * on the PI codes received meanwhile; the driver's rds_pi would still show
+ * what was received before tuning. Returns NULL if no candidate is worth
+ * checking. The backend must stay open until the check finishes or is
+ * cancelled. */
+CFmAfFollow* cfm_af_follow_start(CFmTunerBackend *backend, GHashTable *cache,
+	guint16 pi, gulong current, guint signal, const gulong *af_list, guint n_af,
+	CFmAfFollowFunc func, gpointer user_data)
+{
+	CFmAfFollow *af;
+	guint i;
+
+	g_return_val_if_fail(cfm_tuner_backend_is_open(backend), NULL);
+	g_return_val_if_fail(cfm_tuner_backend_get_rds_fd(backend, CFM_TUNER_RDS_BLOCKS) != -1, NULL);
+
+	af = g_slice_new0(CFmAfFollow);
+	af->backend = backend;
+	af->cache = cache;
+	af->func = func;
+	af->user_data = user_data;
+	af->pi = pi;
+	af->current = current;
+	af->current_signal = signal;
+
+	for (i = 0; i < n_af && af->n < AF_MAX; i++) {
+		const gulong freq = af_list[i];
+		const guint v = af_cache_get(af, freq);
+		if (ABS((glong) freq - (glong) current) < AF_SAME_CHANNEL ||
+		    freq < backend->range_low || freq > backend->range_high) {
+			continue;
+		}
+		if ((v & AF_CACHE_RESULT_MSK) == AF_OTHER_PI) {
+			continue;
+		}
+		af->cand[af->n].freq = freq;
+		/* Those never measured go first, so that each gets its turn. */
+		af->cand[af->n].signal = v & AF_CACHE_MEASURED ? AF_CACHE_SIGNAL(v) : G_MAXUINT16 + 1;
+		af->n++;
+	}
+
+	qsort(af->cand, af->n, sizeof(AfCandidate), af_compare_signal);
+	af->n = MIN(af->n, AF_MEASURE);
+
+	if (af->n == 0) {
+		g_slice_free(CFmAfFollow, af);
+		return NULL;
+	}
+
+	af->deadline = cfm_monotonic_ms() + AF_BUDGET_MS;
+	af->timer = g_timeout_add(AF_TICK_MS, af_tick, af);
+
+	return af;
+}
+
+/* A PI code received from the RDS blocks while the check runs. */
+void cfm_af_follow_feed_pi(CFmAfFollow *af, guint16 pi)
+{
+	if (af->phase != PHASE_VERIFY) return;
+
+	if (af->pi_count && pi == af->pi_received) {
+		af->pi_count++;
+	} else {
+		af->pi_received = pi;
+		af->pi_count = 1;
+	}
+}
+
+/* Leaves the tuner wherever the check was. */
+void cfm_af_follow_cancel(CFmAfFollow *af)
+{
+	if (!af) return;
+	if (af->timer) {
+		g_source_remove(af->timer);
+	}
+	g_slice_free(CFmAfFollow, af);
+}
@@ -0,0 +1,28 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_AF_FOLLOW_H_
+#define _CFM_AF_FOLLOW_H_
+
+#include <glib.h>
+
+#include "tuner_backend.h"
+
+typedef struct _CFmAfFollow CFmAfFollow;
+
+/* Called once the check is over, with the tuner left at "freq": the
+ * alternative frequency switched to if "switched", otherwise back where it
+ * started. The check frees itself after this returns. */
+typedef void (*CFmAfFollowFunc)(CFmAfFollow *af, gulong freq, gboolean switched,
+	gpointer user_data);
+
+/* "cache" is a g_direct_hash table that the caller keeps across checks, so
+ * that what was learned about each frequency for a PI is not measured again. */
+CFmAfFollow* cfm_af_follow_start(CFmTunerBackend *backend, GHashTable *cache,
+	guint16 pi, gulong current, guint signal, const gulong *af, guint n_af,
+	CFmAfFollowFunc func, gpointer user_data);
+void cfm_af_follow_feed_pi(CFmAfFollow *af, guint16 pi);
+void cfm_af_follow_cancel(CFmAfFollow *af);
+
+#endif /* _CFM_AF_FOLLOW_H_ */
@@ -0,0 +1,93 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "band.h"
+
+/* Channels that do not fall on a 62.5 kHz boundary can only be tuned
+ * exactly by tuners with V4L2_TUNER_CAP_LOW; everything else rounds. */
+static const CFmBandPlan band_plans[] = {
+	{ "europe", "87.5-108 MHz, 100 kHz",   87500000, 100000, 206 },
+	{ "us",     "87.9-107.9 MHz, 200 kHz", 87900000, 200000, 101 },
+	{ "japan",  "76-95 MHz, 100 kHz",      76000000, 100000, 191 },
+	{ "oirt",   "65.9-74 MHz, 30 kHz",     65900000,  30000, 271 },
+	{ "fine",   "87.5-108 MHz, 50 kHz",    87500000,  50000, 411 },
+};
+
+const CFmBandPlan* cfm_band_plan_get(const gchar *id)
+{
+	guint i;
+	if (!id) return NULL;
+	for (i = 0; i < G_N_ELEMENTS(band_plans); i++) {
+		if (strcmp(band_plans[i].id, id) == 0) {
+			return &band_plans[i];
+		}
+	}
+	return NULL;
+}
+
+const CFmBandPlan* cfm_band_plan_get_default(void)
+{
+	return &band_plans[0];
+}
+
+const CFmBandPlan* cfm_band_plan_list(guint *len)
+{
+	*len = G_N_ELEMENTS(band_plans);
+	return band_plans;
+}
+
+gulong cfm_band_plan_channel(const CFmBandPlan *plan, guint index)
+{
+	return plan->first + index * plan->spacing;
+}
+
+gulong cfm_band_plan_last(const CFmBandPlan *plan)
+{
+	return cfm_band_plan_channel(plan, plan->count - 1);
+}
+
+/* Nearest channel, clamped to the plan. */
+guint cfm_band_plan_index(const CFmBandPlan *plan, gulong freq)
+{
+	gulong i;
+	if (freq <= plan->first) return 0;
+	i = (freq - plan->first + plan->spacing / 2) / plan->spacing;
+	return MIN(i, plan->count - 1);
+}
+
+gulong cfm_band_plan_round(const CFmBandPlan *plan, gulong freq)
+{
+	return cfm_band_plan_channel(plan, cfm_band_plan_index(plan, freq));
+}
+
+/* Finds the channels of the plan a tuner covering [range_low, range_high]
+ * can actually receive. */
+gboolean cfm_band_plan_clip(const CFmBandPlan *plan, gulong range_low,
+	gulong range_high, guint *first, guint *last)
+{
+	gulong lo, hi;
+
+	if (range_high < plan->first || range_low > cfm_band_plan_last(plan)) {
+		return FALSE;
+	}
+
+	lo = range_low <= plan->first ? 0 :
+		(range_low - plan->first + plan->spacing - 1) / plan->spacing;
+	hi = (MIN(range_high, cfm_band_plan_last(plan)) - plan->first) / plan->spacing;
+	if (lo > hi) return FALSE;
+
+	*first = lo;
+	*last = hi;
+	return TRUE;
+}
+
+/* How many decimals a frequency needs to be shown in MHz: one on the usual
+ * 100 kHz grid, two for the finer ones. */
+gint cfm_band_freq_decimals(gulong freq)
+{
+	return (freq % 100000) == 0 ? 1 : 2;
+}
@@ -0,0 +1,35 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_BAND_H_
+#define _CFM_BAND_H_
+
+#include <glib.h>
+
+/* A band plan is a regular channel grid: channel i is at
+ * first + i * spacing, for i in [0, count). */
+typedef struct {
+	const gchar *id;
+	const gchar *name;
+	gulong first;
+	gulong spacing;
+	guint count;
+} CFmBandPlan;
+
+#define CFM_BAND_PLAN_DEFAULT "europe"
+
+const CFmBandPlan* cfm_band_plan_get(const gchar *id);
+const CFmBandPlan* cfm_band_plan_get_default(void);
+const CFmBandPlan* cfm_band_plan_list(guint *len);
+
+gulong cfm_band_plan_channel(const CFmBandPlan *plan, guint index);
+gulong cfm_band_plan_last(const CFmBandPlan *plan);
+guint cfm_band_plan_index(const CFmBandPlan *plan, gulong freq);
+gulong cfm_band_plan_round(const CFmBandPlan *plan, gulong freq);
+gboolean cfm_band_plan_clip(const CFmBandPlan *plan, gulong range_low,
+	gulong range_high, guint *first, guint *last);
+
+gint cfm_band_freq_decimals(gulong freq);
+
+#endif /* _CFM_BAND_H_ */
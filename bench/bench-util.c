@@ -0,0 +1,43 @@
+/*
+ * GPL 2
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <glib.h>
+
+#include "bench-util.h"
+
+/* Monotonic time in microseconds, for measuring intervals. */
+gint64 now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+/* Orders gint64 samples for qsort(). */
+gint compare_int64(gconstpointer a, gconstpointer b)
+{
+	const gint64 x = *(const gint64*) a, y = *(const gint64*) b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Prints s quoted as a JSON string; quotes, backslashes and control
+ * characters are escaped, the rest is passed on as UTF-8. */
+void print_json_string(const gchar *s)
+{
+	const guchar *c;
+
+	putchar('"');
+	for (c = (const guchar*) s; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			printf("\\%c", *c);
+		} else if (*c < 0x20) {
+			printf("\\u%04x", *c);
+		} else {
+			putchar(*c);
+		}
+	}
+	putchar('"');
+}
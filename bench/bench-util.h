@@ -0,0 +1,16 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_BENCH_UTIL_H_
+#define _CFM_BENCH_UTIL_H_
+
+#include <glib.h>
+
+/* Helpers shared by the benchmark and capture tools. */
+
+gint64 now_us(void);
+gint compare_int64(gconstpointer a, gconstpointer b);
+void print_json_string(const gchar *s);
+
+#endif /* _CFM_BENCH_UTIL_H_ */
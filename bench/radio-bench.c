@@ -0,0 +1,359 @@
+/*
+ * GPL 2
+ */
+
+/* Measures the CFmRadio hot paths against a real V4L2 receiver without the
+ * N900 enabler service. Meant to be run against the kernel's vivid driver:
+ *
+ *   modprobe vivid n_devs=1 node_types=0x10
+ *   ./cfmradio-bench                  # picks the vivid radio automatically
+ *   ./cfmradio-bench -d /dev/radio1   # or any other receiver
+ *   ./cfmradio-bench -b sim           # or the simulated backend
+ *   ./cfmradio-bench -r run.trace     # record what the hardware did...
+ *   ./cfmradio-bench -b replay -d run.trace[,realtime]
+ *                                     # ...and replay it later
+ *   ./cfmradio-bench -D /dev/radio1,/dev/radio2
+ *                                     # also time a scan split across tuners
+ *
+ * Results are printed to stdout as a single JSON object, timings in
+ * microseconds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "radio.h"
+#include "scan_parallel.h"
+#include "dwell.h"
+#include "bench-util.h"
+
+#define SCAN_INCREMENT	100000
+
+static gchar *backend = "v4l2";
+static gchar *device = NULL;
+static gint iterations = 50;
+static gint rds_timeout = 10000;
+static gchar *scan_devices = NULL;
+static gchar *band = NULL;
+static gchar *trace = NULL;
+static CFmDwellConfig dwell;
+static guint dwell_samples, dwell_channels;
+
+static GOptionEntry entries[] = {
+	{ "backend", 'b', 0, G_OPTION_ARG_STRING, &backend, "Tuner backend (v4l2, sim)", "NAME" },
+	{ "device", 'd', 0, G_OPTION_ARG_STRING, &device, "Radio device, autodetected for vivid", "DEV" },
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Samples per measurement", "N" },
+	{ "rds-timeout", 't', 0, G_OPTION_ARG_INT, &rds_timeout, "Give up waiting for RDS PS after this many ms", "MS" },
+	{ "band", 'B', 0, G_OPTION_ARG_STRING, &band, "Band plan for the parallel scan", "PLAN" },
+	{ "trace", 'r', 0, G_OPTION_ARG_STRING, &trace, "Record all tuner operations to this file", "FILE" },
+	{ "scan-devices", 'D', 0, G_OPTION_ARG_STRING, &scan_devices, "Comma separated tuners for the parallel scan", "DEVS" },
+	{ NULL }
+};
+
+typedef struct {
+	const gchar *name;
+	guint n;
+	gint64 *samples;
+} Series;
+
+static void series_init(Series *s, const gchar *name, guint max)
+{
+	s->name = name;
+	s->n = 0;
+	s->samples = g_new(gint64, max);
+}
+
+static void series_print(Series *s, gboolean last)
+{
+	gint64 sum = 0;
+	guint i;
+
+	if (s->n == 0) {
+		printf("  \"%s\": null%s\n", s->name, last ? "" : ",");
+		g_free(s->samples);
+		return;
+	}
+
+	qsort(s->samples, s->n, sizeof(gint64), compare_int64);
+	for (i = 0; i < s->n; i++) sum += s->samples[i];
+
+	printf("  \"%s\": { \"n\": %u, \"min\": %" G_GINT64_FORMAT
+	       ", \"median\": %" G_GINT64_FORMAT ", \"mean\": %" G_GINT64_FORMAT
+	       ", \"max\": %" G_GINT64_FORMAT " }%s\n",
+	       s->name, s->n, s->samples[0], s->samples[s->n / 2], sum / s->n,
+	       s->samples[s->n - 1], last ? "" : ",");
+
+	g_free(s->samples);
+}
+
+/* Finds the radio node created by the vivid driver, if loaded. */
+static gchar* find_vivid_radio(void)
+{
+	gint i;
+	for (i = 0; i < 64; i++) {
+		gchar *dev = g_strdup_printf("/dev/radio%d", i);
+		struct v4l2_capability cap = { { 0 } };
+		int fd = open(dev, O_RDONLY);
+		if (fd >= 0) {
+			int res = ioctl(fd, VIDIOC_QUERYCAP, &cap);
+			close(fd);
+			if (res == 0 && strcmp((const char*) cap.driver, "vivid") == 0 &&
+			    (cap.device_caps & V4L2_CAP_TUNER)) {
+				return dev;
+			}
+		}
+		g_free(dev);
+	}
+	return NULL;
+}
+
+static void bench_tune(CFmRadio *radio, gulong low, gulong high, Series *tune,
+	Series *status)
+{
+	gint i;
+	for (i = 0; i < iterations; i++) {
+		gulong freq = low + ((high - low) / SCAN_INCREMENT * i / iterations) * SCAN_INCREMENT;
+		guint signal;
+		gint64 t0 = now_us();
+		g_object_set(G_OBJECT(radio), "frequency", freq, NULL);
+		gint64 t1 = now_us();
+		g_object_get(G_OBJECT(radio), "signal", &signal, NULL);
+		gint64 t2 = now_us();
+		tune->samples[tune->n++] = t1 - t0;
+		status->samples[status->n++] = t2 - t1;
+	}
+}
+
+static void bench_seek(CFmRadio *radio, gulong low, Series *seek)
+{
+	gint i;
+	g_object_set(G_OBJECT(radio), "frequency", low, NULL);
+	for (i = 0; i < iterations; i++) {
+		gint64 t0 = now_us();
+		cfm_radio_seek_up(radio);
+		seek->samples[seek->n++] = now_us() - t0;
+	}
+}
+
+/* Samples the current channel the way the scanner does. */
+static gboolean bench_dwell(CFmRadio *radio)
+{
+	CFmDwellResult result = CFM_DWELL_UNDECIDED;
+	CFmDwellStats stats;
+
+	cfm_dwell_stats_reset(&stats);
+	while (result == CFM_DWELL_UNDECIDED) {
+		guint signal;
+		g_usleep(dwell.interval_ms * 1000);
+		g_object_get(G_OBJECT(radio), "signal", &signal, NULL);
+		cfm_dwell_stats_add(&stats, signal);
+		result = cfm_dwell_decide(&dwell, &stats);
+	}
+
+	dwell_samples += stats.n;
+	dwell_channels++;
+	return result == CFM_DWELL_STATION;
+}
+
+/* The same seek loop "Scan for presets" runs in a full scan. */
+static guint bench_scan(CFmRadio *radio, gulong low, gulong high, Series *scan)
+{
+	guint stations = 0;
+	gulong freq = 0, prev;
+	gint64 t0 = now_us();
+
+	g_object_set(G_OBJECT(radio), "frequency", low, NULL);
+	cfm_radio_seek_up(radio);
+	for (;;) {
+		prev = freq;
+		g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
+		if (bench_dwell(radio)) stations++;
+		if (freq >= high || freq <= prev) break;
+		g_object_set(G_OBJECT(radio), "frequency", freq + SCAN_INCREMENT, NULL);
+		cfm_radio_seek_up(radio);
+	}
+
+	scan->samples[scan->n++] = now_us() - t0;
+	return stations;
+}
+
+typedef struct {
+	GMainLoop *loop;
+	guint stations;
+} ParallelResult;
+
+static void bench_parallel_done(CFmParallelScan *scan,
+	const CFmSpectrumPoint *stations, guint len,
+	gulong range_low, gulong range_high, gpointer user_data)
+{
+	ParallelResult *r = user_data;
+	r->stations = len;
+	g_main_loop_quit(r->loop);
+}
+
+/* The same band split across every tuner in scan_devices. */
+static guint bench_parallel_scan(CFmRadio *radio, Series *scan, guint *workers)
+{
+	gchar **devices = g_strsplit(scan_devices, ",", 0);
+	ParallelResult r = { g_main_loop_new(NULL, FALSE), 0 };
+	CFmParallelScan *ps;
+	gint64 t0 = now_us();
+
+	ps = cfm_parallel_scan_start(backend, devices,
+		cfm_radio_get_band_plan(radio), &dwell, bench_parallel_done, &r);
+	if (ps) {
+		*workers = cfm_parallel_scan_get_n_workers(ps);
+		g_main_loop_run(r.loop);
+		scan->samples[scan->n++] = now_us() - t0;
+	}
+
+	g_main_loop_unref(r.loop);
+	g_strfreev(devices);
+	return r.stations;
+}
+
+typedef struct {
+	GMainLoop *loop;
+	gint64 t0;
+	Series *rds;
+} RdsWait;
+
+static void bench_rds_ps(GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+	RdsWait *w = user_data;
+	gchar *ps = NULL;
+
+	g_object_get(object, "rds-ps", &ps, NULL);
+	if (ps && strlen(g_strstrip(ps)) > 0 && w->rds->n == 0) {
+		w->rds->samples[w->rds->n++] = now_us() - w->t0;
+		g_main_loop_quit(w->loop);
+	}
+	g_free(ps);
+}
+
+static gboolean bench_rds_timeout(gpointer user_data)
+{
+	RdsWait *w = user_data;
+	g_main_loop_quit(w->loop);
+	return FALSE;
+}
+
+static void bench_rds(CFmRadio *radio, gulong low, gulong high, Series *rds)
+{
+	RdsWait w = { g_main_loop_new(NULL, FALSE), 0, rds };
+	gulong freq = low;
+	gulong handler;
+	guint timer;
+
+	/* Find something that is likely to carry RDS first. */
+	g_object_set(G_OBJECT(radio), "frequency", low, NULL);
+	cfm_radio_seek_up(radio);
+	g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
+	g_object_set(G_OBJECT(radio), "frequency", freq, NULL);
+
+	/* RDS is refreshed from the main loop as it changes. */
+	w.t0 = now_us();
+	handler = g_signal_connect(G_OBJECT(radio), "notify::rds-ps",
+		G_CALLBACK(bench_rds_ps), &w);
+	timer = g_timeout_add(rds_timeout, bench_rds_timeout, &w);
+	g_main_loop_run(w.loop);
+
+	if (rds->n) {
+		g_source_remove(timer);
+	}
+	g_signal_handler_disconnect(G_OBJECT(radio), handler);
+	g_main_loop_unref(w.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	CFmRadio *radio;
+	gulong low, high;
+	Series tune, status, seek, scan, pscan, rds;
+	guint stations, pstations = 0, workers = 0;
+
+	if (!g_thread_supported()) g_thread_init(NULL);
+	g_type_init();
+
+	context = g_option_context_new("- benchmark CFmRadio against a V4L2 receiver");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	cfm_dwell_config_init(&dwell);
+
+	if (!device && strcmp(backend, "v4l2") == 0) {
+		device = find_vivid_radio();
+		if (!device) {
+			g_printerr("No vivid radio receiver found; load it with "
+			           "'modprobe vivid node_types=0x10' or pass -d\n");
+			return 77;
+		}
+	}
+	if (!device) device = "";
+
+	radio = g_object_new(CFM_TYPE_RADIO, "backend", backend, "device", device,
+	                     "trace", trace, NULL);
+	if (band) {
+		g_object_set(G_OBJECT(radio), "band", band, NULL);
+	}
+	g_object_get(G_OBJECT(radio), "range-low", &low, "range-high", &high, NULL);
+	if (high <= low) {
+		g_printerr("Could not open tuner %s\n", device);
+		return 1;
+	}
+
+	series_init(&tune, "tune_us", iterations);
+	series_init(&status, "status_us", iterations);
+	series_init(&seek, "seek_us", iterations);
+	series_init(&scan, "full_scan_us", 1);
+	series_init(&pscan, "parallel_scan_us", 1);
+	series_init(&rds, "rds_first_ps_us", 1);
+
+	bench_tune(radio, low, high, &tune, &status);
+	bench_seek(radio, low, &seek);
+	stations = bench_scan(radio, low, high, &scan);
+	if (scan_devices) {
+		pstations = bench_parallel_scan(radio, &pscan, &workers);
+	}
+	bench_rds(radio, low, high, &rds);
+
+	printf("{\n");
+	printf("  \"backend\": ");
+	print_json_string(backend);
+	printf(",\n  \"device\": ");
+	print_json_string(device);
+	printf(",\n");
+	printf("  \"range_low\": %lu,\n", low);
+	printf("  \"range_high\": %lu,\n", high);
+	printf("  \"stations_found\": %u,\n", stations);
+	printf("  \"dwell_samples_per_channel\": %.2f,\n",
+	       dwell_channels ? (double) dwell_samples / dwell_channels : 0.0);
+	printf("  \"dwell_max_samples\": %u,\n", dwell.max_samples);
+	printf("  \"parallel_workers\": %u,\n", workers);
+	printf("  \"parallel_stations_found\": %u,\n", pstations);
+	series_print(&tune, FALSE);
+	series_print(&status, FALSE);
+	series_print(&seek, FALSE);
+	series_print(&scan, FALSE);
+	series_print(&pscan, FALSE);
+	series_print(&rds, TRUE);
+	printf("}\n");
+
+	g_object_unref(G_OBJECT(radio));
+
+	return 0;
+}
@@ -0,0 +1,597 @@
+/*
+ * GPL 2
+ */
+
+/* Measures how fast RDS is decoded, without any hardware: a capture is
+ * replayed through the same steps CFmRadio takes, as fast as possible, a
+ * few times. Raw blocks go through the group decoder and strings read
+ * through sysfs through the vote; either way, changed texts are converted
+ * to UTF-8. Without a capture, a synthetic one is used, see rds-synth.c.
+ * Converting texts from the RDS character set to UTF-8 is measured too,
+ * against the original per character rds_decode().
+ *
+ *   ./cfmradio-rds-bench              # 1M synthetic groups, no errors
+ *   ./cfmradio-rds-bench -e 20        # 2% of blocks uncorrectable
+ *   ./cfmradio-rds-bench -f drive.rds # a capture from cfmradio-rds-capture
+ *   ./cfmradio-rds-bench -w synth.rds # also save the synthetic capture
+ *
+ * Allocations are counted through g_mem_set_vtable(), where GLib still
+ * honours it. Results are printed to stdout as a single JSON object. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rds_decoder.h"
+#include "rds_capture.h"
+#include "rds.h"
+#include "rds-synth.h"
+#include "bench-util.h"
+
+static gint groups = 1000000;
+static gint error_rate = 0;
+static gint rounds = 5;
+static gint charset_iterations = 200000;
+static gchar *capture_file = NULL;
+static gchar *write_file = NULL;
+
+static GOptionEntry entries[] = {
+	{ "groups", 'n', 0, G_OPTION_ARG_INT, &groups, "Groups in the synthetic stream", "N" },
+	{ "errors", 'e', 0, G_OPTION_ARG_INT, &error_rate, "Uncorrectable blocks per 1000", "N" },
+	{ "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds, "Times the stream is decoded", "N" },
+	{ "charset", 'c', 0, G_OPTION_ARG_INT, &charset_iterations, "Texts converted to UTF-8 per decoder", "N" },
+	{ "file", 'f', 0, G_OPTION_ARG_FILENAME, &capture_file, "Replay this capture instead", "FILE" },
+	{ "write", 'w', 0, G_OPTION_ARG_FILENAME, &write_file, "Save the synthetic capture here", "FILE" },
+	{ NULL }
+};
+
+static const gchar * const rds_keys[] = { "rds_pi", "rds_ps", "rds_rt" };
+
+/* Raw texts as received: a PS, a plain RadioText and one with accents. */
+static const gchar * const charset_texts[] = {
+	"CADENA S",
+	"Hoy por hoy - con Angels Barcelo, de lunes a viernes de 6 a 12h",
+	"Canci\206n del a\232o: Mar\204a Jos\202 - Las r\202plicas ($)"
+};
+
+static guint allocations;
+
+static gpointer count_malloc(gsize n)
+{
+	allocations++;
+	return malloc(n);
+}
+
+static gpointer count_realloc(gpointer p, gsize n)
+{
+	allocations++;
+	return realloc(p, n);
+}
+
+static gpointer count_calloc(gsize n, gsize size)
+{
+	allocations++;
+	return calloc(n, size);
+}
+
+static GMemVTable count_vtable = {
+	count_malloc, count_realloc, free, count_calloc, NULL, NULL
+};
+
+/* The table rds.c had before it was generated, kept verbatim so that
+ * the comparison does not depend on the code being measured. It came
+ * from pyFMRadio. */
+static const gunichar old_table[256] = {
+	0,	/* 0 */
+	0,	/* 1 */
+	0,	/* 2 */
+	0,	/* 3 */
+	0,	/* 4 */
+	0,	/* 5 */
+	0,	/* 6 */
+	0,	/* 7 */
+	0,	/* 8 */
+	0,	/* 9 */
+	0,	/* 10 */
+	0,	/* 11 */
+	0,	/* 12 */
+	0,	/* 13 */
+	0,	/* 14 */
+	0,	/* 15 */
+	0,	/* 16 */
+	0,	/* 17 */
+	0,	/* 18 */
+	0,	/* 19 */
+	0,	/* 20 */
+	0,	/* 21 */
+	0,	/* 22 */
+	0,	/* 23 */
+	0,	/* 24 */
+	0,	/* 25 */
+	0,	/* 26 */
+	0,	/* 27 */
+	0,	/* 28 */
+	0,	/* 29 */
+	0,	/* 30 */
+	0,	/* 31 */
+	32,	/* 32 */
+	33,	/* 33 */
+	34,	/* 34 */
+	35,	/* 35 */
+	164,	/* 36 */
+	37,	/* 37 */
+	38,	/* 38 */
+	39,	/* 39 */
+	40,	/* 40 */
+	41,	/* 41 */
+	42,	/* 42 */
+	43,	/* 43 */
+	44,	/* 44 */
+	45,	/* 45 */
+	46,	/* 46 */
+	47,	/* 47 */
+	48,	/* 48 */
+	49,	/* 49 */
+	50,	/* 50 */
+	51,	/* 51 */
+	52,	/* 52 */
+	53,	/* 53 */
+	54,	/* 54 */
+	55,	/* 55 */
+	56,	/* 56 */
+	57,	/* 57 */
+	58,	/* 58 */
+	59,	/* 59 */
+	60,	/* 60 */
+	61,	/* 61 */
+	62,	/* 62 */
+	63,	/* 63 */
+	64,	/* 64 */
+	65,	/* 65 */
+	66,	/* 66 */
+	67,	/* 67 */
+	68,	/* 68 */
+	69,	/* 69 */
+	70,	/* 70 */
+	71,	/* 71 */
+	72,	/* 72 */
+	73,	/* 73 */
+	74,	/* 74 */
+	75,	/* 75 */
+	76,	/* 76 */
+	77,	/* 77 */
+	78,	/* 78 */
+	79,	/* 79 */
+	80,	/* 80 */
+	81,	/* 81 */
+	82,	/* 82 */
+	83,	/* 83 */
+	84,	/* 84 */
+	85,	/* 85 */
+	86,	/* 86 */
+	87,	/* 87 */
+	88,	/* 88 */
+	89,	/* 89 */
+	90,	/* 90 */
+	91,	/* 91 */
+	92,	/* 92 */
+	93,	/* 93 */
+	32,	/* 94 */
+	32,	/* 95 */
+	32,	/* 96 */
+	97,	/* 97 */
+	98,	/* 98 */
+	99,	/* 99 */
+	100,	/* 100 */
+	101,	/* 101 */
+	102,	/* 102 */
+	103,	/* 103 */
+	104,	/* 104 */
+	105,	/* 105 */
+	106,	/* 106 */
+	107,	/* 107 */
+	108,	/* 108 */
+	109,	/* 109 */
+	110,	/* 110 */
+	111,	/* 111 */
+	112,	/* 112 */
+	113,	/* 113 */
+	114,	/* 114 */
+	115,	/* 115 */
+	116,	/* 116 */
+	117,	/* 117 */
+	118,	/* 118 */
+	119,	/* 119 */
+	120,	/* 120 */
+	121,	/* 121 */
+	122,	/* 122 */
+	123,	/* 123 */
+	124,	/* 124 */
+	125,	/* 125 */
+	32,	/* 126 */
+	32,	/* 127 */
+	225,	/* 128 */
+	224,	/* 129 */
+	233,	/* 130 */
+	232,	/* 131 */
+	237,	/* 132 */
+	236,	/* 133 */
+	243,	/* 134 */
+	242,	/* 135 */
+	250,	/* 136 */
+	249,	/* 137 */
+	209,	/* 138 */
+	199,	/* 139 */
+	350,	/* 140 */
+	223,	/* 141 */
+	161,	/* 142 */
+	306,	/* 143 */
+	226,	/* 144 */
+	228,	/* 145 */
+	234,	/* 146 */
+	235,	/* 147 */
+	238,	/* 148 */
+	239,	/* 149 */
+	244,	/* 150 */
+	246,	/* 151 */
+	251,	/* 152 */
+	252,	/* 153 */
+	241,	/* 154 */
+	231,	/* 155 */
+	351,	/* 156 */
+	287,	/* 157 */
+	63,	/* 158 */
+	307,	/* 159 */
+	170,	/* 160 */
+	945,	/* 161 */
+	169,	/* 162 */
+	8240,	/* 163 */
+	486,	/* 164 */
+	277,	/* 165 */
+	328,	/* 166 */
+	337,	/* 167 */
+	960,	/* 168 */
+	63,	/* 169 */
+	163,	/* 170 */
+	36,	/* 171 */
+	8592,	/* 172 */
+	8593,	/* 173 */
+	8594,	/* 174 */
+	8595,	/* 175 */
+	186,	/* 176 */
+	185,	/* 177 */
+	178,	/* 178 */
+	179,	/* 179 */
+	177,	/* 180 */
+	304,	/* 181 */
+	324,	/* 182 */
+	369,	/* 183 */
+	956,	/* 184 */
+	191,	/* 185 */
+	247,	/* 186 */
+	176,	/* 187 */
+	188,	/* 188 */
+	189,	/* 189 */
+	190,	/* 190 */
+	167,	/* 191 */
+	193,	/* 192 */
+	192,	/* 193 */
+	201,	/* 194 */
+	200,	/* 195 */
+	205,	/* 196 */
+	204,	/* 197 */
+	211,	/* 198 */
+	210,	/* 199 */
+	218,	/* 200 */
+	217,	/* 201 */
+	344,	/* 202 */
+	268,	/* 203 */
+	352,	/* 204 */
+	381,	/* 205 */
+	272,	/* 206 */
+	317,	/* 207 */
+	194,	/* 208 */
+	196,	/* 209 */
+	202,	/* 210 */
+	203,	/* 211 */
+	206,	/* 212 */
+	207,	/* 213 */
+	212,	/* 214 */
+	214,	/* 215 */
+	219,	/* 216 */
+	220,	/* 217 */
+	345,	/* 218 */
+	269,	/* 219 */
+	353,	/* 220 */
+	382,	/* 221 */
+	271,	/* 222 */
+	318,	/* 223 */
+	195,	/* 224 */
+	197,	/* 225 */
+	198,	/* 226 */
+	338,	/* 227 */
+	375,	/* 228 */
+	221,	/* 229 */
+	213,	/* 230 */
+	216,	/* 231 */
+	254,	/* 232 */
+	330,	/* 233 */
+	340,	/* 234 */
+	262,	/* 235 */
+	346,	/* 236 */
+	377,	/* 237 */
+	63,	/* 238 */
+	240,	/* 239 */
+	227,	/* 240 */
+	229,	/* 241 */
+	230,	/* 242 */
+	339,	/* 243 */
+	373,	/* 244 */
+	253,	/* 245 */
+	245,	/* 246 */
+	248,	/* 247 */
+	254,	/* 248 */
+	331,	/* 249 */
+	341,	/* 250 */
+	263,	/* 251 */
+	347,	/* 252 */
+	378,	/* 253 */
+	63,	/* 254 */
+	32,	/* 255 */
+};
+
+/* rds_decode() as it was before it was table driven. */
+static gchar* old_rds_decode(const gchar *s)
+{
+	guint l = strlen(s);
+	GString *b = g_string_sized_new(2 * l);
+
+	guchar *c = (guchar*) s;
+	while (*c) {
+		g_string_append_unichar(b, old_table[*c]);
+		c++;
+	}
+
+	gchar *r = b->str;
+	g_string_free(b, FALSE);
+	return r;
+}
+
+/* Prints a JSON member holding text as received, in the RDS set. */
+static void print_json_rds(const gchar *name, const gchar *raw)
+{
+	gchar buf[CFM_RDS_TEXT_MAX * RDS_UTF8_MAX_LEN + 1];
+
+	rds_decode_to(raw, buf, sizeof(buf));
+	printf("  \"%s\": ", name);
+	print_json_string(buf);
+	printf(",\n");
+}
+
+typedef struct {
+	CFmRdsDecoder d;
+	CFmRdsText strings[G_N_ELEMENTS(rds_keys)];
+	gchar text[CFM_RDS_TEXT_MAX * RDS_UTF8_MAX_LEN + 1];
+	guint records, changes;
+} Replay;
+
+static void replay_string(Replay *r, const CFmRdsCaptureRecord *rec)
+{
+	guint k;
+	for (k = 0; k < G_N_ELEMENTS(rds_keys); k++) {
+		if (rec->key_len == strlen(rds_keys[k]) &&
+		    memcmp(rec->key, rds_keys[k], rec->key_len) == 0) {
+			break;
+		}
+	}
+	if (k == G_N_ELEMENTS(rds_keys)) return;
+
+	if (cfm_rds_text_vote_string(&r->strings[k], (const gchar*) rec->data, rec->len)) {
+		rds_decode_to(r->strings[k].text, r->text, sizeof(r->text));
+		r->changes++;
+	}
+}
+
+/* What radio.c does with every read from the tuner. */
+static void replay_all(Replay *r, CFmRdsReplay *replay)
+{
+	CFmRdsCaptureRecord rec;
+	guint k;
+
+	cfm_rds_decoder_init(&r->d);
+	for (k = 0; k < G_N_ELEMENTS(rds_keys); k++) {
+		cfm_rds_text_init(&r->strings[k], 0);
+	}
+	r->records = r->changes = 0;
+
+	cfm_rds_replay_rewind(replay);
+	while (cfm_rds_replay_next(replay, &rec)) {
+		r->records++;
+		if (rec.type == CFM_RDS_CAPTURE_BLOCKS) {
+			const guint changed = cfm_rds_decoder_feed(&r->d, rec.data, rec.len);
+			if (changed & CFM_RDS_CHANGED_PS) {
+				rds_decode_to(r->d.ps.text, r->text, sizeof(r->text));
+			}
+			if (changed & CFM_RDS_CHANGED_RT) {
+				rds_decode_to(r->d.rt.text, r->text, sizeof(r->text));
+			}
+			if (changed & CFM_RDS_CHANGED_ERT) {
+				rds_decode_charset_to(r->d.ert_utf8 ? RDS_CHARSET_UTF8 : RDS_CHARSET_UCS2,
+					r->d.ert.text, r->d.ert.text_len, r->text, sizeof(r->text));
+			}
+			if (changed) r->changes++;
+		} else if (rec.type == CFM_RDS_CAPTURE_STRING) {
+			replay_string(r, &rec);
+		}
+	}
+}
+
+static void bench_charset(void)
+{
+	const guint n_texts = G_N_ELEMENTS(charset_texts);
+	gchar buf[CFM_RDS_RT_LEN * RDS_UTF8_MAX_LEN + 1];
+	gint64 t_old, t_new, t_to;
+	gboolean match = TRUE;
+	gint i;
+
+	for (i = 0; i < (gint) n_texts; i++) {
+		gchar *a = old_rds_decode(charset_texts[i]);
+		gchar *b = rds_decode(charset_texts[i]);
+		rds_decode_to(charset_texts[i], buf, sizeof(buf));
+		match = match && strcmp(a, b) == 0 && strcmp(a, buf) == 0;
+		g_free(a);
+		g_free(b);
+	}
+	for (i = 1; i < 256; i++) {
+		/* Every character on its own, not just those in the texts */
+		const gchar s[2] = { i, '\0' };
+		gchar *a = old_rds_decode(s);
+		gchar *b = rds_decode(s);
+		match = match && strcmp(a, b) == 0;
+		g_free(a);
+		g_free(b);
+	}
+
+	t_old = now_us();
+	for (i = 0; i < charset_iterations; i++) {
+		g_free(old_rds_decode(charset_texts[i % n_texts]));
+	}
+	t_old = MAX(now_us() - t_old, 1);
+
+	t_new = now_us();
+	for (i = 0; i < charset_iterations; i++) {
+		g_free(rds_decode(charset_texts[i % n_texts]));
+	}
+	t_new = MAX(now_us() - t_new, 1);
+
+	t_to = now_us();
+	for (i = 0; i < charset_iterations; i++) {
+		rds_decode_to(charset_texts[i % n_texts], buf, sizeof(buf));
+	}
+	t_to = MAX(now_us() - t_to, 1);
+
+	printf("  \"charset\": {\n");
+	printf("    \"texts\": %d,\n", charset_iterations);
+	printf("    \"outputs_match\": %s,\n", match ? "true" : "false");
+	printf("    \"old_ns_per_text\": %.1f,\n", t_old * 1000.0 / charset_iterations);
+	printf("    \"new_ns_per_text\": %.1f,\n", t_new * 1000.0 / charset_iterations);
+	printf("    \"into_buffer_ns_per_text\": %.1f,\n", t_to * 1000.0 / charset_iterations);
+	printf("    \"speedup\": %.2f\n", (gdouble) t_old / t_new);
+	printf("  }\n");
+	printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GByteArray *capture = NULL;
+	gchar *file_data = NULL;
+	const guint8 *data;
+	gsize len;
+	CFmRdsReplay replay;
+	Replay r;
+	gint64 *times;
+	guint64 span_us = 0;
+	guint allocs, probe;
+	gboolean counting;
+	gint i;
+
+	/* Before anything else is allocated. */
+	g_mem_set_vtable(&count_vtable);
+	probe = allocations;
+	g_free(g_malloc(1));
+	counting = allocations != probe;
+
+	context = g_option_context_new("- benchmark RDS decoding");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		return 2;
+	}
+	g_option_context_free(context);
+	if (groups < RDS_SYNTH_CYCLE || rounds < 1 || charset_iterations < 1) {
+		g_printerr("Need at least %d groups, one round and one text\n", RDS_SYNTH_CYCLE);
+		return 2;
+	}
+
+	if (capture_file) {
+		if (!g_file_get_contents(capture_file, &file_data, &len, &error)) {
+			g_printerr("%s\n", error->message);
+			return 1;
+		}
+		data = (const guint8*) file_data;
+	} else {
+		capture = rds_synth_capture(groups, error_rate);
+		data = capture->data;
+		len = capture->len;
+		if (write_file && !g_file_set_contents(write_file, (const gchar*) data, len, &error)) {
+			g_printerr("%s\n", error->message);
+			return 1;
+		}
+	}
+	if (!cfm_rds_replay_init(&replay, data, len)) {
+		g_printerr("Not an RDS capture: %s\n", capture_file);
+		return 1;
+	}
+
+	times = g_new(gint64, rounds);
+	allocs = 0;
+	for (i = 0; i < rounds; i++) {
+		const guint before = allocations;
+		gint64 t0 = now_us();
+		replay_all(&r, &replay);
+		times[i] = MAX(now_us() - t0, 1);
+		allocs += allocations - before;
+	}
+	span_us = replay.time_us;
+	qsort(times, rounds, sizeof(gint64), compare_int64);
+
+	printf("{\n");
+	printf("  \"source\": \"%s\",\n", capture_file ? "capture" : "synthetic");
+	if (!capture_file) {
+		printf("  \"error_rate_per_mille\": %d,\n", error_rate);
+	}
+	printf("  \"records\": %u,\n", r.records);
+	printf("  \"groups\": %u,\n", r.d.groups);
+	printf("  \"rounds\": %d,\n", rounds);
+	printf("  \"decode_us\": { \"min\": %" G_GINT64_FORMAT ", \"median\": %"
+	       G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT " },\n",
+	       times[0], times[rounds / 2], times[rounds - 1]);
+	printf("  \"groups_per_second\": %.0f,\n",
+	       r.d.groups / (times[rounds / 2] / 1000000.0));
+	printf("  \"records_per_second\": %.0f,\n",
+	       r.records / (times[rounds / 2] / 1000000.0));
+	printf("  \"ns_per_group\": %.1f,\n",
+	       r.d.groups ? times[rounds / 2] * 1000.0 / r.d.groups : 0.0);
+	if (counting) {
+		printf("  \"allocations_per_group\": %.4f,\n",
+		       r.d.groups ? (gdouble) allocs / rounds / r.d.groups : 0.0);
+	} else {
+		printf("  \"allocations_per_group\": null,\n");
+	}
+	printf("  \"times_realtime\": %.0f,\n", (gdouble) span_us / times[rounds / 2]);
+	printf("  \"block_errors\": %u,\n", r.d.errors);
+	printf("  \"sync_lost\": %u,\n", r.d.sync_lost);
+	printf("  \"reads_with_changes\": %u,\n", r.changes);
+	printf("  \"pi\": \"%04X\",\n", r.d.pi);
+	print_json_rds("ps", r.d.ps.text);
+	printf("  \"af\": %u,\n", r.d.n_af);
+	print_json_rds("artist", r.d.artist);
+	print_json_rds("title", r.d.title);
+	rds_decode_charset_to(r.d.ert_utf8 ? RDS_CHARSET_UTF8 : RDS_CHARSET_UCS2,
+		r.d.ert.text, r.d.ert.text_len, r.text, sizeof(r.text));
+	printf("  \"ert\": ");
+	print_json_string(r.text);
+	printf(",\n");
+
+	g_free(times);
+	g_free(file_data);
+	if (capture) g_byte_array_free(capture, TRUE);
+
+	bench_charset();
+
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * GPL 2
+ */
+
+/* Records the RDS a tuner hands out, for cfmradio-rds-bench and
+ * cfmradio-rds-fuzz to replay later without the hardware:
+ *
+ *   ./cfmradio-rds-capture -d /dev/radio0 -f 93.9 -t 120 ser.rds
+ *   ./cfmradio-rds-capture -f 93.9 -s sysfs.rds  # strings, like the N900
+ *
+ * Raw blocks are recorded when the tuner provides them, as they are read;
+ * otherwise, or with -s, each RDS string is read every 250 ms the way
+ * CFmRadio polls them, repeats included, since the vote depends on those. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tuner_backend.h"
+#include "rds_decoder.h"
+#include "rds_capture.h"
+#include "bench-util.h"
+
+#define BLOCKS_POLL_MS   20
+#define STRINGS_POLL_MS  250
+#define READ_BLOCKS      64
+#define STRING_LEN       128
+
+static gchar *backend = "v4l2";
+static gchar *device = "/dev/radio0";
+static gdouble frequency = 0.0;
+static gint seconds = 60;
+static gboolean strings = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "backend", 'b', 0, G_OPTION_ARG_STRING, &backend, "Tuner backend (v4l2, sim)", "NAME" },
+	{ "device", 'd', 0, G_OPTION_ARG_STRING, &device, "Radio device", "DEV" },
+	{ "frequency", 'f', 0, G_OPTION_ARG_DOUBLE, &frequency, "Tune here first, in MHz", "MHZ" },
+	{ "time", 't', 0, G_OPTION_ARG_INT, &seconds, "Stop after this many seconds", "S" },
+	{ "strings", 's', 0, G_OPTION_ARG_NONE, &strings, "Record the RDS strings even if raw blocks are available", NULL },
+	{ NULL }
+};
+
+static const gchar * const rds_keys[] = { "rds_pi", "rds_ps", "rds_rt" };
+
+static gboolean flush(GByteArray *buf, FILE *f)
+{
+	gboolean ok = fwrite(buf->data, 1, buf->len, f) == buf->len;
+	g_byte_array_set_size(buf, 0);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	CFmTunerBackend *b;
+	GByteArray *buf;
+	FILE *f;
+	gint64 start, last, end;
+	guint records = 0;
+	gsize bytes = 0;
+	gboolean blocks, ok = TRUE;
+
+	context = g_option_context_new("FILE - record RDS for replaying later");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		return 2;
+	}
+	g_option_context_free(context);
+	if (argc != 2) {
+		g_printerr("Need exactly one file to record to\n");
+		return 2;
+	}
+
+	b = cfm_tuner_backend_new(backend);
+	if (!b || !cfm_tuner_backend_open(b, device)) {
+		g_printerr("Cannot open %s tuner %s\n", backend, device);
+		return 1;
+	}
+	cfm_tuner_backend_power(b, TRUE);
+	if (frequency > 0.0 && !cfm_tuner_backend_tune(b, frequency * 1000000.0 + 0.5)) {
+		g_printerr("Cannot tune to %.2f MHz\n", frequency);
+		return 1;
+	}
+
+	f = fopen(argv[1], "wb");
+	if (!f) {
+		g_printerr("Cannot write to %s\n", argv[1]);
+		return 1;
+	}
+
+	buf = g_byte_array_new();
+	cfm_rds_capture_begin(buf);
+
+	/* An empty read tells whether raw blocks are available at all. */
+	blocks = !strings && cfm_tuner_backend_read_rds_blocks(b, NULL, 0) >= 0;
+	start = last = now_us();
+	end = start + (gint64) seconds * G_USEC_PER_SEC;
+	while (ok && now_us() < end) {
+		if (blocks) {
+			guint8 data[READ_BLOCKS * CFM_RDS_BLOCK_SIZE];
+			const gssize n = cfm_tuner_backend_read_rds_blocks(b, data, sizeof(data));
+			if (n > 0) {
+				const gint64 now = now_us();
+				cfm_rds_capture_append(buf, CFM_RDS_CAPTURE_BLOCKS, now - last,
+					NULL, data, n);
+				last = now;
+				records++;
+			} else if (n < 0) {
+				break;
+			}
+			g_usleep(BLOCKS_POLL_MS * 1000);
+		} else {
+			guint k;
+			for (k = 0; k < G_N_ELEMENTS(rds_keys); k++) {
+				gchar data[STRING_LEN];
+				const gssize n = cfm_tuner_backend_read_rds_into(b, rds_keys[k],
+					data, sizeof(data));
+				const gint64 now = now_us();
+				cfm_rds_capture_append(buf, CFM_RDS_CAPTURE_STRING, now - last,
+					rds_keys[k], (const guint8*) data, MAX(n, 0));
+				last = now;
+				records++;
+			}
+			g_usleep(STRINGS_POLL_MS * 1000);
+		}
+		bytes += buf->len;
+		ok = flush(buf, f);
+	}
+
+	if (!ok || fclose(f) != 0) {
+		g_printerr("Failed to write %s\n", argv[1]);
+		return 1;
+	}
+	printf("%u %s records, %" G_GSIZE_FORMAT " bytes in %.1f s\n", records,
+		blocks ? "block" : "string", bytes, (now_us() - start) / 1000000.0);
+
+	g_byte_array_free(buf, TRUE);
+	cfm_tuner_backend_power(b, FALSE);
+	cfm_tuner_backend_free(b);
+
+	return 0;
+}
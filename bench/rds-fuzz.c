@@ -0,0 +1,396 @@
+/*
+ * GPL 2
+ */
+
+/* Feeds corrupted RDS to the decoding path and checks that what comes out
+ * still holds together: texts within their lengths and valid UTF-8 once
+ * converted, RT+ artist and title taken from the RadioText, AFs inside the
+ * band, clock times that exist, statistics that add up. Each run takes a
+ * stretch of a seed, corrupts it a few times and then either feeds its
+ * blocks to the group decoder in reads of random size, or replays the
+ * corrupted capture file itself, strings included.
+ *
+ *   ./cfmradio-rds-fuzz                        # seeded from rds-synth.c
+ *   ./cfmradio-rds-fuzz -n 1000000 -S 7 *.rds  # from captures, see
+ *                                              # cfmradio-rds-capture
+ *
+ * It finds more when built with sanitizers, e.g.
+ *   make fuzz-rds CFLAGS="-O1 -g -fsanitize=address,undefined" \
+ *       LDFLAGS=-fsanitize=address,undefined
+ * The first input that fails is saved as a capture, which
+ * cfmradio-rds-bench -f replays. Built with -DRDS_FUZZ_LIBFUZZER and
+ * -fsanitize=fuzzer instead, this is a libFuzzer target. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "rds_decoder.h"
+#include "rds_capture.h"
+#include "rds.h"
+#include "rds-synth.h"
+
+#define MAX_BLOCKS      4096
+#define MAX_CAPTURE     (64 * 1024)
+#define MAX_READ_BLOCKS 64
+#define AF_LOW          87600000
+#define AF_HIGH         107900000
+
+static const gchar * const rds_keys[] = { "rds_pi", "rds_ps", "rds_rt" };
+
+/* ---- Checks ---- */
+
+static const gchar* check_text(const gchar *raw, guint max_len)
+{
+	gchar buf[CFM_RDS_TEXT_MAX * RDS_UTF8_MAX_LEN + 1];
+	gsize n;
+
+	if (strlen(raw) > max_len) return "text longer than its field";
+
+	n = rds_decode_to(raw, buf, sizeof(buf));
+	if (n >= sizeof(buf) || strlen(buf) != n) return "converted text overflows";
+	if (!g_utf8_validate(buf, -1, NULL)) return "converted text is not UTF-8";
+
+	return NULL;
+}
+
+static const gchar* check_ert(const CFmRdsDecoder *d)
+{
+	gchar buf[CFM_RDS_ERT_LEN * RDS_UTF8_MAX_LEN + 1];
+	gsize n;
+
+	if (d->ert.text_len > CFM_RDS_ERT_LEN) return "text longer than its field";
+
+	n = rds_decode_charset_to(d->ert_utf8 ? RDS_CHARSET_UTF8 : RDS_CHARSET_UCS2,
+		d->ert.text, d->ert.text_len, buf, sizeof(buf));
+	if (n >= sizeof(buf) || strlen(buf) != n) return "converted eRT overflows";
+	if (!g_utf8_validate(buf, -1, NULL)) return "converted eRT is not UTF-8";
+
+	return NULL;
+}
+
+static const gchar* check_decoder(const CFmRdsDecoder *d)
+{
+	const gchar *error;
+	guint i;
+
+	if (d->errors > d->blocks || d->groups > d->blocks / 4) {
+		return "statistics do not add up";
+	}
+	if (d->n_af > CFM_RDS_MAX_AF) return "too many AFs";
+	for (i = 0; i < d->n_af; i++) {
+		if (d->af[i] < AF_LOW || d->af[i] > AF_HIGH) return "AF out of the band";
+	}
+	if (d->has_ct && (d->ct_hour > 23 || d->ct_minute > 59 || d->ct_mjd == 0)) {
+		return "clock time that does not exist";
+	}
+	if ((error = check_text(d->ps.text, CFM_RDS_PS_LEN))) return error;
+	if (!strstr(d->rt.text, d->artist) || !strstr(d->rt.text, d->title)) {
+		return "RT+ tag not from the RadioText";
+	}
+	if ((error = check_text(d->artist, CFM_RDS_RT_LEN))) return error;
+	if ((error = check_text(d->title, CFM_RDS_RT_LEN))) return error;
+	if ((error = check_ert(d))) return error;
+	return check_text(d->rt.text, CFM_RDS_RT_LEN);
+}
+
+/* ---- Running ---- */
+
+static guint32 rng_state = 1;
+
+static guint32 rng(void)
+{
+	/* xorshift32: the same runs for the same seed everywhere. */
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static guint rng_below(guint n)
+{
+	return n ? rng() % n : 0;
+}
+
+static const gchar* run_blocks(const guint8 *data, gsize len, gboolean random_reads)
+{
+	CFmRdsDecoder d;
+	const gchar *error;
+	gsize off = 0;
+
+	cfm_rds_decoder_init(&d);
+	while (off < len) {
+		const gsize n = random_reads ?
+			MIN(len - off, (1 + rng_below(MAX_READ_BLOCKS)) * CFM_RDS_BLOCK_SIZE) :
+			len - off;
+		cfm_rds_decoder_feed(&d, data + off, n);
+		if ((error = check_decoder(&d))) return error;
+		off += n;
+	}
+
+	return NULL;
+}
+
+/* Replays a capture, which may itself be corrupt, like cfmradio-rds-bench. */
+static const gchar* run_capture(const guint8 *data, gsize len)
+{
+	CFmRdsReplay replay;
+	CFmRdsCaptureRecord rec;
+	CFmRdsDecoder d;
+	CFmRdsText strings[G_N_ELEMENTS(rds_keys)];
+	const gchar *error;
+	guint k;
+
+	if (!cfm_rds_replay_init(&replay, data, len)) return NULL;
+
+	cfm_rds_decoder_init(&d);
+	for (k = 0; k < G_N_ELEMENTS(rds_keys); k++) {
+		cfm_rds_text_init(&strings[k], 0);
+	}
+
+	while (cfm_rds_replay_next(&replay, &rec)) {
+		if (rec.key < (const gchar*) data || rec.data < data ||
+		    rec.data + rec.len > data + len || rec.key + rec.key_len > (const gchar*) rec.data) {
+			return "capture record outside the capture";
+		}
+		if (rec.type == CFM_RDS_CAPTURE_BLOCKS) {
+			cfm_rds_decoder_feed(&d, rec.data, rec.len);
+			if ((error = check_decoder(&d))) return error;
+		} else if (rec.type == CFM_RDS_CAPTURE_STRING) {
+			for (k = 0; k < G_N_ELEMENTS(rds_keys); k++) {
+				if (rec.key_len == strlen(rds_keys[k]) &&
+				    memcmp(rec.key, rds_keys[k], rec.key_len) == 0) {
+					break;
+				}
+			}
+			if (k == G_N_ELEMENTS(rds_keys)) continue;
+			cfm_rds_text_vote_string(&strings[k], (const gchar*) rec.data, rec.len);
+			if ((error = check_text(strings[k].text, CFM_RDS_TEXT_MAX))) return error;
+		}
+	}
+
+	return NULL;
+}
+
+#ifdef RDS_FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const guint8 *data, size_t len)
+{
+	const gchar *error = run_capture(data, len);
+	if (!error) error = run_blocks(data, len, TRUE);
+	if (error) {
+		fprintf(stderr, "%s\n", error);
+		abort();
+	}
+	return 0;
+}
+
+#else
+
+static gint runs = 100000;
+static gint seed = 1;
+static gint max_mutations = 8;
+static gchar *crash_file = "rds-fuzz-crash.rds";
+
+static GOptionEntry entries[] = {
+	{ "runs", 'n', 0, G_OPTION_ARG_INT, &runs, "Corrupted inputs to try", "N" },
+	{ "seed", 'S', 0, G_OPTION_ARG_INT, &seed, "Random seed", "N" },
+	{ "mutations", 'm', 0, G_OPTION_ARG_INT, &max_mutations, "Most corruptions per input", "N" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &crash_file, "Where to save a failing input", "FILE" },
+	{ NULL }
+};
+
+typedef struct {
+	GByteArray *capture;  /* As read */
+	GByteArray *blocks;   /* All the raw blocks in it, back to back */
+} Seed;
+
+static Seed* seed_new(GByteArray *capture)
+{
+	Seed *s = g_new(Seed, 1);
+	CFmRdsReplay replay;
+	CFmRdsCaptureRecord rec;
+
+	s->capture = capture;
+	s->blocks = g_byte_array_new();
+	if (cfm_rds_replay_init(&replay, capture->data, capture->len)) {
+		while (cfm_rds_replay_next(&replay, &rec)) {
+			if (rec.type == CFM_RDS_CAPTURE_BLOCKS) {
+				g_byte_array_append(s->blocks, rec.data,
+					rec.len - rec.len % CFM_RDS_BLOCK_SIZE);
+			}
+		}
+	}
+
+	return s;
+}
+
+static void seed_free(Seed *s)
+{
+	g_byte_array_free(s->capture, TRUE);
+	g_byte_array_free(s->blocks, TRUE);
+	g_free(s);
+}
+
+/* Corrupts n bytes of blocks, growing by a block at most; returns the new
+ * length. */
+static gsize mutate_blocks(guint8 *p, gsize n)
+{
+	const guint count = n / CFM_RDS_BLOCK_SIZE;
+	const guint i = rng_below(count) * CFM_RDS_BLOCK_SIZE;
+	const guint j = rng_below(count) * CFM_RDS_BLOCK_SIZE;
+	guint8 tmp[CFM_RDS_BLOCK_SIZE];
+
+	if (count == 0) return n;
+
+	switch (rng_below(8)) {
+	case 0: /* Noise */
+		p[rng_below(n)] ^= 1 << rng_below(8);
+		break;
+	case 1: /* Uncorrectable */
+		p[i + 2] |= CFM_RDS_BLOCK_ERROR;
+		break;
+	case 2: /* Wrong offset word */
+		p[i + 2] = (p[i + 2] & ~CFM_RDS_BLOCK_MSK) | rng_below(8);
+		break;
+	case 3: /* Wrong value, not caught */
+		p[i] = rng();
+		p[i + 1] = rng();
+		break;
+	case 4: /* Lost */
+		memmove(p + i, p + i + CFM_RDS_BLOCK_SIZE, n - i - CFM_RDS_BLOCK_SIZE);
+		return n - CFM_RDS_BLOCK_SIZE;
+	case 5: /* Received twice */
+		memmove(p + i + CFM_RDS_BLOCK_SIZE, p + i, n - i);
+		return n + CFM_RDS_BLOCK_SIZE;
+	case 6: /* Out of order */
+		memcpy(tmp, p + i, CFM_RDS_BLOCK_SIZE);
+		memcpy(p + i, p + j, CFM_RDS_BLOCK_SIZE);
+		memcpy(p + j, tmp, CFM_RDS_BLOCK_SIZE);
+		break;
+	case 7: /* Short read */
+		return n - 1 - rng_below(CFM_RDS_BLOCK_SIZE - 1);
+	}
+
+	return n;
+}
+
+static gsize mutate_bytes(guint8 *p, gsize n)
+{
+	if (n == 0) return n;
+	switch (rng_below(3)) {
+	case 0:
+		p[rng_below(n)] ^= 1 << rng_below(8);
+		break;
+	case 1:
+		p[rng_below(n)] = rng();
+		break;
+	case 2:
+		return rng_below(n);
+	}
+	return n;
+}
+
+static void save_crash(const guint8 *data, gsize len, gboolean is_capture)
+{
+	GByteArray *out = g_byte_array_new();
+	GError *error = NULL;
+
+	if (is_capture) {
+		g_byte_array_append(out, data, len);
+	} else {
+		cfm_rds_capture_begin(out);
+		cfm_rds_capture_append(out, CFM_RDS_CAPTURE_BLOCKS, 0, NULL, data, len);
+	}
+	if (!g_file_set_contents(crash_file, (const gchar*) out->data, out->len, &error)) {
+		g_printerr("%s\n", error->message);
+	}
+	g_byte_array_free(out, TRUE);
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GPtrArray *seeds;
+	guint8 *work;
+	guint blocks_runs = 0, capture_runs = 0;
+	gint i;
+
+	context = g_option_context_new("[CAPTURE...] - feed corrupted RDS to the decoder");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		return 2;
+	}
+	g_option_context_free(context);
+	rng_state = seed ? seed : 1;
+
+	seeds = g_ptr_array_new();
+	for (i = 1; i < argc; i++) {
+		GByteArray *capture = g_byte_array_new();
+		gchar *data;
+		gsize len;
+		if (!g_file_get_contents(argv[i], &data, &len, &error)) {
+			g_printerr("%s\n", error->message);
+			return 1;
+		}
+		g_byte_array_append(capture, (const guint8*) data, len);
+		g_free(data);
+		g_ptr_array_add(seeds, seed_new(capture));
+	}
+	if (seeds->len == 0) {
+		g_ptr_array_add(seeds, seed_new(rds_synth_capture(RDS_SYNTH_CYCLE * 64, 0)));
+	}
+
+	/* Room for every mutation to grow the input by a block. */
+	work = g_malloc(MAX(MAX_BLOCKS * CFM_RDS_BLOCK_SIZE, MAX_CAPTURE) +
+		max_mutations * CFM_RDS_BLOCK_SIZE);
+
+	for (i = 0; i < runs; i++) {
+		const Seed *s = g_ptr_array_index(seeds, rng_below(seeds->len));
+		const gint mutations = 1 + rng_below(MAX(max_mutations, 1));
+		const gboolean whole_capture = rng_below(4) == 0;
+		const gchar *failed;
+		gsize len;
+		gint m;
+
+		if (whole_capture) {
+			len = MIN(s->capture->len, MAX_CAPTURE);
+			memcpy(work, s->capture->data, len);
+			for (m = 0; m < mutations; m++) len = mutate_bytes(work, len);
+			failed = run_capture(work, len);
+			capture_runs++;
+		} else {
+			const guint count = s->blocks->len / CFM_RDS_BLOCK_SIZE;
+			const guint n = MIN(count, 1 + rng_below(MAX_BLOCKS));
+			const guint first = rng_below(count - n + 1);
+			len = n * CFM_RDS_BLOCK_SIZE;
+			memcpy(work, s->blocks->data + first * CFM_RDS_BLOCK_SIZE, len);
+			for (m = 0; m < mutations; m++) len = mutate_blocks(work, len);
+			failed = run_blocks(work, len, TRUE);
+			blocks_runs++;
+		}
+
+		if (failed) {
+			g_printerr("Run %d: %s; input saved to %s\n", i, failed, crash_file);
+			save_crash(work, len, whole_capture);
+			return 1;
+		}
+	}
+
+	printf("{ \"runs\": %d, \"block_runs\": %u, \"capture_runs\": %u, \"seeds\": %u, \"failures\": 0 }\n",
+		runs, blocks_runs, capture_runs, seeds->len);
+
+	for (i = 0; i < (gint) seeds->len; i++) {
+		seed_free(g_ptr_array_index(seeds, i));
+	}
+	g_ptr_array_free(seeds, TRUE);
+	g_free(work);
+
+	return 0;
+}
+
+#endif /* RDS_FUZZ_LIBFUZZER */
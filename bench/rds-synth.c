@@ -0,0 +1,144 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "rds_decoder.h"
+#include "rds_capture.h"
+#include "rds-synth.h"
+
+/* A synthetic RDS stream for the tools that need one without hardware. It
+ * cycles through PS (0A, with AF), RadioText (2A), clock time (4A),
+ * RadioText Plus (3A and 11A) and Enhanced RadioText in UTF-8 (3A and 12A)
+ * groups the way a station sends them, with the
+ * texts changing every few cycles, and comes as a capture of block reads of
+ * the usual size. */
+
+#define STREAM_PTY       3
+#define CYCLES_PER_TEXT  8
+#define READ_BLOCKS      32
+#define BLOCK_US         21895 /* 26 bits at 1187.5 bit/s */
+#define RTPLUS_GROUP     11    /* 11A */
+#define RTPLUS_AID       0x4BD7
+#define ERT_GROUP        12    /* 12A */
+#define ERT_AID          0x6552
+#define ERT_UTF8         0x0001
+
+static const gchar * const ps_names[] = { "CADENA S", "ER      " };
+static const gchar * const rt_texts[] = {
+	"Hoy por hoy - con Angels Barcelo, de lunes a viernes de 6 a 12h\r",
+	"Ahora suena: Los Secretos - Ojos de gata\r"
+};
+/* The same in UTF-8, 32 bytes at most */
+static const gchar * const ert_texts[] = {
+	"Hoy por hoy · Àngels Barceló\r",
+	"Los Secretos – Ojos de gata\r"
+};
+
+/* RT+ tags for each text: content type, start and length of the title
+ * and the artist; none while a programme rather than a song is on. */
+static const guint8 rt_tags[][2][3] = {
+	{ { 0, 0, 1 }, { 0, 0, 1 } },
+	{ { 1, 28, 12 }, { 4, 13, 12 } }
+};
+
+static guint8* put_block(guint8 *p, guint16 value, guint8 id, gint error_rate,
+	guint32 *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	p[0] = value & 0xFF;
+	p[1] = value >> 8;
+	p[2] = id;
+	if ((gint) ((*seed >> 16) % 1000) < error_rate) {
+		p[2] |= CFM_RDS_BLOCK_ERROR;
+	}
+	return p + CFM_RDS_BLOCK_SIZE;
+}
+
+static guint8* put_group(guint8 *p, guint type, guint16 b, guint16 c, guint16 d,
+	gint error_rate, guint32 *seed)
+{
+	p = put_block(p, RDS_SYNTH_PI, CFM_RDS_BLOCK_A, error_rate, seed);
+	p = put_block(p, (type << 12) | (STREAM_PTY << 5) | b, CFM_RDS_BLOCK_B, error_rate, seed);
+	p = put_block(p, c, CFM_RDS_BLOCK_C, error_rate, seed);
+	return put_block(p, d, CFM_RDS_BLOCK_D, error_rate, seed);
+}
+
+/* Roughly "groups" groups, in whole cycles; error_rate is the number of
+ * blocks per 1000 marked uncorrectable. */
+GByteArray* rds_synth_capture(guint groups, gint error_rate)
+{
+	guint8 *data = g_malloc(groups * 4 * CFM_RDS_BLOCK_SIZE);
+	guint8 *p = data;
+	GByteArray *capture;
+	guint32 seed = 1;
+	guint g = 0, cycle = 0, i;
+	gsize len, off;
+
+	while (g + RDS_SYNTH_CYCLE <= groups) {
+		const guint text = (cycle / CYCLES_PER_TEXT) % 2;
+		const gchar *ps = ps_names[text];
+		const gchar *rt = rt_texts[text];
+		const guint rt_len = strlen(rt);
+		const gchar *ert = ert_texts[text];
+		const guint ert_len = strlen(ert);
+
+		for (i = 0; i < 4; i++) {
+			/* AF: 3 frequencies, then 93.9 and 96.1 MHz */
+			const guint16 af = i == 0 ? ((224 + 3) << 8) | 64 : (86 << 8) | 205;
+			p = put_group(p, 0, i, af, (ps[2 * i] << 8) | (guint8) ps[2 * i + 1],
+				error_rate, &seed);
+		}
+		for (i = 0; i < 16; i++) {
+			guint8 c[4];
+			guint j;
+			for (j = 0; j < 4; j++) {
+				c[j] = 4 * i + j < rt_len ? rt[4 * i + j] : ' ';
+			}
+			p = put_group(p, 2, (text << 4) | i, (c[0] << 8) | c[1],
+				(c[2] << 8) | c[3], error_rate, &seed);
+		}
+		/* 4A: MJD 60000, 12:00 + minutes, UTC+1 */
+		p = put_group(p, 4, 60000 >> 15, ((60000 & 0x7FFF) << 1) | (12 >> 4),
+			((12 & 0xF) << 12) | ((cycle % 60) << 6) | 2, error_rate, &seed);
+		/* 3A: RT+ is in 11A, then the tags themselves */
+		p = put_group(p, 3, RTPLUS_GROUP << 1, 0, RTPLUS_AID, error_rate, &seed);
+		{
+			const guint8 (*tag)[3] = rt_tags[text];
+			const gboolean running = tag[0][0] != 0;
+			p = put_group(p, RTPLUS_GROUP, (text << 4) | (running << 3) | (tag[0][0] >> 3),
+				((tag[0][0] & 0x7) << 13) | (tag[0][1] << 7) | ((tag[0][2] - 1) << 1) |
+				(tag[1][0] >> 5),
+				((tag[1][0] & 0x1F) << 11) | (tag[1][1] << 5) | ((tag[1][2] - 1) & 0x1F),
+				error_rate, &seed);
+		}
+		/* 3A: eRT in UTF-8 is in 12A, then the first 32 bytes of it */
+		p = put_group(p, 3, ERT_GROUP << 1, ERT_UTF8, ERT_AID, error_rate, &seed);
+		for (i = 0; i < 8; i++) {
+			guint8 c[4];
+			guint j;
+			for (j = 0; j < 4; j++) {
+				c[j] = 4 * i + j < ert_len ? ert[4 * i + j] : ' ';
+			}
+			p = put_group(p, ERT_GROUP, i, (c[0] << 8) | c[1],
+				(c[2] << 8) | c[3], error_rate, &seed);
+		}
+
+		g += RDS_SYNTH_CYCLE;
+		cycle++;
+	}
+	len = p - data;
+
+	capture = g_byte_array_sized_new(len + len / 8 + 64);
+	cfm_rds_capture_begin(capture);
+	for (off = 0; off < len; off += READ_BLOCKS * CFM_RDS_BLOCK_SIZE) {
+		const gsize n = MIN(len - off, READ_BLOCKS * CFM_RDS_BLOCK_SIZE);
+		cfm_rds_capture_append(capture, CFM_RDS_CAPTURE_BLOCKS,
+			READ_BLOCKS * BLOCK_US, NULL, data + off, n);
+	}
+	g_free(data);
+
+	return capture;
+}
@@ -0,0 +1,15 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_RDS_SYNTH_H_
+#define _CFM_RDS_SYNTH_H_
+
+#include <glib.h>
+
+#define RDS_SYNTH_PI         0xE2C1
+#define RDS_SYNTH_CYCLE      (4 + 16 + 1 + 2 + 1 + 8) /* Groups */
+
+GByteArray* rds_synth_capture(guint groups, gint error_rate);
+
+#endif /* _CFM_RDS_SYNTH_H_ */
@@ -1,18 +1,29 @@
 #include <libosso.h>
 #include <hildon/hildon.h>
 #include <glib/gi18n.h>
+#include <gconf/gconf-client.h>
 
 #include "radio.h"
 #include "presets.h"
 #include "preset_list.h"
 #include "tuner.h"
 #include "types.h"
+#include "scan_cache.h"
+#include "scan_parallel.h"
+#include "band.h"
+#include "dwell.h"
 
 // TODO: ADV_AUDIO_ROUTING
 #include "radio_routing.h"
 
 #define SCAN_LOCK_TIME	1
-#define SCAN_INCREMENT	100000
+#define SCAN_CACHE_MAX_AGE	(7 * 24 * 3600)
+#define HARVEST_TIMEOUT_MS	2000
+#define STATION_DB_FILE	"/usr/share/cfmradio/stations.db"
+
+#define GCONF_BAND_KEY	"/apps/maemo/cfmradio/band"
+#define GCONF_SCAN_DIR	"/apps/maemo/cfmradio/scan"
+#define GCONF_FINE_TUNE_DIR	"/apps/maemo/cfmradio/fine-tune"
 
 static osso_context_t *osso_context;
 static HildonProgram *program;
@@ -26,47 +37,70 @@ static GtkLabel *ps_label, *rt_label;
 static CFmTuner *tuner;
 //static GtkToolbar *toolbar;
 
-static GtkWidget *start_scan_button, *stop_scan_button;
+static GtkWidget *start_scan_button, *full_scan_button, *stop_scan_button;
+static GtkWidget *sweep_button;
 
 static CFmPresetList *preset_list;
 
-static guint rds_timer;
 
 static guint scan_timer;
-static gulong scan_prev_freq, scan_max;
+static gulong scan_prev_freq, scan_next_freq, scan_max;
+static CFmScanCache *scan_cache;
+static gulong *scan_list;
+static guint scan_list_len, scan_list_pos;
+static CFmParallelScan *parallel_scan;
+static CFmDwellConfig scan_dwell;
+static CFmDwellStats scan_stats;
+static guint scan_pty;
+static gulong harvest_freq;
+static guint harvest_ticks;
 
 /* The only symbol externally visible (for maemo-launcher). */
 int main(int argc, char *argv[]) __attribute__((visibility("default")));
 
 static void cancel_scan();
 
+/* Presets and the frequency display use the nearest channel of the band
+ * plan, whatever the tuner actually reports. */
+static gulong channel_freq(gulong freq)
+{
+	return cfm_band_plan_round(cfm_radio_get_band_plan(radio), freq);
+}
+
+/* The labels below are only touched when what they show changes: setting
+ * them, even to the same text, makes GTK+ lay out and redraw the window. */
 static void print_freq(gulong freq)
 {
 	static gchar markup[256];
+	static gulong shown_freq = 0;
 	float freq_mhz;
 
+	freq = channel_freq(freq);
+	if (freq == shown_freq) return;
+	shown_freq = freq;
 	freq_mhz = freq / 1000000.0f;
 
-	g_snprintf(markup, sizeof(markup), "<span font=\"64\">%.1f</span> MHz", freq_mhz);
+	g_snprintf(markup, sizeof(markup), "<span font=\"64\">%.*f</span> MHz",
+		cfm_band_freq_decimals(freq), freq_mhz);
 	gtk_label_set_markup(freq_label, markup);
 }
 
-static void print_rds()
+static void print_station_name()
 {
 	gulong freq;
-	gchar *rds_ps, *rds_rt;
+	gchar *rds_ps, *name;
 	gchar *markup;
 	gchar *preset;
 
 	g_object_get(G_OBJECT(radio), "frequency", &freq, "rds-ps", &rds_ps,
-		"rds-rt", &rds_rt, NULL);
-
-	markup = g_markup_printf_escaped("<span font=\"31\">%s</span>",
-		g_strstrip(rds_ps));
-	gtk_label_set_markup(ps_label, markup);
-	g_free(markup);
+		"station-name", &name, NULL);
+	freq = channel_freq(freq);
 
-	gtk_label_set_text(rt_label, g_strstrip(rds_rt));
+	if (strcmp(g_strstrip(name), gtk_label_get_text(ps_label)) != 0) {
+		markup = g_markup_printf_escaped("<span font=\"31\">%s</span>", name);
+		gtk_label_set_markup(ps_label, markup);
+		g_free(markup);
+	}
 
 	preset = cfm_presets_get_preset(presets, freq);
 	if (preset) {
@@ -78,6 +112,17 @@ static void print_rds()
 	}
 
 	g_free(rds_ps);
+	g_free(name);
+}
+
+static void print_rt()
+{
+	gchar *rds_rt;
+
+	g_object_get(G_OBJECT(radio), "rds-rt", &rds_rt, NULL);
+	if (strcmp(g_strstrip(rds_rt), gtk_label_get_text(rt_label)) != 0) {
+		gtk_label_set_text(rt_label, rds_rt);
+	}
 	g_free(rds_rt);
 }
 
@@ -95,6 +140,14 @@ static void range_high_changed_cb(GObject *object, GParamSpec *psec, gpointer us
 	g_object_set(G_OBJECT(tuner), "range-high", freq, NULL);
 }
 
+static void band_changed_cb(GObject *object, GParamSpec *psec, gpointer user_data)
+{
+	gchar *band;
+	g_object_get(G_OBJECT(radio), "band", &band, NULL);
+	g_object_set(G_OBJECT(tuner), "band", band, NULL);
+	g_free(band);
+}
+
 static void frequency_changed_cb(GObject *object, GParamSpec *psec, gpointer user_data)
 {
 	gulong freq;
@@ -103,19 +156,36 @@ static void frequency_changed_cb(GObject *object, GParamSpec *psec, gpointer use
 	print_freq(freq);
 }
 
+/* Remembers where each station sounded best, keyed by its channel in kHz. */
+static void fine_tune_offset_changed_cb(GObject *object, GParamSpec *psec, gpointer user_data)
+{
+	GConfClient *gconf;
+	gulong freq;
+	glong offset;
+	gchar *key;
+
+	g_object_get(G_OBJECT(radio), "frequency", &freq, "fine-tune-offset", &offset, NULL);
+
+	gconf = gconf_client_get_default();
+	key = g_strdup_printf("%s/%lu", GCONF_FINE_TUNE_DIR, freq / 1000);
+	gconf_client_set_int(gconf, key, offset, NULL);
+	g_free(key);
+	g_object_unref(gconf);
+}
+
 static gboolean key_press_cb(GObject *object, GdkEventKey *event, gpointer user_data)
 {
 	gulong freq;
 	switch (event->keyval) {
 	case GDK_Left:
 		g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
-		freq -= 100000;
+		freq = channel_freq(freq - cfm_radio_get_band_plan(radio)->spacing);
 		g_object_set(G_OBJECT(radio), "frequency", freq, NULL);
 		return FALSE;
 	break;
 	case GDK_Right:
 		g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
-		freq += 100000;
+		freq = channel_freq(freq + cfm_radio_get_band_plan(radio)->spacing);
 		g_object_set(G_OBJECT(radio), "frequency", freq, NULL);
 		return FALSE;
 	break;
@@ -142,16 +212,21 @@ static gboolean tuner_tuned_cb(GObject *object, gpointer user_data)
 	return TRUE;
 }
 
-static gboolean rds_timer_cb(gpointer data)
+static void station_name_changed_cb(GObject *object, GParamSpec *psec, gpointer user_data)
 {
-	print_rds();
-	return TRUE;
+	print_station_name();
+}
+
+static void rds_rt_changed_cb(GObject *object, GParamSpec *psec, gpointer user_data)
+{
+	print_rt();
 }
 
 static void presets_clicked(GtkButton *button, gpointer user_data)
 {
 	gulong freq;
 	g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
+	freq = cfm_presets_get_station_freq(presets, channel_freq(freq));
 	g_object_set(G_OBJECT(preset_list), "frequency", freq, NULL);
 	cfm_preset_list_show(preset_list);
 }
@@ -172,7 +247,7 @@ static void add_preset_clicked(GtkButton *button, gpointer user_data)
 	gulong freq;
 
 	g_object_get(G_OBJECT(radio), "rds-ps", &rds_ps, "frequency", &freq, NULL);
-	cfm_presets_set_preset(presets, freq, g_strstrip(rds_ps));
+	cfm_presets_set_preset(presets, channel_freq(freq), g_strstrip(rds_ps));
 
 	g_free(rds_ps);
 }
@@ -182,78 +257,438 @@ static void remove_preset_clicked(GtkButton *button, gpointer user_data)
 	gulong freq;
 
 	g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
-	cfm_presets_remove_preset(presets, freq);
+	cfm_presets_remove_preset(presets, channel_freq(freq));
+}
+
+static void set_scanning(gboolean scanning)
+{
+	hildon_gtk_window_set_progress_indicator(GTK_WINDOW(main_window), scanning);
+	if (scanning) {
+		gtk_widget_show(stop_scan_button);
+		gtk_widget_hide(start_scan_button);
+		gtk_widget_hide(full_scan_button);
+		gtk_widget_hide(sweep_button);
+	} else {
+		gtk_widget_show(start_scan_button);
+		gtk_widget_show(full_scan_button);
+		gtk_widget_show(sweep_button);
+		gtk_widget_hide(stop_scan_button);
+	}
+}
+
+static void sweep_progress_cb(CFmRadio *object, guint index, gpointer user_data)
+{
+	guint len;
+	const CFmSpectrumPoint *spectrum = cfm_radio_get_spectrum(radio, &len);
+	cfm_tuner_update_spectrum(tuner, index, &spectrum[index]);
+}
+
+static void sweep_finished_cb(CFmRadio *object, gboolean completed, gpointer user_data)
+{
+	g_object_set(G_OBJECT(radio), "output", CFM_RADIO_OUTPUT_SYSTEM, NULL);
+	set_scanning(FALSE);
+}
+
+static void start_sweep(void)
+{
+	guint len;
+	const CFmSpectrumPoint *spectrum;
+	if (scan_timer || cfm_radio_is_sweeping(radio)) {
+		return;
+	}
+	g_object_set(G_OBJECT(radio), "output", CFM_RADIO_OUTPUT_MUTE, NULL);
+
+	cfm_radio_sweep_start(radio);
+	if (!cfm_radio_is_sweeping(radio)) {
+		g_object_set(G_OBJECT(radio), "output", CFM_RADIO_OUTPUT_SYSTEM, NULL);
+		return;
+	}
+	spectrum = cfm_radio_get_spectrum(radio, &len);
+	cfm_tuner_set_spectrum(tuner, spectrum, len);
+
+	set_scanning(TRUE);
+}
+
+/* The second tuner never interrupts playback, so whatever it finds is
+ * merged into the presets as it goes. */
+static void monitor_progress_cb(CFmRadio *object, guint index, gpointer user_data)
+{
+	guint len;
+	const CFmSpectrumPoint *spectrum = cfm_radio_monitor_get_spectrum(radio, &len);
+	const CFmSpectrumPoint *p = &spectrum[index];
+	const gchar *ps;
+
+	if (!cfm_radio_is_sweeping(radio)) {
+		cfm_tuner_update_spectrum(tuner, index, p);
+	}
+
+	if (p->signal <= scan_dwell.threshold) {
+		return;
+	}
+
+	ps = cfm_radio_monitor_get_ps(radio, index);
+	if (!cfm_presets_is_preset(presets, p->freq)) {
+		g_debug("Monitor found station at %u Hz\n", p->freq);
+		cfm_presets_set_preset(presets, p->freq, ps ? ps : "");
+	} else if (ps) {
+		gchar *name = cfm_presets_get_preset(presets, p->freq);
+		if (!name || !name[0]) {
+			cfm_presets_set_preset(presets, p->freq, ps);
+		}
+		g_free(name);
+	}
+}
+
+static void start_monitor(const gchar *device)
+{
+	guint len;
+	const CFmSpectrumPoint *spectrum;
+
+	if (!cfm_radio_monitor_start(radio, device)) {
+		return;
+	}
+
+	spectrum = cfm_radio_monitor_get_spectrum(radio, &len);
+	cfm_tuner_set_spectrum(tuner, spectrum, len);
 }
 
 static void end_scan()
 {
 	scan_timer = 0;
+	harvest_freq = 0;
+
+	if (scan_cache) {
+		cfm_scan_cache_save(scan_cache);
+		cfm_scan_cache_free(scan_cache);
+		scan_cache = NULL;
+	}
+	g_free(scan_list);
+	scan_list = NULL;
 
 	g_object_set(G_OBJECT(radio), "output", CFM_RADIO_OUTPUT_SYSTEM, NULL);
 
-	hildon_gtk_window_set_progress_indicator(GTK_WINDOW(main_window), 0);
-	gtk_widget_show(start_scan_button);
-	gtk_widget_hide(stop_scan_button);
+	set_scanning(FALSE);
 }
 
-static gboolean scan_step(gpointer data)
+static void finish_scan()
 {
-	gulong freq;
-	guint signal;
-	g_object_get(G_OBJECT(radio), "frequency", &freq, "signal", &signal, NULL);
+	/* Scan ended succesfully */
+	g_object_set(G_OBJECT(radio), "frequency", scan_prev_freq, NULL);
+	g_object_set(G_OBJECT(tuner), "frequency", scan_prev_freq, NULL);
+	print_freq(scan_prev_freq);
+	end_scan();
+}
 
-	g_debug("Autoscan %.2f MHz: %.0f %%", freq / 1000000.0f, signal / 655.36f),
+static void scan_found(gulong freq, const CFmDwellStats *stats, gboolean station)
+{
+	g_debug("Autoscan %.2f MHz: %.0f %% (sd %.1f %%, %u samples)",
+		freq / 1000000.0f, stats->mean / 655.36f,
+		cfm_dwell_stats_stddev(stats) / 655.36f, stats->n);
 	g_object_set(G_OBJECT(tuner), "frequency", freq, NULL);
 	print_freq(freq);
 
-	if (signal > (65536 / 3)) {
-		/* Signal > 33% : Create / Update preset */
+	if (station) {
 		g_debug(" -> Found station at %lu Hz", freq);
-		if (!cfm_presets_is_preset(presets, freq)) {
-			cfm_presets_set_preset(presets, freq, "");
+	}
+
+	cfm_scan_cache_update_stats(scan_cache, freq, stats, station);
+}
+
+/* Creates or names the preset for a station a scan found, with what RDS
+ * told about it, unless it is known to be of some other programme type
+ * than asked for. PTY 0 means it is not known: no RDS, or a receiver that
+ * only hands out PS and RT (the N900's), so those stations are kept. */
+static void scan_store(gulong freq, guint16 pi, guint8 pty, const gchar *ps)
+{
+	const gulong channel = channel_freq(freq);
+	gchar *name;
+	guint signal = 0;
+
+	if (scan_pty && pty && pty != scan_pty) {
+		g_debug(" -> PTY %u, not %u; no preset\n", pty, scan_pty);
+		return;
+	}
+
+	name = cfm_presets_get_preset(presets, channel);
+	if (!name || (!name[0] && ps[0])) {
+		cfm_presets_set_preset(presets, channel, ps);
+	}
+	g_free(name);
+	if (pi) {
+		/* Grouped with its alternative frequencies by the PI code */
+		cfm_scan_cache_get_stats(scan_cache, freq, &signal, NULL, NULL);
+		cfm_presets_set_preset_rds(presets, channel, pi, pty, signal);
+	}
+}
+
+/* Stores a station with what an earlier scan heard from it, if anything,
+ * where it cannot be listened to now. */
+static void scan_store_cached(gulong freq)
+{
+	gchar ps[CFM_SCAN_CACHE_PS_LEN];
+	guint16 pi = 0;
+	guint8 pty = 0;
+
+	if (!cfm_scan_cache_get_rds(scan_cache, freq, &pi, &pty, ps)) {
+		ps[0] = '\0';
+	}
+	scan_store(freq, pi, pty, ps);
+}
+
+/* Stays on a station just found until its PI and PS are confirmed, for
+ * HARVEST_TIMEOUT_MS at most. RDS has been coming in since the channel was
+ * tuned, while the signal was being measured, so often that already is
+ * the case. Returns FALSE if there is nothing to wait for: the station
+ * sent no RDS last time either. */
+static gboolean harvest_start(gulong freq)
+{
+	guint16 pi;
+
+	if (cfm_scan_cache_get_rds(scan_cache, freq, &pi, NULL, NULL) && !pi) {
+		scan_store_cached(freq);
+		return FALSE;
+	}
+
+	harvest_freq = freq;
+	harvest_ticks = MAX(HARVEST_TIMEOUT_MS / scan_dwell.interval_ms, 1);
+	return TRUE;
+}
+
+/* Returns FALSE while still waiting. A station whose PI matches what was
+ * cached for the channel need not be listened to until its PS comes. */
+static gboolean harvest_step(void)
+{
+	gchar cached_ps[CFM_SCAN_CACHE_PS_LEN];
+	gchar *pi_str, *ps;
+	guint16 pi, cached_pi;
+	guint pty;
+	gboolean done;
+
+	g_object_get(G_OBJECT(radio), "rds-pi", &pi_str, "rds-ps", &ps,
+		"rds-pty", &pty, NULL);
+	pi = g_ascii_strtoull(pi_str, NULL, 16);
+	g_strstrip(ps);
+
+	if (pi && !ps[0] &&
+	    cfm_scan_cache_get_rds(scan_cache, harvest_freq, &cached_pi, NULL, cached_ps) &&
+	    pi == cached_pi && cached_ps[0]) {
+		g_free(ps);
+		ps = g_strdup(cached_ps);
+	}
+
+	done = (pi && ps[0]) || --harvest_ticks == 0;
+	if (done) {
+		g_debug(" -> RDS PI %04X, PTY %u, PS '%s'\n", pi, pty, ps);
+		cfm_scan_cache_update_rds(scan_cache, harvest_freq, pi, pty, ps);
+		scan_store(harvest_freq, pi, pty, ps);
+		harvest_freq = 0;
+	}
+
+	g_free(pi_str);
+	g_free(ps);
+	return done;
+}
+
+/* Adds one more sample of the current channel; returns FALSE until there
+ * are enough of them to tell whether there is a station. */
+static gboolean scan_sample(CFmDwellResult *result)
+{
+	guint signal;
+	g_object_get(G_OBJECT(radio), "signal", &signal, NULL);
+	cfm_dwell_stats_add(&scan_stats, signal);
+	*result = cfm_dwell_decide(&scan_dwell, &scan_stats);
+	return *result != CFM_DWELL_UNDECIDED;
+}
+
+static gboolean scan_step(gpointer data)
+{
+	CFmDwellResult result;
+	gulong freq;
+
+	if (harvest_freq) {
+		freq = harvest_freq;
+		if (!harvest_step()) {
+			return TRUE;
+		}
+	} else {
+		if (!scan_sample(&result)) {
+			return TRUE;
+		}
+
+		g_object_get(G_OBJECT(radio), "frequency", &freq, NULL);
+
+		/* Everything the seek skipped over had no station worth stopping at. */
+		cfm_scan_cache_update_range(scan_cache, scan_next_freq, freq, 0);
+		scan_found(freq, &scan_stats, result == CFM_DWELL_STATION);
+		cfm_dwell_stats_reset(&scan_stats);
+		if (result == CFM_DWELL_STATION && harvest_start(freq)) {
+			return TRUE;
 		}
 	}
 
 	if (freq >= scan_max) {
-		/* Scan ended succesfully */
-		g_object_set(G_OBJECT(radio), "frequency", scan_prev_freq, NULL);
-		g_object_set(G_OBJECT(tuner), "frequency", scan_prev_freq, NULL);
-		print_freq(scan_prev_freq);
-		end_scan();
+		finish_scan();
 		return FALSE;
 	}
 
-	g_object_set(G_OBJECT(radio), "frequency", freq + SCAN_INCREMENT, NULL);
+	scan_next_freq = freq + cfm_radio_get_band_plan(radio)->spacing;
+	g_object_set(G_OBJECT(radio), "frequency", scan_next_freq, NULL);
 	cfm_radio_seek_up(radio);
 
 	return TRUE;
 }
 
-static void start_scan(void)
+static gboolean rescan_step(gpointer data)
+{
+	CFmDwellResult result;
+
+	if (harvest_freq) {
+		if (!harvest_step()) {
+			return TRUE;
+		}
+	} else {
+		if (!scan_sample(&result)) {
+			return TRUE;
+		}
+
+		scan_found(scan_list[scan_list_pos], &scan_stats,
+			result == CFM_DWELL_STATION);
+		cfm_dwell_stats_reset(&scan_stats);
+		if (result == CFM_DWELL_STATION && harvest_start(scan_list[scan_list_pos])) {
+			return TRUE;
+		}
+	}
+
+	scan_list_pos++;
+	if (scan_list_pos >= scan_list_len) {
+		finish_scan();
+		return FALSE;
+	}
+
+	g_object_set(G_OBJECT(radio), "frequency", scan_list[scan_list_pos], NULL);
+
+	return TRUE;
+}
+
+static void parallel_scan_done(CFmParallelScan *scan,
+	const CFmSpectrumPoint *stations, guint len,
+	gulong range_low, gulong range_high, gpointer user_data)
+{
+	gulong next = range_low;
+	guint i;
+
+	parallel_scan = NULL;
+
+	for (i = 0; i < len; i++) {
+		CFmDwellStats stats;
+		if (!cfm_scan_cache_has_channel(scan_cache, stations[i].freq)) {
+			continue; /* Only the other receivers reach this far */
+		}
+		/* Workers only report the mean of what they sampled. */
+		cfm_dwell_stats_reset(&stats);
+		cfm_dwell_stats_add(&stats, stations[i].signal);
+		cfm_scan_cache_update_range(scan_cache, next, stations[i].freq, 0);
+		scan_found(stations[i].freq, &stats, TRUE);
+		scan_store_cached(stations[i].freq);
+		next = stations[i].freq + cfm_radio_get_band_plan(radio)->spacing;
+	}
+	if (next <= range_high) {
+		cfm_scan_cache_update_range(scan_cache, next, range_high + 1, 0);
+	}
+
+	g_debug("Parallel scan found %u stations\n", len);
+	finish_scan();
+}
+
+/* Other receivers to scan with, e.g. "/dev/radio1,/dev/radio2".
+ * The tuner being listened to is left alone. */
+static gboolean start_parallel_scan(void)
+{
+	const gchar *env = g_getenv("CFMRADIO_SCAN_DEVICES");
+	gchar **devices;
+
+	if (!env || !env[0]) return FALSE;
+
+	devices = g_strsplit(env, ",", 0);
+	parallel_scan = cfm_parallel_scan_start(g_getenv("CFMRADIO_BACKEND"),
+		devices, cfm_radio_get_band_plan(radio), &scan_dwell,
+		parallel_scan_done, NULL);
+	g_strfreev(devices);
+
+	return parallel_scan != NULL;
+}
+
+static void start_scan_full(gboolean full)
 {
 	gulong range_low, range_high;
-	if (scan_timer) {
+	if (scan_timer || parallel_scan || cfm_radio_is_sweeping(radio)) {
 		return; /* We are already scanning */
 	}
-	g_object_set(G_OBJECT(radio), "output", CFM_RADIO_OUTPUT_MUTE, NULL);
+	if (cfm_radio_is_monitoring(radio)) {
+		/* The background tuner does the scanning; just start over. */
+		cfm_radio_monitor_restart(radio);
+		return;
+	}
 
 	g_object_get(G_OBJECT(radio), "frequency", &scan_prev_freq,
 	                              "range-low", &range_low,
 	                              "range-high", &range_high, NULL);
 
-	scan_max = range_high;
-	g_object_set(G_OBJECT(radio), "frequency", range_low, NULL);
+	scan_cache = cfm_scan_cache_open(cfm_radio_get_band_plan(radio),
+		range_low, range_high);
+	g_return_if_fail(scan_cache != NULL);
+
+	if (!full && !cfm_scan_cache_is_empty(scan_cache)) {
+		scan_list = cfm_scan_cache_get_rescan_list(scan_cache,
+			SCAN_CACHE_MAX_AGE, &scan_list_len);
+		scan_list_pos = 0;
+		g_debug("Incremental rescan of %u channels", scan_list_len);
+	} else if (start_parallel_scan()) {
+		set_scanning(TRUE);
+		return;
+	}
 
-	cfm_radio_seek_up(radio);
-	scan_timer = g_idle_add(scan_step, NULL);
+	g_object_set(G_OBJECT(radio), "output", CFM_RADIO_OUTPUT_MUTE, NULL);
+	cfm_dwell_stats_reset(&scan_stats);
 
-	hildon_gtk_window_set_progress_indicator(GTK_WINDOW(main_window), 1);
-	gtk_widget_show(stop_scan_button);
-	gtk_widget_hide(start_scan_button);
+	if (scan_list && scan_list_len > 0) {
+		g_object_set(G_OBJECT(radio), "frequency", scan_list[0], NULL);
+		scan_timer = g_timeout_add(scan_dwell.interval_ms, rescan_step, NULL);
+	} else if (scan_list) {
+		/* Nothing is stale and there are no known stations. */
+		end_scan();
+		return;
+	} else {
+		scan_max = range_high;
+		scan_next_freq = range_low;
+		g_object_set(G_OBJECT(radio), "frequency", range_low, NULL);
+
+		cfm_radio_seek_up(radio);
+		scan_timer = g_timeout_add(scan_dwell.interval_ms, scan_step, NULL);
+	}
+
+	set_scanning(TRUE);
+}
+
+static void start_scan(void)
+{
+	start_scan_full(FALSE);
+}
+
+static void start_full_scan(void)
+{
+	start_scan_full(TRUE);
 }
 
 static void cancel_scan(void)
 {
+	cfm_radio_sweep_cancel(radio);
+	if (parallel_scan) {
+		cfm_parallel_scan_cancel(parallel_scan);
+		parallel_scan = NULL;
+		end_scan();
+		return;
+	}
 	if (!scan_timer) return;
 	g_source_remove(scan_timer);
 	end_scan();
@@ -301,10 +736,18 @@ static void build_main_window()
 	g_signal_connect_after(G_OBJECT(start_scan_button), "clicked",
 		G_CALLBACK(start_scan), NULL);
 	hildon_app_menu_append(menu, GTK_BUTTON(start_scan_button));
+	full_scan_button = gtk_button_new_with_label(_("Rescan whole band"));
+	g_signal_connect_after(G_OBJECT(full_scan_button), "clicked",
+		G_CALLBACK(start_full_scan), NULL);
+	hildon_app_menu_append(menu, GTK_BUTTON(full_scan_button));
 	stop_scan_button = gtk_button_new_with_label(_("Stop scanning"));
 	g_signal_connect_after(G_OBJECT(stop_scan_button), "clicked",
 		G_CALLBACK(cancel_scan), NULL);
 	hildon_app_menu_append(menu, GTK_BUTTON(stop_scan_button));
+	sweep_button = gtk_button_new_with_label(_("Show band spectrum"));
+	g_signal_connect_after(G_OBJECT(sweep_button), "clicked",
+		G_CALLBACK(start_sweep), NULL);
+	hildon_app_menu_append(menu, GTK_BUTTON(sweep_button));
 	menu_button = gtk_button_new_with_label(_("Set preset"));
 	g_signal_connect_after(G_OBJECT(menu_button), "clicked",
 		G_CALLBACK(add_preset_clicked), NULL);
@@ -386,8 +829,51 @@ static void build_main_window()
 	                 G_CALLBACK(tuner_tuned_cb), NULL);
 }
 
+/* Keys left unset keep the defaults from dwell.c. */
+static void load_scan_config(GConfClient *gconf)
+{
+	gint val;
+
+	cfm_dwell_config_init(&scan_dwell);
+
+	val = gconf_client_get_int(gconf, GCONF_SCAN_DIR "/min-samples", NULL);
+	if (val > 0) scan_dwell.min_samples = val;
+	val = gconf_client_get_int(gconf, GCONF_SCAN_DIR "/max-samples", NULL);
+	if (val > 0) scan_dwell.max_samples = MAX(val, scan_dwell.min_samples);
+	val = gconf_client_get_int(gconf, GCONF_SCAN_DIR "/interval-ms", NULL);
+	if (val > 0) scan_dwell.interval_ms = val;
+	val = gconf_client_get_int(gconf, GCONF_SCAN_DIR "/threshold", NULL);
+	if (val > 0) scan_dwell.threshold = val;
+	/* Only keep stations of this programme type, e.g. 1 for news, and
+	 * those whose type is unknown */
+	val = gconf_client_get_int(gconf, GCONF_SCAN_DIR "/pty", NULL);
+	if (val > 0 && val < 32) scan_pty = val;
+}
+
+static void load_station_offsets(GConfClient *gconf)
+{
+	GSList *i, *l = gconf_client_all_entries(gconf, GCONF_FINE_TUNE_DIR, NULL);
+	for (i = l; i; i = g_slist_next(i)) {
+		GConfEntry *entry = (GConfEntry*) i->data;
+		GConfValue *value = gconf_entry_get_value(entry);
+		gulong khz = g_ascii_strtoull(g_basename(gconf_entry_get_key(entry)), NULL, 10);
+		if (khz && value && value->type == GCONF_VALUE_INT) {
+			cfm_radio_set_station_offset(radio, khz * 1000,
+				gconf_value_get_int(value));
+		}
+		gconf_entry_free(entry);
+	}
+	g_slist_free(l);
+}
+
 int main(int argc, char *argv[])
 {
+	GConfClient *gconf;
+	const gchar *station_db;
+	gchar *band;
+
+	/* Parallel scans run one thread per tuner. */
+	if (!g_thread_supported()) g_thread_init(NULL);
 	hildon_gtk_init(&argc, &argv);
 
 	bindtextdomain(GETTEXT_PACKAGE, LOCALEDIR);
@@ -400,23 +886,64 @@ int main(int argc, char *argv[])
 	g_set_application_name("FM Radio"); /* This might be important for Pulse */
 	program = hildon_program_get_instance();
 
-	radio = cfm_radio_new();
+	/* Allows running against another tuner, e.g. CFMRADIO_BACKEND=sim,
+	 * or recording a session with CFMRADIO_TRACE=/tmp/session.trace and
+	 * playing it back with CFMRADIO_BACKEND=replay. CFMRADIO_RECEPTION_LOG
+	 * keeps a history of the signal of whatever is being listened to, and
+	 * CFMRADIO_STATION_DB replaces the installed station database. */
+	station_db = g_getenv("CFMRADIO_STATION_DB");
+	radio = g_object_new(CFM_TYPE_RADIO,
+	                     "backend", g_getenv("CFMRADIO_BACKEND"),
+	                     "device", g_getenv("CFMRADIO_DEVICE"),
+	                     "trace", g_getenv("CFMRADIO_TRACE"),
+	                     "reception-log", g_getenv("CFMRADIO_RECEPTION_LOG"),
+	                     "station-db", station_db ? station_db : STATION_DB_FILE, NULL);
 	g_signal_connect(G_OBJECT(radio), "notify::range-low",
 	                 G_CALLBACK(range_low_changed_cb), NULL);
 	g_signal_connect(G_OBJECT(radio), "notify::range-high",
 	                 G_CALLBACK(range_high_changed_cb), NULL);
 	g_signal_connect(G_OBJECT(radio), "notify::frequency",
 	                 G_CALLBACK(frequency_changed_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "notify::band",
+	                 G_CALLBACK(band_changed_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "notify::fine-tune-offset",
+	                 G_CALLBACK(fine_tune_offset_changed_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "notify::station-name",
+	                 G_CALLBACK(station_name_changed_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "notify::rds-rt",
+	                 G_CALLBACK(rds_rt_changed_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "sweep-progress",
+	                 G_CALLBACK(sweep_progress_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "sweep-finished",
+	                 G_CALLBACK(sweep_finished_cb), NULL);
+	g_signal_connect(G_OBJECT(radio), "monitor-progress",
+	                 G_CALLBACK(monitor_progress_cb), NULL);
 
 	presets = cfm_presets_get_default();
 
-	rds_timer = g_timeout_add_seconds(1, rds_timer_cb, NULL);
 	scan_timer = 0;
 
 	build_main_window();
 
+	/* One of the plans in band.c, e.g. "us" or "japan". */
+	gconf = gconf_client_get_default();
+	band = gconf_client_get_string(gconf, GCONF_BAND_KEY, NULL);
+	load_scan_config(gconf);
+	load_station_offsets(gconf);
+	g_object_unref(gconf);
+	if (band) {
+		g_object_set(G_OBJECT(radio), "band", band, NULL);
+		g_free(band);
+	}
+	band_changed_cb(G_OBJECT(radio), NULL, NULL);
+
 	gtk_widget_show_all(GTK_WIDGET(main_window));
 
+	/* With a second receiver, e.g. CFMRADIO_MONITOR_DEVICE=/dev/radio1 */
+	if (g_getenv("CFMRADIO_MONITOR_DEVICE")) {
+		start_monitor(g_getenv("CFMRADIO_MONITOR_DEVICE"));
+	}
+
 	preset_list = cfm_preset_list_new();
 	GtkTreeModel *model;
 	g_object_get(G_OBJECT(presets), "model", &model, NULL);
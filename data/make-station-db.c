@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "station_db_format.h"
+
+/* Builds the station database read by station_db.c from a CSV file with
+ * one station per line:
+ *
+ *   # pi,frequency in MHz,name
+ *   E2C1,93.9,Cadena SER
+ *   ,101.2,"Radio Example, local"
+ *
+ * Either the PI (in hex) or the frequency may be left empty; names are
+ * UTF-8 and may be quoted. */
+
+#define MAX_NAME_LEN 64
+
+typedef struct {
+	guint16 pi;
+	guint16 freq;
+	guint32 name;
+} Entry;
+
+static gint compare_by_pi(gconstpointer a, gconstpointer b)
+{
+	const Entry *x = a, *y = b;
+	if (x->pi != y->pi) return x->pi < y->pi ? -1 : 1;
+	if (x->freq != y->freq) return x->freq < y->freq ? -1 : 1;
+	return 0;
+}
+
+static gint compare_by_freq(gconstpointer a, gconstpointer b)
+{
+	const Entry *x = a, *y = b;
+	if (x->freq != y->freq) return x->freq < y->freq ? -1 : 1;
+	if (x->pi != y->pi) return x->pi < y->pi ? -1 : 1;
+	return 0;
+}
+
+static void write_entries(GString *out, const Entry *entries, guint count)
+{
+	guint i;
+	for (i = 0; i < count; i++) {
+		StationDbEntry e;
+		e.pi = GUINT16_TO_LE(entries[i].pi);
+		e.freq = GUINT16_TO_LE(entries[i].freq);
+		e.name = GUINT32_TO_LE(entries[i].name);
+		g_string_append_len(out, (const gchar*) &e, sizeof(e));
+	}
+}
+
+/* Splits "line" in place into at most 3 fields; the last may be quoted. */
+static gint split_line(gchar *line, gchar *fields[3])
+{
+	gint n = 0;
+	gchar *c = line;
+
+	while (n < 2) {
+		gchar *comma = strchr(c, ',');
+		if (!comma) break;
+		*comma = '\0';
+		fields[n++] = g_strstrip(c);
+		c = comma + 1;
+	}
+	c = g_strstrip(c);
+	if (c[0] == '"') {
+		gsize len = strlen(c);
+		if (len < 2 || c[len - 1] != '"') return -1;
+		c[len - 1] = '\0';
+		c++;
+	}
+	fields[n++] = c;
+
+	return n;
+}
+
+int main(int argc, char **argv) {
+	GError *error = NULL;
+	gchar *data, **lines;
+	GArray *entries;
+	GHashTable *names;
+	GString *pool, *out;
+	StationDbHeader h;
+	Entry *by_freq;
+	guint i;
+
+	if (argc != 3) {
+		g_printerr("Usage: %s stations.csv stations.db\n", argv[0]);
+		return 2;
+	}
+
+	if (!g_file_get_contents(argv[1], &data, NULL, &error)) {
+		g_printerr("Failed to open %s: %s\n", argv[1], error->message);
+		return 1;
+	}
+	if (!g_utf8_validate(data, -1, NULL)) {
+		g_printerr("%s is not valid UTF-8\n", argv[1]);
+		return 1;
+	}
+
+	entries = g_array_new(FALSE, FALSE, sizeof(Entry));
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+	pool = g_string_new(NULL);
+
+	lines = g_strsplit(data, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		gchar *line = g_strstrip(lines[i]);
+		gchar *fields[3], *end;
+		gdouble mhz;
+		gpointer offset;
+		Entry e;
+
+		if (line[0] == '\0' || line[0] == '#') continue;
+		if (split_line(line, fields) != 3) {
+			g_printerr("%s:%u: expected pi,frequency,name\n", argv[1], i + 1);
+			return 1;
+		}
+
+		e.pi = strtoul(fields[0], &end, 16);
+		if (*end || strlen(fields[0]) > 4) {
+			g_printerr("%s:%u: bad PI '%s'\n", argv[1], i + 1, fields[0]);
+			return 1;
+		}
+		mhz = fields[1][0] ? g_ascii_strtod(fields[1], &end) : 0.0;
+		if (*end || mhz < 0.0 || mhz * 1000000.0 / STATION_DB_FREQ_UNIT > G_MAXUINT16) {
+			g_printerr("%s:%u: bad frequency '%s'\n", argv[1], i + 1, fields[1]);
+			return 1;
+		}
+		e.freq = (guint16) (mhz * 1000000.0 / STATION_DB_FREQ_UNIT + 0.5);
+		if (!e.pi && !e.freq) {
+			g_printerr("%s:%u: need a PI or a frequency\n", argv[1], i + 1);
+			return 1;
+		}
+		if (fields[2][0] == '\0' || strlen(fields[2]) > MAX_NAME_LEN) {
+			g_printerr("%s:%u: name must be 1 to %d bytes long\n", argv[1], i + 1,
+				MAX_NAME_LEN);
+			return 1;
+		}
+
+		if (!g_hash_table_lookup_extended(names, fields[2], NULL, &offset)) {
+			offset = GUINT_TO_POINTER(pool->len);
+			g_hash_table_insert(names, fields[2], offset);
+			g_string_append_len(pool, fields[2], strlen(fields[2]) + 1);
+		}
+		e.name = GPOINTER_TO_UINT(offset);
+
+		g_array_append_val(entries, e);
+	}
+
+	if (entries->len == 0) {
+		g_printerr("No stations in %s\n", argv[1]);
+		return 1;
+	}
+
+	g_array_sort(entries, compare_by_pi);
+	for (i = 1; i < entries->len; i++) {
+		const Entry *a = &g_array_index(entries, Entry, i - 1);
+		const Entry *b = &g_array_index(entries, Entry, i);
+		if (compare_by_pi(a, b) == 0) {
+			g_printerr("Station %04X on %u0 kHz listed twice\n", b->pi, b->freq);
+			return 1;
+		}
+	}
+	by_freq = g_memdup(entries->data, entries->len * sizeof(Entry));
+	qsort(by_freq, entries->len, sizeof(Entry), compare_by_freq);
+
+	h.magic = GUINT32_TO_LE(STATION_DB_MAGIC);
+	h.version = GUINT16_TO_LE(STATION_DB_VERSION);
+	h.entry_size = GUINT16_TO_LE(sizeof(StationDbEntry));
+	h.count = GUINT32_TO_LE(entries->len);
+	h.names_size = GUINT32_TO_LE(pool->len);
+
+	out = g_string_new(NULL);
+	g_string_append_len(out, (const gchar*) &h, sizeof(h));
+	write_entries(out, (const Entry*) entries->data, entries->len);
+	write_entries(out, by_freq, entries->len);
+	g_string_append_len(out, pool->str, pool->len);
+
+	if (!g_file_set_contents(argv[2], out->str, out->len, &error)) {
+		g_printerr("Failed to write %s: %s\n", argv[2], error->message);
+		return 1;
+	}
+
+	printf("%u stations, %u bytes of names\n", entries->len, (guint) pool->len);
+
+	g_string_free(out, TRUE);
+	g_string_free(pool, TRUE);
+	g_free(by_freq);
+	g_hash_table_destroy(names);
+	g_array_free(entries, TRUE);
+	g_strfreev(lines);
+	g_free(data);
+
+	return 0;
+}
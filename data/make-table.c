@@ -1,32 +1,87 @@
+#include <stdio.h>
+#include <string.h>
 #include <glib.h>
 
+/* Generates rds_table.h from codetables.utf8: the UTF-8 bytes of every
+ * character in the RDS set, so that decoding is a table lookup and a copy.
+ * The first 0x20 codes are control characters and map to nothing. */
+
+#define TABLE_SIZE 256
+#define FIRST_CHAR 0x20
+#define MAX_LEN    3 /* Must match RDS_UTF8_MAX_LEN in rds.h */
+
+/* rds.c copies these runs of printable ASCII straight through, without
+ * looking them up; all other bytes in the range must map to themselves. */
+static gboolean is_ascii_exception(guint c)
+{
+	return c == '$' || c == '^' || c == '_' || c == '`';
+}
+
 int main(int argc, char **argv) {
+	const gchar *file = argc > 1 ? argv[1] : "codetables.utf8";
 	GError *error = NULL;
 	gchar *data;
-	if (!g_file_get_contents("codetables.utf8", &data, NULL, &error)) {
-		g_printerr("Failed to open %s: %s\n", error->message);
+	gchar utf8[TABLE_SIZE][6];
+	gint len[TABLE_SIZE];
+	guint count = 0;
+	gchar *c;
+	gint i, j;
+
+	if (!g_file_get_contents(file, &data, NULL, &error)) {
+		g_printerr("Failed to open %s: %s\n", file, error->message);
+		return 1;
+	}
+	if (!g_utf8_validate(data, -1, NULL)) {
+		g_printerr("%s is not valid UTF-8\n", file);
 		return 1;
 	}
 
-	gint i;
-	guint count = 0;
+	for (i = 0; i < FIRST_CHAR; i++) {
+		len[count++] = 0;
+	}
 
-	for (i = 0; i < 0x20; i++) {
-		g_print("\t%u,\t/* %u */\n", 0, count);
+	for (c = data; *c; c = g_utf8_next_char(c)) {
+		if (*c == '\n') continue;
+		if (count >= TABLE_SIZE) {
+			g_printerr("Too many characters in %s\n", file);
+			return 1;
+		}
+		len[count] = g_unichar_to_utf8(g_utf8_get_char(c), utf8[count]);
+		if (len[count] > MAX_LEN) {
+			g_printerr("Character %u needs more than %d bytes\n", count, MAX_LEN);
+			return 1;
+		}
 		count++;
 	}
 
-	gchar * c = data;
-	while (*c) {
-		if (*c != '\n') {
-			gunichar u = g_utf8_get_char(c);
-			g_print("\t%u,\t/* %u */\n", u, count);
-			count++;
+	if (count != TABLE_SIZE) {
+		g_printerr("Expected %d characters in %s, got %u\n", TABLE_SIZE, file, count);
+		return 1;
+	}
+
+	for (i = FIRST_CHAR; i <= '}'; i++) {
+		if (!is_ascii_exception(i) && (len[i] != 1 || utf8[i][0] != i)) {
+			g_printerr("Character %d does not map to itself\n", i);
+			return 1;
+		}
+	}
+
+	printf("/* Generated by data/make-table from %s, do not edit. */\n\n", file);
+	printf("static const RdsChar rds_table[%d] = {\n", TABLE_SIZE);
+	for (i = 0; i < TABLE_SIZE; i++) {
+		printf("\t{ %d, \"", len[i]);
+		for (j = 0; j < len[i]; j++) {
+			printf("\\%03o", (guchar) utf8[i][j]);
+		}
+		printf("\" },\t/* %d", i);
+		if (len[i]) {
+			printf(" %.*s", len[i], utf8[i]);
 		}
-		c = g_utf8_next_char(c);
+		printf(" */\n");
 	}
+	printf("};\n");
 
-	g_printerr("Total elements = %d\n", count);
+	g_free(data);
 
 	return 0;
 }
@@ -0,0 +1,86 @@
+/*
+ * GPL 2
+ */
+
+#include <math.h>
+#include <glib.h>
+
+#include "dwell.h"
+
+#define DEFAULT_MIN_SAMPLES  2
+#define DEFAULT_MAX_SAMPLES  8
+#define DEFAULT_INTERVAL_MS  15
+#define DEFAULT_THRESHOLD    (65536 / 3)
+#define DEFAULT_MARGIN       3.0
+
+/* Signal readings never get more precise than this, whatever the sample
+ * variance says; keeps two identical readings from looking certain. */
+#define MIN_STDDEV           1000.0
+
+void cfm_dwell_config_init(CFmDwellConfig *config)
+{
+	config->min_samples = DEFAULT_MIN_SAMPLES;
+	config->max_samples = DEFAULT_MAX_SAMPLES;
+	config->interval_ms = DEFAULT_INTERVAL_MS;
+	config->threshold = DEFAULT_THRESHOLD;
+	config->margin = DEFAULT_MARGIN;
+}
+
+void cfm_dwell_stats_reset(CFmDwellStats *stats)
+{
+	stats->n = 0;
+	stats->mean = 0.0;
+	stats->m2 = 0.0;
+	stats->min = G_MAXUINT;
+	stats->max = 0;
+}
+
+/* Welford's online algorithm. */
+void cfm_dwell_stats_add(CFmDwellStats *stats, guint signal)
+{
+	const gdouble delta = signal - stats->mean;
+	stats->n++;
+	stats->mean += delta / stats->n;
+	stats->m2 += delta * (signal - stats->mean);
+	stats->min = MIN(stats->min, signal);
+	stats->max = MAX(stats->max, signal);
+}
+
+gdouble cfm_dwell_stats_variance(const CFmDwellStats *stats)
+{
+	return stats->n > 1 ? stats->m2 / (stats->n - 1) : 0.0;
+}
+
+gdouble cfm_dwell_stats_stddev(const CFmDwellStats *stats)
+{
+	return sqrt(cfm_dwell_stats_variance(stats));
+}
+
+/* Stops as soon as the mean is far enough from the threshold, given how
+ * noisy the samples so far have been; otherwise keeps sampling until
+ * max_samples and then goes with the mean. */
+CFmDwellResult cfm_dwell_decide(const CFmDwellConfig *config,
+	const CFmDwellStats *stats)
+{
+	gdouble stderr_mean;
+
+	if (stats->n == 0) return CFM_DWELL_UNDECIDED;
+
+	if (stats->n >= config->min_samples) {
+		stderr_mean = MAX(cfm_dwell_stats_stddev(stats), MIN_STDDEV) /
+			sqrt(stats->n);
+		if (stats->mean - config->margin * stderr_mean > config->threshold) {
+			return CFM_DWELL_STATION;
+		}
+		if (stats->mean + config->margin * stderr_mean < config->threshold) {
+			return CFM_DWELL_EMPTY;
+		}
+	}
+
+	if (stats->n >= config->max_samples) {
+		return stats->mean > config->threshold ?
+			CFM_DWELL_STATION : CFM_DWELL_EMPTY;
+	}
+
+	return CFM_DWELL_UNDECIDED;
+}
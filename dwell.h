@@ -0,0 +1,44 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_DWELL_H_
+#define _CFM_DWELL_H_
+
+#include <glib.h>
+
+/* How long the scanner listens to a channel before calling it a station. */
+typedef struct {
+	guint min_samples;
+	guint max_samples;
+	guint interval_ms;  /* Between two samples */
+	guint threshold;    /* Mean signal above which there is a station */
+	gdouble margin;     /* Standard errors away from the threshold that
+	                     * count as a clear decision */
+} CFmDwellConfig;
+
+typedef enum {
+	CFM_DWELL_UNDECIDED = 0,
+	CFM_DWELL_STATION,
+	CFM_DWELL_EMPTY
+} CFmDwellResult;
+
+/* Running statistics of the signal samples taken on one channel. */
+typedef struct {
+	guint n;
+	gdouble mean;
+	gdouble m2;
+	guint min, max;
+} CFmDwellStats;
+
+void cfm_dwell_config_init(CFmDwellConfig *config);
+
+void cfm_dwell_stats_reset(CFmDwellStats *stats);
+void cfm_dwell_stats_add(CFmDwellStats *stats, guint signal);
+gdouble cfm_dwell_stats_variance(const CFmDwellStats *stats);
+gdouble cfm_dwell_stats_stddev(const CFmDwellStats *stats);
+
+CFmDwellResult cfm_dwell_decide(const CFmDwellConfig *config,
+	const CFmDwellStats *stats);
+
+#endif /* _CFM_DWELL_H_ */
@@ -0,0 +1,198 @@
+/*
+ * GPL 2
+ */
+
+#include <glib.h>
+
+#include "fine_tune.h"
+
+/* Looks for the point around a channel where a precise tuner gets the best
+ * reception: the strongest signal, and among points about as strong, the
+ * one with the smallest AFC error. Starts with a coarse pass over
+ * +-FINE_TUNE_SPAN and then keeps halving the step around the best point
+ * so far, down to FINE_TUNE_MIN_STEP. With an offset learned earlier, the
+ * coarse pass is skipped. Runs from a timeout in the main loop, one tuner
+ * operation per tick. */
+
+#define FINE_TUNE_DELAY_MS   500  /* Let the user finish stepping through channels */
+#define FINE_TUNE_TICK_MS    30
+#define FINE_TUNE_SAMPLES    2
+#define FINE_TUNE_SPAN       12000
+#define FINE_TUNE_COARSE     4000
+#define FINE_TUNE_MIN_STEP   500
+#define FINE_TUNE_MARGIN     (65536 / 100)
+#define FINE_TUNE_MIN_SIGNAL (65536 / 4)
+
+#define FINE_TUNE_MAX_QUEUE  (2 * FINE_TUNE_SPAN / FINE_TUNE_COARSE + 1)
+
+struct _CFmFineTune {
+	CFmTunerBackend *backend;
+	CFmFineTuneFunc func;
+	gpointer user_data;
+
+	gulong nominal;
+	gboolean learned;
+
+	glong queue[FINE_TUNE_MAX_QUEUE];
+	guint queue_len, queue_pos;
+	glong step;
+
+	gboolean have_best;
+	glong best;
+	guint best_signal;
+	gint best_afc;
+
+	gboolean tuned;
+	guint samples;
+	guint signal_sum;
+	gint afc_sum;
+
+	guint timer;
+};
+
+static gboolean fine_tune_better(CFmFineTune *ft, guint signal, gint afc)
+{
+	if (!ft->have_best) return TRUE;
+	if (signal > ft->best_signal + FINE_TUNE_MARGIN) return TRUE;
+	if (signal + FINE_TUNE_MARGIN < ft->best_signal) return FALSE;
+	return ABS(afc) < ABS(ft->best_afc);
+}
+
+static void fine_tune_push(CFmFineTune *ft, glong offset)
+{
+	const gulong freq = ft->nominal + offset;
+	if (freq < ft->backend->range_low || freq > ft->backend->range_high) return;
+	if (ft->have_best && offset == ft->best) return;
+	g_return_if_fail(ft->queue_len < FINE_TUNE_MAX_QUEUE);
+	ft->queue[ft->queue_len++] = offset;
+}
+
+static void fine_tune_refill(CFmFineTune *ft)
+{
+	ft->queue_len = ft->queue_pos = 0;
+	ft->step /= 2;
+	if (ft->step < FINE_TUNE_MIN_STEP) return;
+	fine_tune_push(ft, ft->best - ft->step);
+	fine_tune_push(ft, ft->best + ft->step);
+}
+
+static void fine_tune_finish(CFmFineTune *ft)
+{
+	const gulong freq = ft->nominal + ft->best;
+
+	if (ft->queue_pos == 0 || ft->queue[ft->queue_pos - 1] != ft->best) {
+		cfm_tuner_backend_tune(ft->backend, freq);
+	}
+
+	g_debug("Fine tuned %lu Hz to %+ld Hz (signal %u, afc %d)\n",
+		ft->nominal, ft->best, ft->best_signal, ft->best_afc);
+
+	ft->timer = 0;
+	ft->func(ft, freq, ft->have_best, ft->user_data);
+	g_slice_free(CFmFineTune, ft);
+}
+
+static gboolean fine_tune_tick(gpointer data)
+{
+	CFmFineTune *ft = data;
+	const glong offset = ft->queue[ft->queue_pos];
+	CFmTunerStatus status;
+	guint signal;
+	gint afc;
+
+	if (!ft->tuned) {
+		cfm_tuner_backend_tune(ft->backend, ft->nominal + offset);
+		ft->tuned = TRUE;
+		ft->samples = ft->signal_sum = ft->afc_sum = 0;
+		return TRUE;
+	}
+
+	if (cfm_tuner_backend_get_status(ft->backend, &status)) {
+		ft->signal_sum += MIN(status.signal, G_MAXUINT16);
+		ft->afc_sum += status.afc;
+	}
+	if (++ft->samples < FINE_TUNE_SAMPLES) {
+		return TRUE;
+	}
+
+	signal = ft->signal_sum / FINE_TUNE_SAMPLES;
+	afc = ft->afc_sum / FINE_TUNE_SAMPLES;
+	ft->tuned = FALSE;
+	ft->queue_pos++;
+
+	if (!ft->have_best && signal < FINE_TUNE_MIN_SIGNAL) {
+		/* No station here to fine tune to. */
+		ft->best = offset;
+		ft->best_signal = signal;
+		ft->best_afc = afc;
+		fine_tune_finish(ft);
+		return FALSE;
+	}
+	if (fine_tune_better(ft, signal, afc)) {
+		ft->best = offset;
+		ft->best_signal = signal;
+		ft->best_afc = afc;
+		if (!ft->have_best) {
+			ft->have_best = TRUE;
+			if (!ft->learned) {
+				glong o;
+				ft->queue_len = ft->queue_pos = 0;
+				for (o = -FINE_TUNE_SPAN; o <= FINE_TUNE_SPAN; o += FINE_TUNE_COARSE) {
+					fine_tune_push(ft, o);
+				}
+			}
+		}
+	}
+
+	if (ft->queue_pos >= ft->queue_len) {
+		fine_tune_refill(ft);
+		if (ft->queue_len == 0) {
+			fine_tune_finish(ft);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean fine_tune_begin(gpointer data)
+{
+	CFmFineTune *ft = data;
+	ft->timer = g_timeout_add(FINE_TUNE_TICK_MS, fine_tune_tick, ft);
+	return FALSE;
+}
+
+/* Starts measuring at nominal + hint; "learned" means hint came from an
+ * earlier search and only needs refining. The backend must stay open until
+ * the search finishes or is cancelled. */
+CFmFineTune* cfm_fine_tune_start(CFmTunerBackend *backend, gulong nominal,
+	glong hint, gboolean learned, CFmFineTuneFunc func, gpointer user_data)
+{
+	CFmFineTune *ft;
+
+	g_return_val_if_fail(cfm_tuner_backend_is_open(backend), NULL);
+
+	ft = g_slice_new0(CFmFineTune);
+	ft->backend = backend;
+	ft->func = func;
+	ft->user_data = user_data;
+	ft->nominal = nominal;
+	ft->learned = learned;
+	ft->step = FINE_TUNE_COARSE;
+	ft->queue[0] = hint;
+	ft->queue_len = 1;
+
+	ft->timer = g_timeout_add(FINE_TUNE_DELAY_MS, fine_tune_begin, ft);
+
+	return ft;
+}
+
+/* Leaves the tuner wherever the search was. */
+void cfm_fine_tune_cancel(CFmFineTune *ft)
+{
+	if (!ft) return;
+	if (ft->timer) {
+		g_source_remove(ft->timer);
+	}
+	g_slice_free(CFmFineTune, ft);
+}
@@ -0,0 +1,24 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_FINE_TUNE_H_
+#define _CFM_FINE_TUNE_H_
+
+#include <glib.h>
+
+#include "tuner_backend.h"
+
+typedef struct _CFmFineTune CFmFineTune;
+
+/* Called once the search is over, with the tuner left at "freq"; "found"
+ * is FALSE if there was no station to fine tune to. The search frees
+ * itself after this returns. */
+typedef void (*CFmFineTuneFunc)(CFmFineTune *ft, gulong freq, gboolean found,
+	gpointer user_data);
+
+CFmFineTune* cfm_fine_tune_start(CFmTunerBackend *backend, gulong nominal,
+	glong hint, gboolean learned, CFmFineTuneFunc func, gpointer user_data);
+void cfm_fine_tune_cancel(CFmFineTune *ft);
+
+#endif /* _CFM_FINE_TUNE_H_ */
@@ -0,0 +1,223 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "monitor.h"
+#include "rds.h"
+#include "rds_text.h"
+#include "rds_decoder.h"
+
+/* Continuously sweeps the band on a tuner that nobody is listening to,
+ * stopping on every channel with a station long enough to pick up its PS.
+ * Everything runs from a timeout in the main loop; each tick does at most
+ * one blocking tuner operation. The PS comes from this tuner's own raw
+ * RDS blocks; backends without them are asked for "rds_ps" instead. */
+
+#define MONITOR_TICK_MS       40
+#define MONITOR_RDS_POLL_MS   200
+#define MONITOR_RDS_DWELL_MS  2500
+#define MONITOR_THRESHOLD     (65536 / 3)
+
+typedef enum {
+	PHASE_TUNE,
+	PHASE_MEASURE,
+	PHASE_RDS
+} MonitorPhase;
+
+struct _CFmMonitor {
+	CFmTunerBackend *backend;
+	CFmMonitorFunc func;
+	gpointer user_data;
+
+	CFmSpectrumPoint *points;
+	gchar **ps;
+	guint len, pos;
+
+	MonitorPhase phase;
+	guint timer;
+	gint64 rds_deadline;  /* Monotonic ms */
+	gboolean rds_blocks;
+	CFmRdsDecoder rds;
+	CFmRdsText rds_ps;   /* Without raw blocks */
+};
+
+static gboolean cfm_monitor_tick(gpointer data);
+
+static void cfm_monitor_schedule(CFmMonitor *m, guint ms)
+{
+	m->timer = g_timeout_add(ms, cfm_monitor_tick, m);
+}
+
+static void cfm_monitor_next(CFmMonitor *m)
+{
+	m->func(m, m->pos, m->user_data);
+	m->pos = (m->pos + 1) % m->len;
+	m->phase = PHASE_TUNE;
+}
+
+/* Reads the PS, as received in the RDS set, into raw; returns -1 if this
+ * tuner does not do RDS at all, 0 if no PS is confirmed yet. */
+static gssize cfm_monitor_read_ps(CFmMonitor *m, gchar *raw, gsize len)
+{
+	guint8 buf[CFM_RDS_BLOCK_SIZE * 32];
+	guint changed = 0;
+	gssize n;
+
+	if (!m->rds_blocks) {
+		n = cfm_tuner_backend_read_rds_into(m->backend, "rds_ps", raw, len);
+		/* Only a name read back the same way twice ends up in the presets. */
+		if (n > 0 && cfm_rds_text_vote_string(&m->rds_ps, raw, n)) {
+			return g_strlcpy(raw, m->rds_ps.text, len);
+		}
+		raw[0] = '\0';
+		return MIN(n, 0);
+	}
+
+	raw[0] = '\0';
+
+	while ((n = cfm_tuner_backend_read_rds_blocks(m->backend, buf, sizeof(buf))) > 0) {
+		changed |= cfm_rds_decoder_feed(&m->rds, buf, n);
+	}
+	if (n < 0) return -1;
+	if (!(changed & CFM_RDS_CHANGED_PS)) return 0;
+	return g_strlcpy(raw, m->rds.ps.text, len);
+}
+
+static gboolean cfm_monitor_tick(gpointer data)
+{
+	CFmMonitor *m = data;
+	CFmSpectrumPoint *p = &m->points[m->pos];
+	CFmTunerStatus status;
+	guint8 buf[CFM_RDS_BLOCK_SIZE * 32];
+	gchar raw[128];
+	gssize n;
+
+	switch (m->phase) {
+	case PHASE_TUNE:
+		cfm_tuner_backend_tune(m->backend, p->freq);
+		if (m->rds_blocks) {
+			/* Whatever is queued was received on the previous channel. */
+			while (cfm_tuner_backend_read_rds_blocks(m->backend, buf, sizeof(buf)) > 0);
+			cfm_rds_decoder_reset(&m->rds);
+		}
+		m->phase = PHASE_MEASURE;
+		return TRUE;
+	case PHASE_MEASURE:
+		if (!cfm_tuner_backend_get_status(m->backend, &status)) {
+			cfm_monitor_next(m);
+			return TRUE;
+		}
+		p->signal = MIN(status.signal, G_MAXUINT16);
+		p->stereo = status.stereo;
+		if (p->signal <= MONITOR_THRESHOLD) {
+			g_free(m->ps[m->pos]);
+			m->ps[m->pos] = NULL;
+			cfm_monitor_next(m);
+			return TRUE;
+		}
+		m->phase = PHASE_RDS;
+		cfm_rds_text_init(&m->rds_ps, 0);
+		m->rds_deadline = cfm_monotonic_ms() + MONITOR_RDS_DWELL_MS;
+		/* Slow down while waiting for RDS to arrive. */
+		cfm_monitor_schedule(m, MONITOR_RDS_POLL_MS);
+		return FALSE;
+	case PHASE_RDS:
+		n = cfm_monitor_read_ps(m, raw, sizeof(raw));
+		if (n > 0) {
+			/* Nothing to decode until something other than blanks arrives. */
+			g_strstrip(raw);
+		}
+		if (n > 0 && raw[0]) {
+			g_free(m->ps[m->pos]);
+			m->ps[m->pos] = rds_decode(raw);
+		}
+		if (n < 0 || raw[0] || cfm_monotonic_ms() >= m->rds_deadline) {
+			cfm_monitor_next(m);
+			cfm_monitor_schedule(m, MONITOR_TICK_MS);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	return TRUE;
+}
+
+/* Takes ownership of an already opened backend. */
+CFmMonitor* cfm_monitor_new(CFmTunerBackend *backend, const CFmBandPlan *plan,
+	CFmMonitorFunc func, gpointer user_data)
+{
+	CFmMonitor *m;
+	guint first, last, i;
+
+	g_return_val_if_fail(cfm_tuner_backend_is_open(backend), NULL);
+	if (!cfm_band_plan_clip(plan, backend->range_low, backend->range_high,
+	                        &first, &last)) {
+		g_warning("Band plan %s is outside the monitor tuner range\n", plan->id);
+		cfm_tuner_backend_free(backend);
+		return NULL;
+	}
+
+	m = g_slice_new0(CFmMonitor);
+	m->backend = backend;
+	m->func = func;
+	m->user_data = user_data;
+	m->rds_blocks = cfm_tuner_backend_get_rds_fd(backend, CFM_TUNER_RDS_BLOCKS) != -1;
+	cfm_rds_decoder_init(&m->rds);
+
+	m->len = last - first + 1;
+	m->points = g_new0(CFmSpectrumPoint, m->len);
+	m->ps = g_new0(gchar*, m->len);
+	for (i = 0; i < m->len; i++) {
+		m->points[i].freq = cfm_band_plan_channel(plan, first + i);
+	}
+
+	/* Nobody listens to this tuner. */
+	cfm_tuner_backend_power(backend, FALSE);
+
+	cfm_monitor_schedule(m, MONITOR_TICK_MS);
+
+	return m;
+}
+
+void cfm_monitor_free(CFmMonitor *m)
+{
+	guint i;
+
+	if (!m) return;
+	if (m->timer) {
+		g_source_remove(m->timer);
+	}
+	for (i = 0; i < m->len; i++) {
+		g_free(m->ps[i]);
+	}
+	g_free(m->ps);
+	g_free(m->points);
+	cfm_tuner_backend_free(m->backend);
+	g_slice_free(CFmMonitor, m);
+}
+
+/* Starts a new pass from the bottom of the band. */
+void cfm_monitor_restart(CFmMonitor *m)
+{
+	if (m->timer) {
+		g_source_remove(m->timer);
+	}
+	m->pos = 0;
+	m->phase = PHASE_TUNE;
+	cfm_monitor_schedule(m, MONITOR_TICK_MS);
+}
+
+const CFmSpectrumPoint* cfm_monitor_get_spectrum(CFmMonitor *m, guint *len)
+{
+	*len = m->len;
+	return m->points;
+}
+
+const gchar* cfm_monitor_get_ps(CFmMonitor *m, guint index)
+{
+	g_return_val_if_fail(index < m->len, NULL);
+	return m->ps[index];
+}
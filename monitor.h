@@ -0,0 +1,29 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_MONITOR_H_
+#define _CFM_MONITOR_H_
+
+#include <glib.h>
+
+#include "types.h"
+#include "tuner_backend.h"
+#include "band.h"
+
+typedef struct _CFmMonitor CFmMonitor;
+
+/* Called every time a channel has been measured (and its RDS collected, if
+ * it carried a station). */
+typedef void (*CFmMonitorFunc)(CFmMonitor *monitor, guint index, gpointer user_data);
+
+CFmMonitor* cfm_monitor_new(CFmTunerBackend *backend, const CFmBandPlan *plan,
+	CFmMonitorFunc func, gpointer user_data);
+void cfm_monitor_free(CFmMonitor *monitor);
+
+void cfm_monitor_restart(CFmMonitor *monitor);
+
+const CFmSpectrumPoint* cfm_monitor_get_spectrum(CFmMonitor *monitor, guint *len);
+const gchar* cfm_monitor_get_ps(CFmMonitor *monitor, guint index);
+
+#endif /* _CFM_MONITOR_H_ */
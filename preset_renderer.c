@@ -5,6 +5,7 @@
 #include <gtk/gtk.h>
 
 #include "preset_renderer.h"
+#include "band.h"
 
 G_DEFINE_TYPE (CFmPresetRenderer, cfm_preset_renderer, GTK_TYPE_CELL_RENDERER);
 
@@ -120,7 +121,8 @@ static void cfm_preset_renderer_set_property(GObject *object, guint property_id,
 	case PROP_FREQUENCY:
 		g_free(self->freq_text);
 		self->frequency = g_value_get_ulong(value);
-		self->freq_text = g_strdup_printf("%.1f MHz",
+		self->freq_text = g_strdup_printf("%.*f MHz",
+		                                  cfm_band_freq_decimals(self->frequency),
 		                                  self->frequency / 1000000.0f);
 		break;
 	default:
@@ -7,6 +7,7 @@
 #include <gconf/gconf-client.h>
 
 #include "presets.h"
+#include "band.h"
 
 G_DEFINE_TYPE(CFmPresets, cfm_presets, G_TYPE_OBJECT);
 
@@ -14,20 +15,48 @@ G_DEFINE_TYPE(CFmPresets, cfm_presets, G_TYPE_OBJECT);
 
 #define GCONF_KEY_BUFFER_LEN 1024
 #define GCONF_PATH           "/apps/maemo/cfmradio/presets"
+#define GCONF_RDS_PATH       "/apps/maemo/cfmradio/preset-rds"
+
+/* What RDS told about a preset's station is kept apart from its name, so
+ * that older versions still find only names under GCONF_PATH. It is an
+ * integer under the same key: the PTY in bits 0-4, the PI code in bits
+ * 8-23 and, in bits 24-30, the signal the station was found with, in
+ * steps of 512. */
+#define RDS_SIGNAL_SHIFT     9
+#define RDS_VALUE(pi, pty, signal) \
+	((MIN((signal) >> RDS_SIGNAL_SHIFT, 0x7F) << 24) | ((pi) << 8) | (pty))
+#define RDS_VALUE_PI(v)      (((v) >> 8) & 0xFFFF)
+#define RDS_VALUE_PTY(v)     ((v) & 0x1F)
+#define RDS_VALUE_SIGNAL(v)  ((((v) >> 24) & 0x7F) << RDS_SIGNAL_SHIFT)
+
+/* Presets of one station on its alternative frequencies, found by the PI
+ * code they share; only the one with the strongest signal is shown. */
+typedef struct {
+	GSList *freqs;
+	gulong shown;
+} PresetGroup;
 
 struct _CFmPresetsPrivate {
 	GConfClient *gconf;
 	gchar *name;
 	gchar *gconf_dir;
 	guint gconf_notify;
+	gchar *rds_dir;
+	guint rds_notify;
 	GtkListStore *l;
+	GtkTreeModel *filter; /* l, one row per station */
 	GHashTable *t;
+	GHashTable *groups;   /* PI code to PresetGroup */
 };
 
 enum {
 	COL_INVALID = -1,
 	COL_FREQUENCY = 0,
-	COL_NAME
+	COL_NAME,
+	COL_PI,
+	COL_PTY,
+	COL_SIGNAL,
+	COL_VISIBLE
 };
 
 enum {
@@ -41,7 +70,7 @@ static GParamSpec *properties[PROP_LAST];
 
 static inline gulong round_freq(gulong freq)
 {
-	const gulong round_to = 100000; /* 0.1 MHz */
+	const gulong round_to = 10000; /* 0.01 MHz, finer than any band plan */
 	return ((freq + round_to / 2) / round_to) * round_to;
 }
 
@@ -55,6 +84,13 @@ static inline gfloat freq_to_ffreq(gulong freq)
 	return freq / 1000000.0f;
 }
 
+/* Keys stay "%.1f" on the 100 kHz grid so existing presets keep working. */
+static inline const gchar* freq_to_key(gchar *buf, gsize len, gulong freq)
+{
+	return g_ascii_formatd(buf, len,
+		cfm_band_freq_decimals(freq) > 1 ? "%.2f" : "%.1f", freq_to_ffreq(freq));
+}
+
 static inline gpointer freq_to_pointer(gulong freq)
 {
 	return GUINT_TO_POINTER(freq);
@@ -80,6 +116,13 @@ static void destroy_iter(gpointer data)
 	g_slice_free(GtkTreeIter, data);
 }
 
+static void destroy_group(gpointer data)
+{
+	PresetGroup *group = data;
+	g_slist_free(group->freqs);
+	g_slice_free(PresetGroup, group);
+}
+
 static void func_gconf_entry_free(gpointer data, gpointer user_data)
 {
 	GConfEntry *entry = (GConfEntry*) data;
@@ -98,6 +141,118 @@ static gint compare_freq(GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b,
 	else return 0;
 }
 
+static void cfm_presets_set_visible(CFmPresets *self, gulong freq, gboolean visible)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	GtkTreeIter *iter = g_hash_table_lookup(priv->t, freq_to_pointer(freq));
+	gtk_list_store_set(priv->l, iter, COL_VISIBLE, visible, COL_INVALID);
+}
+
+static guint cfm_presets_get_signal(CFmPresets *self, gulong freq)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	GtkTreeIter *iter = g_hash_table_lookup(priv->t, freq_to_pointer(freq));
+	guint signal;
+	gtk_tree_model_get(GTK_TREE_MODEL(priv->l), iter, COL_SIGNAL, &signal, COL_INVALID);
+	return signal;
+}
+
+/* Adding a preset only compares it with the one its station is shown as,
+ * whatever the number of presets. */
+static void cfm_presets_group_add(CFmPresets *self, gulong freq, guint pi)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	PresetGroup *group;
+
+	if (!pi) {
+		cfm_presets_set_visible(self, freq, TRUE);
+		return;
+	}
+
+	group = g_hash_table_lookup(priv->groups, GUINT_TO_POINTER(pi));
+	if (!group) {
+		group = g_slice_new0(PresetGroup);
+		g_hash_table_insert(priv->groups, GUINT_TO_POINTER(pi), group);
+	}
+	group->freqs = g_slist_prepend(group->freqs, freq_to_pointer(freq));
+
+	if (!group->shown) {
+		group->shown = freq;
+		cfm_presets_set_visible(self, freq, TRUE);
+	} else if (cfm_presets_get_signal(self, freq) > cfm_presets_get_signal(self, group->shown)) {
+		cfm_presets_set_visible(self, group->shown, FALSE);
+		group->shown = freq;
+		cfm_presets_set_visible(self, freq, TRUE);
+	} else {
+		cfm_presets_set_visible(self, freq, FALSE);
+	}
+}
+
+/* Only has to look through the station's other frequencies, if the one
+ * shown goes. */
+static void cfm_presets_group_remove(CFmPresets *self, gulong freq, guint pi)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	PresetGroup *group;
+	GSList *i;
+	guint best = 0;
+
+	if (!pi) return;
+	group = g_hash_table_lookup(priv->groups, GUINT_TO_POINTER(pi));
+	if (!group) return;
+
+	group->freqs = g_slist_remove(group->freqs, freq_to_pointer(freq));
+	if (!group->freqs) {
+		g_hash_table_remove(priv->groups, GUINT_TO_POINTER(pi));
+		return;
+	}
+	if (group->shown != freq) {
+		return;
+	}
+
+	group->shown = pointer_to_freq(group->freqs->data);
+	for (i = group->freqs; i; i = g_slist_next(i)) {
+		const guint signal = cfm_presets_get_signal(self, pointer_to_freq(i->data));
+		if (signal > best) {
+			best = signal;
+			group->shown = pointer_to_freq(i->data);
+		}
+	}
+	cfm_presets_set_visible(self, group->shown, TRUE);
+}
+
+/* Sets the RDS columns of a preset from a stored value, moving it to the
+ * group of its PI code. */
+static void cfm_presets_update_rds(CFmPresets *self, gulong freq, GtkTreeIter *iter,
+	gint value)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	guint pi;
+
+	gtk_tree_model_get(GTK_TREE_MODEL(priv->l), iter, COL_PI, &pi, COL_INVALID);
+	cfm_presets_group_remove(self, freq, pi);
+
+	gtk_list_store_set(priv->l, iter,
+		COL_PI, RDS_VALUE_PI(value),
+		COL_PTY, RDS_VALUE_PTY(value),
+		COL_SIGNAL, RDS_VALUE_SIGNAL(value),
+		COL_INVALID);
+	cfm_presets_group_add(self, freq, RDS_VALUE_PI(value));
+}
+
+/* Fills in the RDS columns of a preset from what is stored for freq. */
+static void cfm_presets_load_rds(CFmPresets *self, gulong freq, GtkTreeIter *iter)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar *key = g_strdup_printf("%s/%s", priv->rds_dir,
+		freq_to_key(buf, sizeof(buf), freq));
+
+	cfm_presets_update_rds(self, freq, iter,
+		gconf_client_get_int(priv->gconf, key, NULL));
+	g_free(key);
+}
+
 static void cfm_presets_load(CFmPresets *self)
 {
 	CFmPresetsPrivate *priv = self->priv;
@@ -105,6 +260,7 @@ static void cfm_presets_load(CFmPresets *self)
 	g_debug("Loading presets from %s\n", priv->gconf_dir);
 
 	g_hash_table_remove_all(priv->t);
+	g_hash_table_remove_all(priv->groups);
 
 	GSList *i, *l = gconf_client_all_entries(priv->gconf, priv->gconf_dir, NULL);
 	for (i = l; i; i = g_slist_next(i)) {
@@ -120,6 +276,7 @@ static void cfm_presets_load(CFmPresets *self)
 			COL_INVALID
 			);
 		g_hash_table_insert(priv->t, freq_to_pointer(freq), iter);
+		cfm_presets_load_rds(self, freq, iter);
 	}
 
 	g_slist_foreach(l, func_gconf_entry_free, NULL);
@@ -158,19 +315,45 @@ static void cfm_presets_gconf_notify(GConfClient *gconf, guint cnxn_id,
 				COL_INVALID
 			);
 			g_hash_table_insert(priv->t, freq_to_pointer(freq), iter);
+			cfm_presets_load_rds(self, freq, iter);
 		}
 		
 	} else {
 		
 		if (t_data) {
 			GtkTreeIter *iter = (GtkTreeIter*)t_data;
+			guint pi;
 			g_debug("Preset '%s' removed\n", basename);
+			gtk_tree_model_get(GTK_TREE_MODEL(priv->l), iter, COL_PI, &pi, COL_INVALID);
+			cfm_presets_group_remove(self, freq, pi);
 			gtk_list_store_remove(priv->l, iter);
 			g_hash_table_remove(priv->t, freq_to_pointer(freq));
 		}
 	}
 }
 
+static void cfm_presets_rds_notify(GConfClient *gconf, guint cnxn_id,
+	GConfEntry *entry, gpointer user_data)
+{
+	CFmPresets *self = CFM_PRESETS(user_data);
+	CFmPresetsPrivate *priv = self->priv;
+
+	if (!entry) {
+		return;
+	}
+
+	const gchar *basename = g_basename(gconf_entry_get_key(entry));
+	gulong freq = ffreq_to_freq(g_ascii_strtod(basename, NULL));
+	GtkTreeIter *iter = g_hash_table_lookup(priv->t, freq_to_pointer(freq));
+	GConfValue *value = gconf_entry_get_value(entry);
+	gint v = value && value->type == GCONF_VALUE_INT ? gconf_value_get_int(value) : 0;
+
+	if (iter) {
+		/* Otherwise read along with the name once that arrives */
+		cfm_presets_update_rds(self, freq, iter, v);
+	}
+}
+
 static void cfm_presets_set_property(GObject *object, guint property_id,
 	const GValue *value, GParamSpec *pspec)
 {
@@ -195,7 +378,7 @@ static void cfm_presets_get_property(GObject *object, guint property_id,
 		g_value_set_string(value, self->priv->name);
 		break;
 	case PROP_MODEL:
-		g_value_set_object(value, self->priv->l);
+		g_value_set_object(value, self->priv->filter);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -212,6 +395,8 @@ static void cfm_presets_init(CFmPresets *self)
 	priv->gconf = gconf_client_get_default();
 	priv->t = g_hash_table_new_full(g_direct_hash, g_direct_equal,
 		NULL, destroy_iter);
+	priv->groups = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, destroy_group);
 }
 
 static GObject * cfm_presets_constructor(GType gtype, guint n_properties,
@@ -223,17 +408,26 @@ static GObject * cfm_presets_constructor(GType gtype, guint n_properties,
 	CFmPresetsPrivate *priv = self->priv;
 
 	priv->gconf_dir = g_strdup_printf("%s/%s", GCONF_PATH, priv->name);
+	priv->rds_dir = g_strdup_printf("%s/%s", GCONF_RDS_PATH, priv->name);
 
 	gconf_client_add_dir(priv->gconf, priv->gconf_dir, GCONF_CLIENT_PRELOAD_ONELEVEL,
 		NULL);
 	priv->gconf_notify = gconf_client_notify_add(priv->gconf, priv->gconf_dir,
 		cfm_presets_gconf_notify, self, NULL, NULL);
+	gconf_client_add_dir(priv->gconf, priv->rds_dir, GCONF_CLIENT_PRELOAD_ONELEVEL,
+		NULL);
+	priv->rds_notify = gconf_client_notify_add(priv->gconf, priv->rds_dir,
+		cfm_presets_rds_notify, self, NULL, NULL);
 
-	priv->l = gtk_list_store_new(2, G_TYPE_ULONG, G_TYPE_STRING);
+	priv->l = gtk_list_store_new(6, G_TYPE_ULONG, G_TYPE_STRING,
+		G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_BOOLEAN);
 	gtk_tree_sortable_set_sort_func(GTK_TREE_SORTABLE(priv->l), 0, compare_freq,
 		NULL, NULL);
 	gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(priv->l), 0,
 		GTK_SORT_ASCENDING);
+	priv->filter = gtk_tree_model_filter_new(GTK_TREE_MODEL(priv->l), NULL);
+	gtk_tree_model_filter_set_visible_column(GTK_TREE_MODEL_FILTER(priv->filter),
+		COL_VISIBLE);
 
 	cfm_presets_load(self);
 
@@ -251,14 +445,28 @@ static void cfm_presets_dispose(GObject *object)
 	if (priv->gconf && priv->gconf_dir) {
 		gconf_client_remove_dir(priv->gconf, priv->gconf_dir, NULL);
 	}
+	if (priv->gconf && priv->rds_notify) {
+		gconf_client_notify_remove(priv->gconf, priv->rds_notify);
+	}
+	if (priv->gconf && priv->rds_dir) {
+		gconf_client_remove_dir(priv->gconf, priv->rds_dir, NULL);
+	}
 	if (priv->gconf_dir) {
 		g_free(priv->gconf_dir);
 		priv->gconf_dir = NULL;
 	}
+	if (priv->rds_dir) {
+		g_free(priv->rds_dir);
+		priv->rds_dir = NULL;
+	}
 	if (priv->gconf) {
 		g_object_unref(priv->gconf);
 		priv->gconf = NULL;
 	}
+	if (priv->filter) {
+		g_object_unref(priv->filter);
+		priv->filter = NULL;
+	}
 	if (priv->l) {
 		g_object_unref(priv->l);
 		priv->l = NULL;
@@ -271,6 +479,7 @@ static void cfm_presets_finalize(GObject *object)
 	CFmPresetsPrivate *priv = self->priv;
 
 	g_hash_table_destroy(priv->t);
+	g_hash_table_destroy(priv->groups);
 	g_free(priv->name);
 }
 
@@ -297,7 +506,7 @@ static void cfm_presets_class_init(CFmPresetsClass *klass)
 	g_object_class_install_property(gobject_class, PROP_NAME, param_spec);
 	param_spec = g_param_spec_object("model",
 	                                 "Preset list model",
-	                                 "A model containing this set of presets",
+	                                 "A model containing this set of presets, one per station",
 	                                 GTK_TYPE_TREE_MODEL,
 	                                 G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
 	properties[PROP_MODEL] = param_spec;
@@ -328,7 +537,7 @@ void cfm_presets_set_preset(CFmPresets *self, gulong freq, const gchar *name)
 	GError *error = NULL;
 	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
 	gchar *key = g_strdup_printf("%s/%s", priv->gconf_dir,
-		g_ascii_formatd(buf, sizeof(buf), "%.1f", freq_to_ffreq(freq)));
+		freq_to_key(buf, sizeof(buf), freq));
 	if (!gconf_client_set_string(priv->gconf, key, name, &error)) {
 		g_warning("Failed to store preset '%s' ('%s'): %s\n", key, name,
 			error->message);
@@ -342,11 +551,65 @@ void cfm_presets_remove_preset(CFmPresets *self, gulong freq)
 	GError *error = NULL;
 	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
 	gchar *key = g_strdup_printf("%s/%s", priv->gconf_dir,
-		g_ascii_formatd(buf, sizeof(buf), "%.1f", freq_to_ffreq(freq)));
+		freq_to_key(buf, sizeof(buf), freq));
 	if (!gconf_client_unset(priv->gconf, key, &error)) {
 		g_warning("Failed to remove preset '%s': %s\n", key, error->message);
 	}
 	g_free(key);
+
+	key = g_strdup_printf("%s/%s", priv->rds_dir, freq_to_key(buf, sizeof(buf), freq));
+	gconf_client_unset(priv->gconf, key, NULL);
+	g_free(key);
+}
+
+/* Remembers the station's PI code and programme type along with the
+ * preset, and how strong it was; of the presets with the same PI code,
+ * the model only has the strongest. */
+void cfm_presets_set_preset_rds(CFmPresets *self, gulong freq, guint16 pi, guint8 pty,
+	guint signal)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	GError *error = NULL;
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar *key = g_strdup_printf("%s/%s", priv->rds_dir,
+		freq_to_key(buf, sizeof(buf), freq));
+	if (!gconf_client_set_int(priv->gconf, key, RDS_VALUE(pi, pty, signal), &error)) {
+		g_warning("Failed to store preset RDS '%s': %s\n", key, error->message);
+		g_error_free(error);
+	}
+	g_free(key);
+}
+
+/* Returns FALSE if freq is not a preset or its PI code is not known. */
+gboolean cfm_presets_get_preset_rds(CFmPresets *self, gulong freq,
+	guint16 *pi, guint8 *pty)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	GtkTreeIter *iter = g_hash_table_lookup(priv->t, freq_to_pointer(freq));
+	guint p = 0, t = 0;
+
+	if (iter) {
+		gtk_tree_model_get(GTK_TREE_MODEL(priv->l), iter,
+			COL_PI, &p, COL_PTY, &t, COL_INVALID);
+	}
+	if (pi) *pi = p;
+	if (pty) *pty = t;
+	return p != 0;
+}
+
+/* The preset the model has for the station on freq, which may be on one
+ * of its alternative frequencies; freq itself if there is no other. */
+gulong cfm_presets_get_station_freq(CFmPresets *self, gulong freq)
+{
+	CFmPresetsPrivate *priv = self->priv;
+	PresetGroup *group;
+	guint16 pi;
+
+	if (!cfm_presets_get_preset_rds(self, freq, &pi, NULL)) {
+		return freq;
+	}
+	group = g_hash_table_lookup(priv->groups, GUINT_TO_POINTER(pi));
+	return group && group->shown ? group->shown : freq;
 }
 
 gboolean cfm_presets_is_preset(CFmPresets *self, gulong freq)
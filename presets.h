@@ -39,5 +39,11 @@ void cfm_presets_remove_preset(CFmPresets *self, gulong freq);
 gboolean cfm_presets_is_preset(CFmPresets *self, gulong freq);
 gchar* cfm_presets_get_preset(CFmPresets *self, gulong freq);
 
+void cfm_presets_set_preset_rds(CFmPresets *self, gulong freq, guint16 pi, guint8 pty,
+	guint signal);
+gboolean cfm_presets_get_preset_rds(CFmPresets *self, gulong freq,
+	guint16 *pi, guint8 *pty);
+gulong cfm_presets_get_station_freq(CFmPresets *self, gulong freq);
+
 #endif /* __CFM_PRESETS_H__ */
 
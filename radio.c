@@ -3,15 +3,11 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-
-#include <sys/types.h>
-#include <sys/ioctl.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <time.h>
 
 #include <alsa/asoundlib.h>
-#include <linux/videodev2.h>
 #include <dbus/dbus-glib.h>
 #include <pulse/glib-mainloop.h>
 #include <pulse/error.h>
@@ -24,6 +20,16 @@
 #include "types.h"
 #include "n900-fmrx-enabler.h"
 #include "rds.h"
+#include "tuner_backend.h"
+#include "monitor.h"
+#include "band.h"
+#include "stereo_control.h"
+#include "reception_log.h"
+#include "fine_tune.h"
+#include "af_follow.h"
+#include "station_db.h"
+#include "rds_decoder.h"
+#include "rds_text.h"
 
 G_DEFINE_TYPE(CFmRadio, cfm_radio, G_TYPE_OBJECT);
 
@@ -38,20 +44,61 @@ G_DEFINE_TYPE(CFmRadio, cfm_radio, G_TYPE_OBJECT);
 #define FMRX_INTERFACE    "de.pycage.FMRXEnabler"
 #define FMRX_KEEPALIVE_INTERVAL 20
 
-#define SYSFS_NODE_PATH	"/sys/class/i2c-adapter/i2c-3/3-0022"
-
 #define MIXER_NAME			"hw:0"
 
+#define STEREO_POLL_MS 250
+
+#define RDS_POLL_MIN_MS 250
+#define RDS_POLL_MAX_MS 2000
+#define RDS_VOTE_SPACING_MS 350 /* One PS cycle: four 0A groups */
+#define RDS_BLOCKS_POLL_MS 100
+#define RDS_BLOCKS_SPURIOUS 3 /* Wakeups with nothing to read before polling */
+#define RDS_BUF_LEN     128
+#define RDS_CT_TOLERANCE_MS 2000
+#define RDS_TAG_LEN     (CFM_RDS_RT_LEN * RDS_UTF8_MAX_LEN + 1)
+
+#define RECEPTION_LOG_INTERVAL 2 /* seconds */
+#define RECEPTION_LOG_MAX_SIZE (4 * 1024 * 1024)
+
+#define AF_POLL_MS    500
+#define AF_THRESHOLD  (65536 / 5)
+#define AF_LOW_MS     3000  /* Signal has to stay weak this long */
+#define AF_RETRY_MS   30000 /* After a check that found nothing better */
+
 static void cfm_radio_turn_on(CFmRadio *self);
 static void cfm_radio_turn_off(CFmRadio *self);
+static void cfm_radio_stereo_start(CFmRadio *self);
+static void cfm_radio_stereo_stop(CFmRadio *self);
+static void cfm_radio_reception_start(CFmRadio *self);
+static void cfm_radio_reception_stop(CFmRadio *self);
+static void cfm_radio_rds_start(CFmRadio *self);
+static void cfm_radio_rds_reset(CFmRadio *self);
+static void cfm_radio_station_name_update(CFmRadio *self);
+static const gchar* cfm_radio_get_station_name(CFmRadio *self);
+static gboolean cfm_radio_rds_poll(gpointer data);
+static void cfm_radio_af_start(CFmRadio *self);
+static void cfm_radio_af_stop(CFmRadio *self);
+
+typedef enum {
+	RDS_PI,
+	RDS_PS,
+	RDS_RT,
+	RDS_N_KEYS
+} CFmRadioRdsKey;
+
+static const gchar * const rds_keys[RDS_N_KEYS] = { "rds_pi", "rds_ps", "rds_rt" };
+static const gchar * const rds_props[RDS_N_KEYS] = { "rds-pi", "rds-ps", "rds-rt" };
 
 struct _CFmRadioPrivate {
-	int fd;
+	CFmTunerBackend *backend;
+	gchar *backend_name;
+	gchar *device;
+	gchar *trace;
 
 	CFmRadioOutput output;
 
-	gboolean precise_tuner;
 	gulong range_low, range_high;
+	const CFmBandPlan *band;
 
 	DBusGProxy *enabler;
 	guint enabler_timer;
@@ -61,6 +108,59 @@ struct _CFmRadioPrivate {
 	pa_stream *so, *si;
 
 	snd_hctl_t *mixer;
+
+	CFmSpectrumPoint *sweep;
+	guint sweep_len, sweep_pos;
+	guint sweep_idle;
+	gulong sweep_prev_freq;
+
+	CFmMonitor *monitor;
+
+	gchar rds_raw[RDS_N_KEYS][RDS_BUF_LEN + 1];
+	guint rds_raw_len[RDS_N_KEYS];
+	RdsCharset rds_charset[RDS_N_KEYS];
+	gchar rds_text[RDS_N_KEYS][RDS_BUF_LEN * RDS_UTF8_MAX_LEN + 1];
+	gchar rds_artist[RDS_TAG_LEN], rds_title[RDS_TAG_LEN]; /* From RT+ */
+	guint16 rds_pi_code;
+	guint rds_pty;         /* Only known from raw blocks */
+	guint rds_watch[RDS_N_KEYS];
+	guint rds_timer, rds_interval;
+	gboolean rds_notified;
+	CFmRdsText rds_votes[RDS_N_KEYS];
+	gint64 rds_voted_at[RDS_N_KEYS];
+	CFmRdsDecoder rds_decoder;
+	guint rds_blocks_watch;
+	guint rds_blocks_empty;
+	gboolean rds_show_ert;  /* Enhanced RadioText rather than RT */
+	gboolean rds_ert_fresh; /* It changed since RT last did */
+	gint64 rds_time;           /* Last confirmed clock time, 0 if none */
+	gint rds_local_offset;     /* Minutes */
+	gint64 rds_ct_prev, rds_ct_prev_at;
+	gboolean has_clock_offset;
+	gint64 clock_offset_ms;    /* Station time minus system time */
+
+	CFmStereoControl stereo_ctl;
+	gboolean auto_mono;
+	guint stereo_timer;
+
+	gchar *reception_log_file;
+	gchar *station_db_file;
+	CFmStationDb *station_db;
+	const gchar *station_db_name; /* Until the PS arrives, or NULL */
+	CFmReceptionLog *reception_log;
+	guint reception_timer;
+
+	gboolean auto_fine_tune;
+	CFmFineTune *fine_tune;
+	gulong nominal;
+	glong fine_offset;
+	GHashTable *station_offsets;
+
+	gboolean auto_af;
+	CFmAfFollow *af_follow;
+	GHashTable *af_cache;
+	guint af_timer;
+	gint64 af_low_since, af_retry_at;
 };
 
 enum {
@@ -73,38 +173,76 @@ enum {
 	PROP_RDS_PI,
 	PROP_RDS_PS,
 	PROP_RDS_RT,
+	PROP_RDS_ARTIST,
+	PROP_RDS_TITLE,
+	PROP_RDS_PTY,
+	PROP_BACKEND,
+	PROP_DEVICE,
+	PROP_TRACE,
+	PROP_BAND,
+	PROP_AUTO_MONO,
+	PROP_STEREO,
+	PROP_RECEPTION_LOG,
+	PROP_AUTO_FINE_TUNE,
+	PROP_FINE_TUNE_OFFSET,
+	PROP_AUTO_AF,
+	PROP_RDS_TIME,
+	PROP_STATION_DB,
+	PROP_STATION_NAME,
 	PROP_LAST
 };
 
+enum {
+	SIGNAL_0,
+	SIGNAL_SWEEP_PROGRESS,
+	SIGNAL_SWEEP_FINISHED,
+	SIGNAL_MONITOR_PROGRESS,
+	SIGNAL_LAST
+};
+
 static GParamSpec *properties[PROP_LAST];
+static guint signals[SIGNAL_LAST];
 
 static void cfm_radio_tuner_power(CFmRadio *self, gboolean enable)
 {
 	CFmRadioPrivate *priv = self->priv;
-	struct v4l2_control vctrl;
-	int res;
 
-	if (priv->fd == -1) return;
+	if (!cfm_tuner_backend_is_open(priv->backend)) return;
 
-	vctrl.id = V4L2_CID_AUDIO_MUTE;
-	vctrl.value = enable ? 0 : 1;
-	res = ioctl(priv->fd, VIDIOC_S_CTRL, &vctrl);
+	cfm_tuner_backend_power(priv->backend, enable);
+}
 
-	if (res < 0) {
-		perror("VIDIOC_S_CTRL");
+static void cfm_radio_fine_tune_cancel(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (priv->fine_tune) {
+		cfm_fine_tune_cancel(priv->fine_tune);
+		priv->fine_tune = NULL;
+	}
+	priv->fine_offset = 0;
+}
+
+/* Goes back to the frequency the check started from. */
+static void cfm_radio_af_cancel(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (!priv->af_follow) return;
+	cfm_af_follow_cancel(priv->af_follow);
+	priv->af_follow = NULL;
+	if (cfm_tuner_backend_is_open(priv->backend)) {
+		cfm_tuner_backend_tune(priv->backend, priv->nominal + priv->fine_offset);
 	}
 }
 
 static void cfm_radio_tuner_hw_seek(CFmRadio *self, gboolean upward)
 {
 	CFmRadioPrivate *priv = self->priv;
-	struct v4l2_hw_freq_seek t_freq_seek = { 0 };
-	g_return_if_fail(priv->fd != -1);
-	t_freq_seek.tuner = 0;
-	t_freq_seek.type = V4L2_TUNER_RADIO;
-	t_freq_seek.seek_upward = upward;
-	int res = ioctl(priv->fd, VIDIOC_S_HW_FREQ_SEEK, &t_freq_seek);
-	g_warn_if_fail(res == 0);
+	g_return_if_fail(cfm_tuner_backend_is_open(priv->backend));
+	cfm_radio_af_cancel(self);
+	cfm_radio_fine_tune_cancel(self);
+	cfm_tuner_backend_seek(priv->backend, upward);
+	priv->nominal = cfm_tuner_backend_get_frequency(priv->backend);
+	cfm_radio_rds_reset(self); /* Whatever is found is another station */
 }
 
 static void cfm_radio_mixer_set_enum_value(CFmRadio *self, const char * name, const char * value)
@@ -186,6 +324,7 @@ static void cfm_radio_mixer_set_bool_value(CFmRadio *self, const char * name, gb
 
 static void cfm_radio_mixer_enable(CFmRadio *self, gboolean enable)
 {
+	if (!self->priv->mixer) return; /* No sound card, e.g. a test tuner */
 	if (enable) {
 		cfm_radio_mixer_set_enum_value(self, "Input Select", "ADC");
 		cfm_radio_mixer_set_bool_value(self, "PGA Capture Switch", TRUE);
@@ -202,40 +341,18 @@ static void cfm_radio_mixer_enable(CFmRadio *self, gboolean enable)
 static void cfm_radio_init_tuner(CFmRadio *self, const gchar * device)
 {
 	CFmRadioPrivate *priv = self->priv;
-	struct v4l2_tuner tuner = { 0 };
-	int res;
 
-	priv->fd = open(device, O_RDONLY);
-	if (priv->fd == -1) {
-		perror("Open radio tuner");
-	}
+	g_return_if_fail(priv->backend);
 
-	tuner.index = 0;
-	res = ioctl(priv->fd, VIDIOC_G_TUNER, &tuner);
-	if (res < 0) {
-		perror("VIDIOC_G_TUNER");
+	if (!cfm_tuner_backend_open(priv->backend, device)) {
 		return;
 	}
 
-	if (tuner.type != V4L2_TUNER_RADIO) {
-		g_warning("Not a radio tuner\n");
-		return;
-	}
-
-	priv->precise_tuner = (tuner.capability & V4L2_TUNER_CAP_LOW) ?
-	                        TRUE : FALSE;
-
-	if (priv->precise_tuner) {
-		priv->range_low = tuner.rangelow * 62.5;
-		priv->range_high = tuner.rangehigh * 62.5;
-	} else {
-		priv->range_low = tuner.rangelow * 62500;
-		priv->range_high = tuner.rangehigh * 62500;
-	}
-
-	g_debug("Tuner detected (from %lu to %lu)\n", priv->range_low, priv->range_high);
+	priv->range_low = priv->backend->range_low;
+	priv->range_high = priv->backend->range_high;
 
 	cfm_radio_tuner_power(self, TRUE);
+	cfm_radio_rds_start(self);
 
 	g_debug("Tuner powered!\n");
 
@@ -255,7 +372,7 @@ static void cfm_radio_fmrx_request_cb(DBusGProxy *proxy, gint result, char * dev
 		g_error_free(error);
 	} else if (result != 0) {
 		g_warning("Ungranted acess to fmrx device (%d)\n", result);
-	} else if (priv->fd != -1) {
+	} else if (cfm_tuner_backend_is_open(priv->backend)) {
 		g_debug("Renewed access to device\n");
 	} else {
 		g_debug("Granted access to device: %s\n", device);
@@ -330,6 +447,12 @@ static void cfm_radio_si_request(pa_stream *p, size_t nbytes, void *userdata)
 	}
 	g_warn_if_fail(in);
 
+	if (priv->af_follow) {
+		/* Checking other frequencies; nothing worth hearing. */
+		pa_stream_drop(priv->si);
+		return;
+	}
+
 	res = pa_stream_write(priv->so, in, in_nbytes, NULL, 0, PA_SEEK_RELATIVE);
 	if (res != 0) {
 		g_warning("Failed to write to output stream: %s\n", pa_strerror(res));
@@ -366,6 +489,9 @@ static void cfm_radio_turn_on(CFmRadio *self)
 	}
 
 	cfm_radio_mixer_enable(self, TRUE);
+	cfm_radio_stereo_start(self);
+	cfm_radio_reception_start(self);
+	cfm_radio_af_start(self);
 
 	g_debug("Turned on\n");
 }
@@ -384,22 +510,62 @@ static void cfm_radio_turn_off(CFmRadio *self)
 		priv->si = NULL;
 	}
 	cfm_radio_mixer_enable(self, FALSE);
+	cfm_radio_stereo_stop(self);
+	cfm_radio_reception_stop(self);
+	cfm_radio_af_stop(self);
+	if (priv->fine_tune) {
+		/* Nobody is listening to where it ends up; go back to the station. */
+		cfm_radio_fine_tune_cancel(self);
+		if (cfm_tuner_backend_is_open(priv->backend)) {
+			cfm_tuner_backend_tune(priv->backend, priv->nominal);
+		}
+	}
 	g_debug("Turned off\n");
 }
 
 static void cfm_radio_init(CFmRadio *self)
 {
 	CFmRadioPrivate *priv;
-	GError *error = NULL;
 	int res;
 
 	self->priv = priv = CFM_RADIO_GET_PRIVATE(self);
-	priv->fd = -1;
+	priv->band = cfm_band_plan_get_default();
+	priv->auto_mono = TRUE;
+	priv->auto_fine_tune = TRUE;
+	priv->station_offsets = g_hash_table_new(g_direct_hash, g_direct_equal);
+	priv->auto_af = TRUE;
+	priv->af_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+	cfm_stereo_control_init(&priv->stereo_ctl, cfm_monotonic_ms());
+
+	priv->pa_loop = pa_glib_mainloop_new(NULL);
+	priv->pa_ctx = pa_context_new(pa_glib_mainloop_get_api(priv->pa_loop),
+		"FMRadio"); /* Note that the name is very important on Maemo. */
+	pa_context_set_state_callback(priv->pa_ctx, cfm_radio_ctx_state_change, self);
+	res = pa_context_connect(priv->pa_ctx, NULL, 0, NULL);
+	g_warn_if_fail(res == 0);
+
+	res = snd_hctl_open(&priv->mixer, MIXER_NAME, 0);
+	if (res < 0) {
+		g_warning("Failed to open ALSA mixer res=%d\n", res);
+		priv->mixer = NULL;
+		return;
+	}
+	res = snd_hctl_load(priv->mixer);
+	if (res < 0) {
+		g_warning("Failed to load ALSA hmixer elements res=%d\n", res);
+	}
+}
+
+static void cfm_radio_enabler_init(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	GError *error = NULL;
 
 	DBusGConnection *conn = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
 	if (!conn) {
 		g_warning("Failed to get system bus: %s\n", error->message);
 		g_error_free(error);
+		return;
 	}
 
 	priv->enabler = dbus_g_proxy_new_for_name_owner(conn, FMRX_SERVICE_NAME,
@@ -408,28 +574,46 @@ static void cfm_radio_init(CFmRadio *self)
 		g_warning("Failed to connect to fmrx enabler service: %s\n",
 			error->message);
 		g_error_free(error);
+		return;
 	}
 
 	cfm_radio_fmrx_request(self);
 
-	priv->pa_loop = pa_glib_mainloop_new(NULL);
-	priv->pa_ctx = pa_context_new(pa_glib_mainloop_get_api(priv->pa_loop),
-		"FMRadio"); /* Note that the name is very important on Maemo. */
-	pa_context_set_state_callback(priv->pa_ctx, cfm_radio_ctx_state_change, self);
-	res = pa_context_connect(priv->pa_ctx, NULL, 0, NULL);
-	g_warn_if_fail(res == 0);
-
 	priv->enabler_timer = g_timeout_add_seconds(FMRX_KEEPALIVE_INTERVAL,
 		cfm_radio_fmrx_keepalive, self);
+}
 
-	res = snd_hctl_open(&priv->mixer, MIXER_NAME, 0);
-	if (res < 0) {
-		g_warning("Failed to open ALSA mixer res=%d\n", res);
+static GObject * cfm_radio_constructor(GType gtype, guint n_properties,
+ GObjectConstructParam *properties)
+{
+	GObject *object = G_OBJECT_CLASS(cfm_radio_parent_class)->constructor(
+		gtype, n_properties, properties);
+	CFmRadio *self = CFM_RADIO(object);
+	CFmRadioPrivate *priv = self->priv;
+
+	priv->backend = cfm_tuner_backend_new(priv->backend_name);
+	if (priv->backend && priv->trace) {
+		priv->backend = cfm_tuner_trace_new(priv->backend, priv->trace);
 	}
-	res = snd_hctl_load(priv->mixer);
-	if (res < 0) {
-		g_warning("Failed to load ALSA hmixer elements res=%d\n", res);
+	if (priv->reception_log_file) {
+		priv->reception_log = cfm_reception_log_open(priv->reception_log_file,
+			RECEPTION_LOG_MAX_SIZE);
 	}
+	if (priv->station_db_file) {
+		priv->station_db = cfm_station_db_open(priv->station_db_file);
+	}
+
+	if (priv->device) {
+		/* Device given explicitly: no need to ask for access. */
+		cfm_radio_init_tuner(self, priv->device);
+	} else if (priv->backend_name && strcmp(priv->backend_name, "v4l2") != 0) {
+		/* Not the N900 receiver the enabler hands out. */
+		cfm_radio_init_tuner(self, NULL);
+	} else {
+		cfm_radio_enabler_init(self);
+	}
+
+	return object;
 }
 
 static void cfm_radio_set_output(CFmRadio *self, CFmRadioOutput mode)
@@ -453,62 +637,777 @@ static CFmRadioOutput cfm_radio_get_output(CFmRadio *self)
 static void cfm_radio_set_frequency(CFmRadio *self, gulong freq)
 {
 	CFmRadioPrivate *priv = self->priv;
-	struct v4l2_frequency t_freq = { 0 };
-	g_return_if_fail(priv->fd != -1);
-	t_freq.tuner = 0;
-	t_freq.type = V4L2_TUNER_RADIO;
-	t_freq.frequency = priv->precise_tuner ? freq / 62.5 : freq / 62500;
-	int res = ioctl(priv->fd, VIDIOC_S_FREQUENCY, &t_freq);
-	g_warn_if_fail(res == 0);
+	g_return_if_fail(cfm_tuner_backend_is_open(priv->backend));
+	cfm_radio_af_cancel(self);
+	cfm_radio_fine_tune_cancel(self);
+	cfm_tuner_backend_tune(priv->backend, freq);
+	cfm_stereo_control_reset(&priv->stereo_ctl, cfm_monotonic_ms());
+	priv->nominal = freq;
+	cfm_radio_rds_reset(self);
+}
+
+static void cfm_radio_fine_tune_done(CFmFineTune *ft, gulong freq, gboolean found,
+	gpointer user_data)
+{
+	CFmRadio *self = CFM_RADIO(user_data);
+	CFmRadioPrivate *priv = self->priv;
+
+	priv->fine_tune = NULL;
+	priv->fine_offset = (glong) freq - (glong) priv->nominal;
+	if (!found) return; /* Nothing worth remembering */
+
+	g_hash_table_insert(priv->station_offsets, GUINT_TO_POINTER(priv->nominal),
+		GINT_TO_POINTER(priv->fine_offset));
+	cfm_stereo_control_reset(&priv->stereo_ctl, cfm_monotonic_ms());
+
+	g_object_notify(G_OBJECT(self), "fine-tune-offset");
+}
+
+/* Tunes to a channel chosen by the user, at the offset that worked best
+ * for it before, and then looks around for a better one. Only precise
+ * tuners can be tuned finely enough for this to matter, and there is no
+ * point in it while nobody is listening, e.g. during scans. */
+static void cfm_radio_tune_station(CFmRadio *self, gulong freq)
+{
+	CFmRadioPrivate *priv = self->priv;
+	gpointer offset = NULL;
+	gboolean learned;
+
+	g_return_if_fail(cfm_tuner_backend_is_open(priv->backend));
+	cfm_radio_set_frequency(self, freq);
+	if (!priv->auto_fine_tune || !priv->backend->precise) return;
+
+	learned = g_hash_table_lookup_extended(priv->station_offsets,
+		GUINT_TO_POINTER(freq), NULL, &offset);
+	if (learned && GPOINTER_TO_INT(offset) != 0) {
+		cfm_tuner_backend_tune(priv->backend, freq + GPOINTER_TO_INT(offset));
+		priv->fine_offset = GPOINTER_TO_INT(offset);
+	}
+
+	if (priv->output != CFM_RADIO_OUTPUT_MUTE) {
+		priv->fine_tune = cfm_fine_tune_start(priv->backend, freq,
+			GPOINTER_TO_INT(offset), learned, cfm_radio_fine_tune_done, self);
+	}
+}
+
+static void cfm_radio_apply_audmode(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	const CFmStereoControl *c = &priv->stereo_ctl;
+	GTimeVal tv;
+	gchar stamp[32];
+	time_t t;
+
+	if (!cfm_tuner_backend_is_open(priv->backend)) return;
+	cfm_tuner_backend_set_audmode(priv->backend, c->stereo);
+
+	g_get_current_time(&tv);
+	t = tv.tv_sec;
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+	g_debug("%s.%03ld Switched to %s (signal %.0f%%, pilot %.0f%%)\n",
+		stamp, tv.tv_usec / 1000, c->stereo ? "stereo" : "mono",
+		c->rssi * 100.0, c->pilot * 100.0);
+
+	g_object_notify(G_OBJECT(self), "stereo");
+}
+
+/* Falls back to mono on weak stations, where stereo decoding only adds
+ * noise, and goes back to stereo once the signal recovers. */
+static gboolean cfm_radio_stereo_poll(gpointer data)
+{
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	CFmTunerStatus status;
+
+	if (priv->sweep_idle || priv->fine_tune || priv->af_follow ||
+	    !cfm_tuner_backend_is_open(priv->backend)) {
+		return TRUE; /* The sweep is retuning all the time. */
+	}
+	if (!cfm_tuner_backend_get_status(priv->backend, &status)) {
+		return TRUE;
+	}
+
+	if (cfm_stereo_control_feed(&priv->stereo_ctl, status.signal,
+	                            status.stereo, cfm_monotonic_ms())) {
+		cfm_radio_apply_audmode(self);
+	}
+
+	return TRUE;
+}
+
+static void cfm_radio_stereo_start(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (priv->stereo_timer || !priv->auto_mono) return;
+	cfm_stereo_control_reset(&priv->stereo_ctl, cfm_monotonic_ms());
+	priv->stereo_timer = g_timeout_add(STEREO_POLL_MS, cfm_radio_stereo_poll, self);
+}
+
+static void cfm_radio_stereo_stop(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (!priv->stereo_timer) return;
+	g_source_remove(priv->stereo_timer);
+	priv->stereo_timer = 0;
+}
+
+static void cfm_radio_set_auto_mono(CFmRadio *self, gboolean enable)
+{
+	CFmRadioPrivate *priv = self->priv;
+	priv->auto_mono = enable;
+	if (enable) {
+		if (priv->so) cfm_radio_stereo_start(self);
+	} else {
+		cfm_radio_stereo_stop(self);
+		if (!priv->stereo_ctl.stereo) {
+			priv->stereo_ctl.stereo = TRUE;
+			cfm_radio_apply_audmode(self);
+		}
+	}
 }
 
 static gulong cfm_radio_get_frequency(CFmRadio *self)
 {
 	CFmRadioPrivate *priv = self->priv;
-	struct v4l2_frequency t_freq = { 0 };
-	g_return_val_if_fail(priv->fd != -1, 0);
-	t_freq.tuner = 0;
-	int res = ioctl(priv->fd, VIDIOC_G_FREQUENCY, &t_freq);
-	g_return_val_if_fail(res == 0, 0);
-	return priv->precise_tuner ? t_freq.frequency * 62.5 : t_freq.frequency * 62500;
+	g_return_val_if_fail(cfm_tuner_backend_is_open(priv->backend), 0);
+	if (priv->fine_tune || priv->fine_offset || priv->af_follow) {
+		return priv->nominal; /* Not wherever fine tuning or AF checks are at */
+	}
+	return cfm_tuner_backend_get_frequency(priv->backend);
+}
+
+/* Appends what is being received right now to the reception log. */
+static gboolean cfm_radio_reception_tick(gpointer data)
+{
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	CFmReceptionRecord rec;
+	CFmTunerStatus status;
+
+	if (priv->sweep_idle || priv->fine_tune || priv->af_follow ||
+	    !cfm_tuner_backend_is_open(priv->backend)) {
+		return TRUE;
+	}
+	if (!cfm_tuner_backend_get_status(priv->backend, &status)) {
+		return TRUE;
+	}
+
+	rec.time = time(NULL);
+	rec.freq = cfm_radio_get_frequency(self);
+	rec.signal = MIN(status.signal, G_MAXUINT16);
+	rec.pi = priv->rds_pi_code;
+	rec.stereo = status.stereo;
+	cfm_reception_log_append(priv->reception_log, &rec);
+
+	return TRUE;
+}
+
+static void cfm_radio_reception_start(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (priv->reception_timer || !priv->reception_log) return;
+	priv->reception_timer = g_timeout_add_seconds(RECEPTION_LOG_INTERVAL,
+		cfm_radio_reception_tick, self);
+}
+
+static void cfm_radio_reception_stop(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (!priv->reception_timer) return;
+	g_source_remove(priv->reception_timer);
+	priv->reception_timer = 0;
+	cfm_reception_log_flush(priv->reception_log);
+}
+
+static void cfm_radio_af_done(CFmAfFollow *af, gulong freq, gboolean switched,
+	gpointer user_data)
+{
+	CFmRadio *self = CFM_RADIO(user_data);
+	CFmRadioPrivate *priv = self->priv;
+	const gint64 now = cfm_monotonic_ms();
+
+	priv->af_follow = NULL;
+	priv->af_low_since = 0;
+	if (!switched) {
+		priv->af_retry_at = now + AF_RETRY_MS;
+		return;
+	}
+
+	/* Same station, so RDS carries on; only the frequency changed. */
+	priv->nominal = freq;
+	priv->fine_offset = 0;
+	cfm_stereo_control_reset(&priv->stereo_ctl, now);
+	g_object_notify(G_OBJECT(self), "frequency");
+	cfm_radio_station_name_update(self);
+}
+
+/* Once the signal has been weak for a while, checks whether the station
+ * can be received better on one of its alternative frequencies. Needs the
+ * AF list, so only works with tuners that hand out raw RDS blocks. */
+static gboolean cfm_radio_af_poll(gpointer data)
+{
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	const CFmRdsDecoder *d = &priv->rds_decoder;
+	CFmTunerStatus status;
+	gint64 now;
+
+	if (!priv->auto_af || priv->sweep_idle || priv->fine_tune || priv->af_follow ||
+	    !cfm_tuner_backend_is_open(priv->backend)) {
+		priv->af_low_since = 0;
+		return TRUE;
+	}
+	if (!cfm_tuner_backend_get_status(priv->backend, &status)) {
+		return TRUE;
+	}
+
+	now = cfm_monotonic_ms();
+	if (status.signal >= AF_THRESHOLD) {
+		priv->af_low_since = 0;
+		return TRUE;
+	}
+	if (!priv->af_low_since) {
+		priv->af_low_since = now;
+	}
+	if (now - priv->af_low_since < AF_LOW_MS || now < priv->af_retry_at ||
+	    !d->pi || !d->n_af) {
+		return TRUE;
+	}
+
+	priv->af_follow = cfm_af_follow_start(priv->backend, priv->af_cache, d->pi,
+		cfm_tuner_backend_get_frequency(priv->backend), MIN(status.signal, G_MAXUINT16),
+		d->af, d->n_af, cfm_radio_af_done, self);
+	if (!priv->af_follow) {
+		priv->af_retry_at = now + AF_RETRY_MS;
+	}
+
+	return TRUE;
+}
+
+static void cfm_radio_af_start(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (priv->af_timer) return;
+	priv->af_low_since = 0;
+	priv->af_timer = g_timeout_add(AF_POLL_MS, cfm_radio_af_poll, self);
+}
+
+static void cfm_radio_af_stop(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	cfm_radio_af_cancel(self);
+	if (!priv->af_timer) return;
+	g_source_remove(priv->af_timer);
+	priv->af_timer = 0;
+}
+
+static gboolean cfm_radio_get_status(CFmRadio *self, guint *signal, gboolean *stereo)
+{
+	CFmRadioPrivate *priv = self->priv;
+	CFmTunerStatus status;
+	g_return_val_if_fail(cfm_tuner_backend_is_open(priv->backend), FALSE);
+	if (!cfm_tuner_backend_get_status(priv->backend, &status)) {
+		return FALSE;
+	}
+	*signal = status.signal;
+	*stereo = status.stereo;
+	return TRUE;
 }
 
 static guint cfm_radio_get_signal(CFmRadio *self)
+{
+	guint signal;
+	gboolean stereo;
+	if (!cfm_radio_get_status(self, &signal, &stereo)) {
+		return 0;
+	}
+	return signal;
+}
+
+static void cfm_radio_sweep_stop(CFmRadio *self, gboolean completed)
 {
 	CFmRadioPrivate *priv = self->priv;
-	struct v4l2_tuner tuner = { 0 };
-	g_return_val_if_fail(priv->fd != -1, 0);
-	tuner.index = 0;
-	int res = ioctl(priv->fd, VIDIOC_G_TUNER, &tuner);
-	g_return_val_if_fail(res == 0, 0);
-	return tuner.signal;
+
+	if (priv->sweep_idle) {
+		g_source_remove(priv->sweep_idle);
+		priv->sweep_idle = 0;
+	}
+
+	cfm_radio_tune_station(self, priv->sweep_prev_freq);
+
+	g_signal_emit(G_OBJECT(self), signals[SIGNAL_SWEEP_FINISHED], 0, completed);
 }
 
-static gchar* cfm_radio_get_sysfs_key(CFmRadio *self, const gchar *key)
+static gboolean cfm_radio_sweep_step(gpointer data)
 {
-	GError *error = NULL;
-	gchar *file = g_strdup_printf("%s/%s", SYSFS_NODE_PATH, key);
-	gchar *r = NULL;
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	CFmSpectrumPoint *p = &priv->sweep[priv->sweep_pos];
+	guint signal;
+	gboolean stereo;
+
+	cfm_radio_set_frequency(self, p->freq);
+	if (cfm_radio_get_status(self, &signal, &stereo)) {
+		p->signal = MIN(signal, G_MAXUINT16);
+		p->stereo = stereo;
+	}
+
+	g_signal_emit(G_OBJECT(self), signals[SIGNAL_SWEEP_PROGRESS], 0,
+		priv->sweep_pos);
 
-	if (!g_file_get_contents(file, &r, NULL, &error)) {
-		g_warning("Unable to read sysfs key %s: %s\n", key, error->message);
+	priv->sweep_pos++;
+	if (priv->sweep_pos >= priv->sweep_len) {
+		priv->sweep_idle = 0;
+		cfm_radio_sweep_stop(self, TRUE);
+		return FALSE;
 	}
 
-	g_free(file);
+	return TRUE;
+}
 
-	return r;
+static void cfm_radio_monitor_cb(CFmMonitor *monitor, guint index, gpointer user_data)
+{
+	CFmRadio *self = CFM_RADIO(user_data);
+	g_signal_emit(G_OBJECT(self), signals[SIGNAL_MONITOR_PROGRESS], 0, index);
 }
 
-static gchar* cfm_radio_get_rds(CFmRadio *self, const gchar *key)
+/* Looks the station up in the database, by PI once one has been received
+ * and until then by frequency, to have a name before the PS arrives. */
+static void cfm_radio_station_name_update(CFmRadio *self)
 {
-	gchar *v = cfm_radio_get_sysfs_key(self, key);
-	if (v) {
-		gchar * r = rds_decode(v);
-		g_free(v);
-		return r;
+	CFmRadioPrivate *priv = self->priv;
+	const gulong freq = priv->nominal;
+	const gchar *name = NULL;
+
+	if (!priv->station_db) return;
+
+	if (priv->rds_pi_code) {
+		name = cfm_station_db_lookup_pi(priv->station_db, priv->rds_pi_code, freq);
+	}
+	if (!name) {
+		name = cfm_station_db_lookup_freq(priv->station_db, freq);
+	}
+
+	if (name != priv->station_db_name) {
+		priv->station_db_name = name;
+		if (!priv->rds_text[RDS_PS][0]) {
+			g_object_notify(G_OBJECT(self), "station-name");
+		}
+	}
+}
+
+/* Only decodes a new raw RDS value and emits "notify" if it changed. */
+static gboolean cfm_radio_rds_update(CFmRadio *self, CFmRadioRdsKey k,
+	RdsCharset charset, const gchar *buf, gsize n)
+{
+	CFmRadioPrivate *priv = self->priv;
+
+	n = MIN(n, RDS_BUF_LEN);
+	if (n == priv->rds_raw_len[k] && charset == priv->rds_charset[k] &&
+	    memcmp(buf, priv->rds_raw[k], n) == 0) {
+		return FALSE;
+	}
+
+	memcpy(priv->rds_raw[k], buf, n);
+	priv->rds_raw[k][n] = '\0';
+	priv->rds_raw_len[k] = n;
+	priv->rds_charset[k] = charset;
+	rds_decode_charset_to(charset, priv->rds_raw[k], n,
+		priv->rds_text[k], sizeof(priv->rds_text[k]));
+	if (k == RDS_PI) {
+		priv->rds_pi_code = strtoul(priv->rds_raw[k], NULL, 16);
+	}
+
+	g_object_notify(G_OBJECT(self), rds_props[k]);
+	if (k == RDS_PS) {
+		g_object_notify(G_OBJECT(self), "station-name");
+	} else if (k == RDS_PI) {
+		cfm_radio_station_name_update(self);
+	}
+
+	return TRUE;
+}
+
+/* Rereads one RDS attribute into a fixed buffer. The driver hands out
+ * whatever it has received so far, errors included, so only text that has
+ * been read back the same way more than once is passed on. Rereading the
+ * same buffer proves nothing, so a read only counts if the driver said it
+ * changed ("fresh") or a whole PS cycle went by since the last one. */
+static gboolean cfm_radio_rds_refresh(CFmRadio *self, CFmRadioRdsKey k, gboolean fresh)
+{
+	CFmRadioPrivate *priv = self->priv;
+	CFmRdsText *t = &priv->rds_votes[k];
+	const gint64 now = cfm_monotonic_ms();
+	gchar buf[RDS_BUF_LEN];
+	gssize n;
+
+	if (!fresh && now - priv->rds_voted_at[k] < RDS_VOTE_SPACING_MS) {
+		return FALSE;
+	}
+	priv->rds_voted_at[k] = now;
+
+	n = cfm_tuner_backend_read_rds_into(priv->backend, rds_keys[k], buf, sizeof(buf));
+	if (n <= 0 || !cfm_rds_text_vote_string(t, buf, n)) {
+		return FALSE;
+	}
+	return cfm_radio_rds_update(self, k, RDS_CHARSET_BASIC, t->text, t->text_len);
+}
+
+static gboolean cfm_radio_rds_pending(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	guint k;
+	for (k = 0; k < RDS_N_KEYS; k++) {
+		if (cfm_rds_text_pending(&priv->rds_votes[k])) return TRUE;
+	}
+	return FALSE;
+}
+
+static void cfm_radio_rds_poll_soon(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+
+	if (priv->rds_timer && priv->rds_interval != RDS_POLL_MIN_MS) {
+		g_source_remove(priv->rds_timer);
+		priv->rds_interval = RDS_POLL_MIN_MS;
+		priv->rds_timer = g_timeout_add(priv->rds_interval, cfm_radio_rds_poll, self);
+	}
+}
+
+/* The decoder only reports RT+ tags when they changed; converting them
+ * happens then, and "notify" only for the one that is different. */
+static void cfm_radio_rds_tag_update(CFmRadio *self, gchar *text, const gchar *raw,
+	const gchar *prop)
+{
+	gchar buf[RDS_TAG_LEN];
+
+	rds_decode_to(raw, buf, sizeof(buf));
+	if (strcmp(buf, text) == 0) return;
+
+	strcpy(text, buf);
+	g_object_notify(G_OBJECT(self), prop);
+}
+
+/* Clock time is sent at the start of every minute. One that agrees with
+ * the previous one and the time elapsed since is believed, and tells how
+ * far off the system clock is; that stays known after tuning elsewhere. */
+static void cfm_radio_rds_clock(CFmRadio *self, const CFmRdsDecoder *d)
+{
+	CFmRadioPrivate *priv = self->priv;
+	const gint64 now = cfm_monotonic_ms();
+	const gint64 t = rds_ct_to_unix(d->ct_mjd, d->ct_hour, d->ct_minute);
+	gboolean consistent;
+	GTimeVal tv;
+
+	consistent = priv->rds_ct_prev &&
+		ABS((t - priv->rds_ct_prev) * 1000 - (now - priv->rds_ct_prev_at)) < RDS_CT_TOLERANCE_MS;
+	priv->rds_ct_prev = t;
+	priv->rds_ct_prev_at = now;
+	if (!consistent) return;
+
+	g_get_current_time(&tv);
+	priv->clock_offset_ms = t * 1000 - ((gint64) tv.tv_sec * 1000 + tv.tv_usec / 1000);
+	priv->has_clock_offset = TRUE;
+	priv->rds_local_offset = d->ct_offset * 30;
+	if (t != priv->rds_time) {
+		priv->rds_time = t;
+		g_object_notify(G_OBJECT(self), "rds-time");
+	}
+}
+
+/* Passes the PI codes on to the AF check, which is tuned elsewhere. */
+static void cfm_radio_af_feed_blocks(CFmRadio *self, const guint8 *buf, gsize n)
+{
+	CFmRadioPrivate *priv = self->priv;
+	gsize i;
+
+	for (i = 0; i + CFM_RDS_BLOCK_SIZE <= n; i += CFM_RDS_BLOCK_SIZE) {
+		const guint8 flags = buf[i + 2];
+		if ((flags & CFM_RDS_BLOCK_MSK) == CFM_RDS_BLOCK_A &&
+		    !(flags & CFM_RDS_BLOCK_ERROR)) {
+			cfm_af_follow_feed_pi(priv->af_follow, buf[i] | (buf[i + 1] << 8));
+		}
+	}
+}
+
+static gboolean cfm_radio_rds_blocks_poll(gpointer data);
+
+/* Standard V4L2 receivers: decode the raw blocks as they arrive. Drivers
+ * that always poll readable (vivid) get read from a timer instead. */
+static gboolean cfm_radio_rds_blocks_event(GIOChannel *source, GIOCondition condition,
+	gpointer data)
+{
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	CFmRdsDecoder *d = &priv->rds_decoder;
+	guint8 buf[CFM_RDS_BLOCK_SIZE * 32];
+	guint changed = 0;
+	gboolean empty = TRUE;
+	gssize n;
+
+	while ((n = cfm_tuner_backend_read_rds_blocks(priv->backend, buf, sizeof(buf))) > 0) {
+		empty = FALSE;
+		if (priv->af_follow) {
+			cfm_radio_af_feed_blocks(self, buf, n);
+			continue; /* Not from the station being listened to */
+		}
+		changed |= cfm_rds_decoder_feed(d, buf, n);
+	}
+	if (n < 0) {
+		priv->rds_blocks_watch = 0;
+		return FALSE;
+	}
+	if (source) {
+		priv->rds_blocks_empty = empty ? priv->rds_blocks_empty + 1 : 0;
+		if (priv->rds_blocks_empty >= RDS_BLOCKS_SPURIOUS) {
+			g_debug("RDS blocks always look readable, polling them\n");
+			priv->rds_blocks_watch = g_timeout_add(RDS_BLOCKS_POLL_MS,
+				cfm_radio_rds_blocks_poll, self);
+			return FALSE;
+		}
+	}
+	if (priv->sweep_idle) {
+		return TRUE; /* Whatever comes in is from some other channel */
+	}
+
+	if (changed & CFM_RDS_CHANGED_PI) {
+		gchar pi[8];
+		g_snprintf(pi, sizeof(pi), "%04X", d->pi);
+		cfm_radio_rds_update(self, RDS_PI, RDS_CHARSET_BASIC, d->pi ? pi : "", d->pi ? 4 : 0);
+	}
+	if ((changed & CFM_RDS_CHANGED_PTY) && d->pty != priv->rds_pty) {
+		priv->rds_pty = d->pty;
+		g_object_notify(G_OBJECT(self), "rds-pty");
+	}
+	if (changed & CFM_RDS_CHANGED_PS) {
+		cfm_radio_rds_update(self, RDS_PS, RDS_CHARSET_BASIC, d->ps.text, d->ps.text_len);
+	}
+	if (changed & (CFM_RDS_CHANGED_RT | CFM_RDS_CHANGED_ERT)) {
+		/* Enhanced RadioText, where sent, is the same text in more
+		 * characters than the basic set has; but once RT changes twice
+		 * without it following, it is left over from something else. */
+		if (changed & CFM_RDS_CHANGED_RT) {
+			if (!priv->rds_ert_fresh && !(changed & CFM_RDS_CHANGED_ERT)) {
+				priv->rds_show_ert = FALSE;
+			}
+			priv->rds_ert_fresh = FALSE;
+		}
+		if (changed & CFM_RDS_CHANGED_ERT) {
+			priv->rds_ert_fresh = TRUE;
+			priv->rds_show_ert = d->ert.text_len > 0;
+		}
+		if (priv->rds_show_ert) {
+			cfm_radio_rds_update(self, RDS_RT,
+				d->ert_utf8 ? RDS_CHARSET_UTF8 : RDS_CHARSET_UCS2,
+				d->ert.text, d->ert.text_len);
+		} else {
+			cfm_radio_rds_update(self, RDS_RT, RDS_CHARSET_BASIC,
+				d->rt.text, d->rt.text_len);
+		}
+	}
+	if (changed & CFM_RDS_CHANGED_RTPLUS) {
+		cfm_radio_rds_tag_update(self, priv->rds_artist, d->artist, "rds-artist");
+		cfm_radio_rds_tag_update(self, priv->rds_title, d->title, "rds-title");
+	}
+	if (changed & CFM_RDS_CHANGED_CT) {
+		cfm_radio_rds_clock(self, d);
+	}
+
+	return TRUE;
+}
+
+static gboolean cfm_radio_rds_blocks_poll(gpointer data)
+{
+	return cfm_radio_rds_blocks_event(NULL, G_IO_IN, data);
+}
+
+static gboolean cfm_radio_rds_refresh_all(CFmRadio *self)
+{
+	gboolean changed = FALSE;
+	guint k;
+	for (k = 0; k < RDS_N_KEYS; k++) {
+		changed |= cfm_radio_rds_refresh(self, k, FALSE);
+	}
+	return changed;
+}
+
+/* Polls quickly right after tuning, when PS and RT are arriving, and backs
+ * off while nothing changes. Drivers that notify changes themselves only
+ * get the slowest rate, as a safety net, except while some text is still
+ * waiting to be confirmed by a second read. */
+static gboolean cfm_radio_rds_poll(gpointer data)
+{
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	guint interval;
+
+	if (priv->sweep_idle || priv->af_follow || !cfm_tuner_backend_is_open(priv->backend)) {
+		return TRUE;
+	}
+
+	if (cfm_radio_rds_refresh_all(self) && !priv->rds_notified) {
+		interval = RDS_POLL_MIN_MS;
 	} else {
-		return NULL;
+		interval = MIN(priv->rds_interval * 2, RDS_POLL_MAX_MS);
+	}
+	if (priv->rds_notified) {
+		interval = RDS_POLL_MAX_MS;
+	}
+	if (cfm_radio_rds_pending(self)) {
+		interval = RDS_POLL_MIN_MS;
+	}
+
+	if (interval == priv->rds_interval) {
+		return TRUE;
+	}
+	priv->rds_interval = interval;
+	priv->rds_timer = g_timeout_add(interval, cfm_radio_rds_poll, self);
+	return FALSE;
+}
+
+static gboolean cfm_radio_rds_event(GIOChannel *source, GIOCondition condition,
+	gpointer data)
+{
+	CFmRadio *self = CFM_RADIO(data);
+	CFmRadioPrivate *priv = self->priv;
+	const int fd = g_io_channel_unix_get_fd(source);
+	guint k;
+
+	if (!priv->rds_notified) {
+		g_debug("RDS driver notifies changes, polling less\n");
+		priv->rds_notified = TRUE;
+	}
+	if (priv->af_follow) {
+		return TRUE; /* Not from the station being listened to */
+	}
+	for (k = 0; k < RDS_N_KEYS; k++) {
+		if (cfm_tuner_backend_get_rds_fd(priv->backend, rds_keys[k]) == fd) {
+			cfm_radio_rds_refresh(self, k, TRUE);
+		}
+	}
+	if (cfm_radio_rds_pending(self)) {
+		cfm_radio_rds_poll_soon(self);
+	}
+
+	return TRUE;
+}
+
+static void cfm_radio_rds_start(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	int fd;
+	guint k;
+
+	fd = cfm_tuner_backend_get_rds_fd(priv->backend, CFM_TUNER_RDS_BLOCKS);
+	if (fd != -1) {
+		if (!priv->rds_blocks_watch) {
+			GIOChannel *channel = g_io_channel_unix_new(fd);
+			cfm_rds_decoder_init(&priv->rds_decoder);
+			priv->rds_blocks_empty = 0;
+			priv->rds_blocks_watch = g_io_add_watch(channel, G_IO_IN,
+				cfm_radio_rds_blocks_event, self);
+			g_io_channel_unref(channel);
+		}
+		return; /* Nothing to poll */
+	}
+
+	for (k = 0; k < RDS_N_KEYS; k++) {
+		fd = cfm_tuner_backend_get_rds_fd(priv->backend, rds_keys[k]);
+		if (fd != -1 && !priv->rds_watch[k]) {
+			GIOChannel *channel = g_io_channel_unix_new(fd);
+			priv->rds_watch[k] = g_io_add_watch(channel, G_IO_PRI | G_IO_ERR,
+				cfm_radio_rds_event, self);
+			g_io_channel_unref(channel);
+		}
+	}
+
+	cfm_radio_rds_refresh_all(self);
+
+	if (!priv->rds_timer) {
+		priv->rds_interval = RDS_POLL_MIN_MS;
+		priv->rds_timer = g_timeout_add(priv->rds_interval, cfm_radio_rds_poll, self);
+	}
+}
+
+static void cfm_radio_rds_stop(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	guint k;
+
+	for (k = 0; k < RDS_N_KEYS; k++) {
+		if (priv->rds_watch[k]) {
+			g_source_remove(priv->rds_watch[k]);
+			priv->rds_watch[k] = 0;
+		}
+	}
+	if (priv->rds_blocks_watch) {
+		g_source_remove(priv->rds_blocks_watch);
+		priv->rds_blocks_watch = 0;
+	}
+	if (priv->rds_timer) {
+		g_source_remove(priv->rds_timer);
+		priv->rds_timer = 0;
+	}
+}
+
+/* Forgets the previous station's RDS and goes back to polling quickly. */
+static void cfm_radio_rds_reset(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	gboolean had_name;
+	guint k;
+
+	had_name = cfm_radio_get_station_name(self)[0] != '\0';
+	priv->rds_pi_code = 0;
+	cfm_rds_decoder_reset(&priv->rds_decoder);
+	if (priv->rds_pty) {
+		priv->rds_pty = 0;
+		g_object_notify(G_OBJECT(self), "rds-pty");
+	}
+	priv->rds_ct_prev = 0;
+	priv->rds_show_ert = FALSE;
+	priv->rds_ert_fresh = FALSE;
+	if (priv->rds_time) {
+		priv->rds_time = 0;
+		g_object_notify(G_OBJECT(self), "rds-time");
+	}
+	cfm_radio_rds_tag_update(self, priv->rds_artist, "", "rds-artist");
+	cfm_radio_rds_tag_update(self, priv->rds_title, "", "rds-title");
+	for (k = 0; k < RDS_N_KEYS; k++) {
+		cfm_rds_text_init(&priv->rds_votes[k], 0);
+		priv->rds_voted_at[k] = 0;
+		priv->rds_raw[k][0] = '\0';
+		priv->rds_raw_len[k] = 0;
+		priv->rds_charset[k] = RDS_CHARSET_BASIC;
+		if (priv->rds_text[k][0]) {
+			priv->rds_text[k][0] = '\0';
+			g_object_notify(G_OBJECT(self), rds_props[k]);
+		}
 	}
+	if (had_name) {
+		priv->station_db_name = NULL;
+		g_object_notify(G_OBJECT(self), "station-name");
+	}
+	cfm_radio_station_name_update(self);
+
+	if (!priv->rds_notified) {
+		cfm_radio_rds_poll_soon(self);
+	}
+}
+
+static const gchar* cfm_radio_get_rds(CFmRadio *self, CFmRadioRdsKey k)
+{
+	CFmRadioPrivate *priv = self->priv;
+	return priv->rds_text[k];
+}
+
+static const gchar* cfm_radio_get_station_name(CFmRadio *self)
+{
+	CFmRadioPrivate *priv = self->priv;
+	if (priv->rds_text[RDS_PS][0] || !priv->station_db_name) {
+		return priv->rds_text[RDS_PS];
+	}
+	return priv->station_db_name;
 }
 
 static void cfm_radio_set_property(GObject *object, guint property_id,
@@ -520,7 +1419,48 @@ static void cfm_radio_set_property(GObject *object, guint property_id,
 		cfm_radio_set_output(self, g_value_get_enum(value));
 		break;
 	case PROP_FREQUENCY:
-		cfm_radio_set_frequency(self, g_value_get_ulong(value));
+		cfm_radio_tune_station(self, g_value_get_ulong(value));
+		break;
+	case PROP_BACKEND:
+		g_free(self->priv->backend_name);
+		self->priv->backend_name = g_value_dup_string(value);
+		break;
+	case PROP_DEVICE:
+		g_free(self->priv->device);
+		self->priv->device = g_value_dup_string(value);
+		break;
+	case PROP_TRACE:
+		g_free(self->priv->trace);
+		self->priv->trace = g_value_dup_string(value);
+		break;
+	case PROP_BAND: {
+		const CFmBandPlan *band = cfm_band_plan_get(g_value_get_string(value));
+		if (band) {
+			self->priv->band = band;
+		} else {
+			g_warning("Unknown band plan '%s'\n", g_value_get_string(value));
+		}
+		break;
+	}
+	case PROP_AUTO_MONO:
+		cfm_radio_set_auto_mono(self, g_value_get_boolean(value));
+		break;
+	case PROP_RECEPTION_LOG:
+		g_free(self->priv->reception_log_file);
+		self->priv->reception_log_file = g_value_dup_string(value);
+		break;
+	case PROP_STATION_DB:
+		g_free(self->priv->station_db_file);
+		self->priv->station_db_file = g_value_dup_string(value);
+		break;
+	case PROP_AUTO_FINE_TUNE:
+		self->priv->auto_fine_tune = g_value_get_boolean(value);
+		break;
+	case PROP_AUTO_AF:
+		self->priv->auto_af = g_value_get_boolean(value);
+		if (!self->priv->auto_af) {
+			cfm_radio_af_cancel(self);
+		}
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -549,13 +1489,61 @@ static void cfm_radio_get_property(GObject *object, guint property_id,
 		g_value_set_uint(value, cfm_radio_get_signal(self));
 		break;
 	case PROP_RDS_PI:
-		g_value_take_string(value, cfm_radio_get_rds(self, "rds_pi"));
+		g_value_set_string(value, cfm_radio_get_rds(self, RDS_PI));
 		break;
 	case PROP_RDS_PS:
-		g_value_take_string(value, cfm_radio_get_rds(self, "rds_ps"));
+		g_value_set_string(value, cfm_radio_get_rds(self, RDS_PS));
 		break;
 	case PROP_RDS_RT:
-		g_value_take_string(value, cfm_radio_get_rds(self, "rds_rt"));
+		g_value_set_string(value, cfm_radio_get_rds(self, RDS_RT));
+		break;
+	case PROP_RDS_ARTIST:
+		g_value_set_string(value, self->priv->rds_artist);
+		break;
+	case PROP_RDS_TITLE:
+		g_value_set_string(value, self->priv->rds_title);
+		break;
+	case PROP_RDS_PTY:
+		g_value_set_uint(value, self->priv->rds_pty);
+		break;
+	case PROP_BACKEND:
+		g_value_set_string(value, self->priv->backend_name);
+		break;
+	case PROP_DEVICE:
+		g_value_set_string(value, self->priv->device);
+		break;
+	case PROP_TRACE:
+		g_value_set_string(value, self->priv->trace);
+		break;
+	case PROP_BAND:
+		g_value_set_string(value, self->priv->band->id);
+		break;
+	case PROP_AUTO_MONO:
+		g_value_set_boolean(value, self->priv->auto_mono);
+		break;
+	case PROP_STEREO:
+		g_value_set_boolean(value, self->priv->stereo_ctl.stereo);
+		break;
+	case PROP_RECEPTION_LOG:
+		g_value_set_string(value, self->priv->reception_log_file);
+		break;
+	case PROP_STATION_DB:
+		g_value_set_string(value, self->priv->station_db_file);
+		break;
+	case PROP_STATION_NAME:
+		g_value_set_string(value, cfm_radio_get_station_name(self));
+		break;
+	case PROP_AUTO_FINE_TUNE:
+		g_value_set_boolean(value, self->priv->auto_fine_tune);
+		break;
+	case PROP_FINE_TUNE_OFFSET:
+		g_value_set_long(value, self->priv->fine_offset);
+		break;
+	case PROP_AUTO_AF:
+		g_value_set_boolean(value, self->priv->auto_af);
+		break;
+	case PROP_RDS_TIME:
+		g_value_set_int64(value, self->priv->rds_time);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -571,8 +1559,23 @@ static void cfm_radio_dispose(GObject *object)
 		g_source_remove(priv->enabler_timer);
 		priv->enabler_timer = 0;
 	}
+	if (priv->sweep_idle) {
+		g_source_remove(priv->sweep_idle);
+		priv->sweep_idle = 0;
+	}
+	if (priv->monitor) {
+		cfm_monitor_free(priv->monitor);
+		priv->monitor = NULL;
+	}
+	cfm_radio_af_stop(self);
+	cfm_radio_fine_tune_cancel(self);
+	cfm_radio_rds_stop(self);
 	cfm_radio_tuner_power(self, FALSE);
 	cfm_radio_turn_off(self);
+	if (priv->reception_log) {
+		cfm_reception_log_close(priv->reception_log);
+		priv->reception_log = NULL;
+	}
 	if (priv->enabler) {
 		g_object_unref(priv->enabler);
 		priv->enabler = NULL;
@@ -596,10 +1599,19 @@ static void cfm_radio_finalize(GObject *object)
 		snd_hctl_close(priv->mixer);
 		priv->mixer = NULL;
 	}
-	if (priv->fd != -1) {
-		close(priv->fd);
-		priv->fd = -1;
+	g_free(priv->sweep);
+	cfm_tuner_backend_free(priv->backend);
+	priv->backend = NULL;
+	g_free(priv->backend_name);
+	g_free(priv->device);
+	g_free(priv->trace);
+	g_free(priv->reception_log_file);
+	if (priv->station_db) {
+		cfm_station_db_free(priv->station_db);
 	}
+	g_free(priv->station_db_file);
+	g_hash_table_destroy(priv->station_offsets);
+	g_hash_table_destroy(priv->af_cache);
 }
 
 static void cfm_radio_class_init(CFmRadioClass *klass)
@@ -607,6 +1619,7 @@ static void cfm_radio_class_init(CFmRadioClass *klass)
 	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 	GParamSpec *param_spec;
 
+	gobject_class->constructor = cfm_radio_constructor;
 	gobject_class->set_property = cfm_radio_set_property;
 	gobject_class->get_property = cfm_radio_get_property;
 	gobject_class->dispose = cfm_radio_dispose;
@@ -673,6 +1686,133 @@ static void cfm_radio_class_init(CFmRadioClass *klass)
 	                                 G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
 	properties[PROP_RDS_RT] = param_spec;
 	g_object_class_install_property(gobject_class, PROP_RDS_RT, param_spec);
+	param_spec = g_param_spec_string("rds-artist",
+	                                 "RDS artist",
+	                                 "Artist of the item playing, as tagged with RadioText Plus",
+	                                 "",
+	                                 G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_RDS_ARTIST] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_RDS_ARTIST, param_spec);
+	param_spec = g_param_spec_string("rds-title",
+	                                 "RDS title",
+	                                 "Title of the item playing, as tagged with RadioText Plus",
+	                                 "",
+	                                 G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_RDS_TITLE] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_RDS_TITLE, param_spec);
+	param_spec = g_param_spec_uint("rds-pty",
+	                               "RDS Programme Type",
+	                               "Current station's programme type, 0 if none or unknown",
+	                               0, 31, 0,
+	                               G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_RDS_PTY] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_RDS_PTY, param_spec);
+	param_spec = g_param_spec_string("backend",
+	                                 "Tuner backend",
+	                                 "Name of the tuner implementation to use (v4l2, sim)",
+	                                 "v4l2",
+	                                 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+	                                 G_PARAM_STATIC_STRINGS);
+	properties[PROP_BACKEND] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_BACKEND, param_spec);
+	param_spec = g_param_spec_string("device",
+	                                 "Tuner device",
+	                                 "Device to open directly instead of asking the FMRX enabler for one",
+	                                 NULL,
+	                                 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+	                                 G_PARAM_STATIC_STRINGS);
+	properties[PROP_DEVICE] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_DEVICE, param_spec);
+	param_spec = g_param_spec_string("trace",
+	                                 "Tuner trace file",
+	                                 "Record every tuner operation to this file, for the replay backend",
+	                                 NULL,
+	                                 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+	                                 G_PARAM_STATIC_STRINGS);
+	properties[PROP_TRACE] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_TRACE, param_spec);
+	param_spec = g_param_spec_string("band",
+	                                 "Band plan",
+	                                 "Channel grid used for sweeps and monitoring",
+	                                 CFM_BAND_PLAN_DEFAULT,
+	                                 G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_BAND] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_BAND, param_spec);
+	param_spec = g_param_spec_boolean("auto-mono",
+	                                  "Automatic mono",
+	                                  "Switch the tuner to mono while the signal is too weak for clean stereo",
+	                                  TRUE,
+	                                  G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_AUTO_MONO] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_AUTO_MONO, param_spec);
+	param_spec = g_param_spec_boolean("stereo",
+	                                  "Stereo decoding",
+	                                  "Whether the tuner is currently decoding stereo",
+	                                  TRUE,
+	                                  G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_STEREO] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_STEREO, param_spec);
+	param_spec = g_param_spec_string("reception-log",
+	                                 "Reception log file",
+	                                 "Periodically log signal, stereo and PI of the tuned station to this file",
+	                                 NULL,
+	                                 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+	                                 G_PARAM_STATIC_STRINGS);
+	properties[PROP_RECEPTION_LOG] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_RECEPTION_LOG, param_spec);
+	param_spec = g_param_spec_boolean("auto-fine-tune",
+	                                  "Automatic fine tuning",
+	                                  "Look for the best reception around every channel tuned to, on precise tuners",
+	                                  TRUE,
+	                                  G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_AUTO_FINE_TUNE] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_AUTO_FINE_TUNE, param_spec);
+	param_spec = g_param_spec_long("fine-tune-offset",
+	                               "Fine tuning offset (Hz)",
+	                               "How far from the current channel the tuner actually is, in Hz",
+	                               -ABS_RANGE_HIGH, ABS_RANGE_HIGH, 0,
+	                               G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_FINE_TUNE_OFFSET] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_FINE_TUNE_OFFSET, param_spec);
+	param_spec = g_param_spec_boolean("auto-af",
+	                                  "Alternative frequency following",
+	                                  "Move to a better frequency of the same station when the signal fades",
+	                                  TRUE,
+	                                  G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_AUTO_AF] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_AUTO_AF, param_spec);
+	param_spec = g_param_spec_int64("rds-time",
+	                                "RDS clock time",
+	                                "UTC time last sent by the current station, in seconds since the epoch, or 0",
+	                                0, G_MAXINT64, 0,
+	                                G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_RDS_TIME] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_RDS_TIME, param_spec);
+	param_spec = g_param_spec_string("station-db",
+	                                 "Station database file",
+	                                 "Names stations by PI or frequency before their PS is received, see data/make-station-db",
+	                                 NULL,
+	                                 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+	                                 G_PARAM_STATIC_STRINGS);
+	properties[PROP_STATION_DB] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_STATION_DB, param_spec);
+	param_spec = g_param_spec_string("station-name",
+	                                 "Station name",
+	                                 "Current station's PS, or its name from the station database until that is received",
+	                                 "",
+	                                 G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_STATION_NAME] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_STATION_NAME, param_spec);
+
+	signals[SIGNAL_SWEEP_PROGRESS] = g_signal_new("sweep-progress",
+		G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+		g_cclosure_marshal_VOID__UINT, G_TYPE_NONE, 1, G_TYPE_UINT);
+	signals[SIGNAL_SWEEP_FINISHED] = g_signal_new("sweep-finished",
+		G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+		g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+	signals[SIGNAL_MONITOR_PROGRESS] = g_signal_new("monitor-progress",
+		G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+		g_cclosure_marshal_VOID__UINT, G_TYPE_NONE, 1, G_TYPE_UINT);
 }
 
 CFmRadio* cfm_radio_new()
@@ -680,6 +1820,11 @@ CFmRadio* cfm_radio_new()
 	return g_object_new(CFM_TYPE_RADIO, NULL);
 }
 
+CFmRadio* cfm_radio_new_with_backend(const gchar *backend, const gchar *device)
+{
+	return g_object_new(CFM_TYPE_RADIO, "backend", backend, "device", device, NULL);
+}
+
 void cfm_radio_seek_up(CFmRadio* radio)
 {
 	cfm_radio_tuner_hw_seek(radio, TRUE);
@@ -690,3 +1835,186 @@ void cfm_radio_seek_down(CFmRadio* radio)
 	cfm_radio_tuner_hw_seek(radio, FALSE);
 }
 
+
+/* Steps through every channel in the tuner range from an idle handler, one
+ * channel per iteration, so that the main loop keeps running and the
+ * spectrum can be drawn as it fills up. "sweep-progress" is emitted with the
+ * index of every channel measured. */
+void cfm_radio_sweep_start(CFmRadio* radio)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	guint first, last, i;
+
+	g_return_if_fail(cfm_tuner_backend_is_open(priv->backend));
+	g_return_if_fail(priv->range_high > priv->range_low);
+	if (priv->sweep_idle) {
+		return; /* Already sweeping */
+	}
+	if (!cfm_band_plan_clip(priv->band, priv->range_low, priv->range_high,
+	                        &first, &last)) {
+		g_warning("Band plan %s is outside the tuner range\n", priv->band->id);
+		return;
+	}
+
+	priv->sweep_len = last - first + 1;
+	priv->sweep = g_renew(CFmSpectrumPoint, priv->sweep, priv->sweep_len);
+	for (i = 0; i < priv->sweep_len; i++) {
+		priv->sweep[i].freq = cfm_band_plan_channel(priv->band, first + i);
+		priv->sweep[i].signal = 0;
+		priv->sweep[i].stereo = FALSE;
+	}
+	priv->sweep_pos = 0;
+	cfm_radio_af_cancel(radio);
+	priv->sweep_prev_freq = cfm_radio_get_frequency(radio);
+	cfm_radio_fine_tune_cancel(radio);
+
+	priv->sweep_idle = g_idle_add(cfm_radio_sweep_step, radio);
+}
+
+void cfm_radio_sweep_cancel(CFmRadio* radio)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	if (!priv->sweep_idle) return;
+	cfm_radio_sweep_stop(radio, FALSE);
+}
+
+gboolean cfm_radio_is_sweeping(CFmRadio* radio)
+{
+	return radio->priv->sweep_idle ? TRUE : FALSE;
+}
+
+const CFmBandPlan* cfm_radio_get_band_plan(CFmRadio* radio)
+{
+	return radio->priv->band;
+}
+
+const CFmSpectrumPoint* cfm_radio_get_spectrum(CFmRadio* radio, guint *len)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	*len = priv->sweep_len;
+	return priv->sweep;
+}
+
+/* Opens a second receiver of the same kind as the main one and keeps it
+ * sweeping the band in the background, without touching the tuner being
+ * listened to. "monitor-progress" is emitted for every channel measured. */
+gboolean cfm_radio_monitor_start(CFmRadio* radio, const gchar *device)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	CFmTunerBackend *backend;
+
+	g_return_val_if_fail(device != NULL, FALSE);
+	if (priv->monitor) {
+		return TRUE;
+	}
+
+	backend = cfm_tuner_backend_new(priv->backend_name);
+	g_return_val_if_fail(backend != NULL, FALSE);
+
+	if (!cfm_tuner_backend_open(backend, device)) {
+		g_warning("Failed to open monitor tuner %s\n", device);
+		cfm_tuner_backend_free(backend);
+		return FALSE;
+	}
+
+	priv->monitor = cfm_monitor_new(backend, priv->band,
+		cfm_radio_monitor_cb, radio);
+
+	return priv->monitor != NULL;
+}
+
+void cfm_radio_monitor_stop(CFmRadio* radio)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	if (priv->monitor) {
+		cfm_monitor_free(priv->monitor);
+		priv->monitor = NULL;
+	}
+}
+
+gboolean cfm_radio_is_monitoring(CFmRadio* radio)
+{
+	return radio->priv->monitor ? TRUE : FALSE;
+}
+
+void cfm_radio_monitor_restart(CFmRadio* radio)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	g_return_if_fail(priv->monitor);
+	cfm_monitor_restart(priv->monitor);
+}
+
+const CFmSpectrumPoint* cfm_radio_monitor_get_spectrum(CFmRadio* radio, guint *len)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	g_return_val_if_fail(priv->monitor, NULL);
+	return cfm_monitor_get_spectrum(priv->monitor, len);
+}
+
+const gchar* cfm_radio_monitor_get_ps(CFmRadio* radio, guint index)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	g_return_val_if_fail(priv->monitor, NULL);
+	return cfm_monitor_get_ps(priv->monitor, index);
+}
+
+/* Remembers the best offset from a channel, e.g. one found by fine tuning
+ * in an earlier session, to start from the next time it is tuned to. */
+void cfm_radio_set_station_offset(CFmRadio* radio, gulong freq, glong offset)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	g_hash_table_insert(priv->station_offsets, GUINT_TO_POINTER(freq),
+		GINT_TO_POINTER(offset));
+}
+
+/* Tells how far the system clock is behind the time sent by stations, in
+ * milliseconds, and the local offset from UTC they last sent, in minutes.
+ * Returns FALSE until a station has sent its clock time twice in a row. */
+gboolean cfm_radio_get_clock_offset(CFmRadio* radio, gint64 *offset_ms, gint *local_offset)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	if (!priv->has_clock_offset) return FALSE;
+	if (offset_ms) *offset_ms = priv->clock_offset_ms;
+	if (local_offset) *local_offset = priv->rds_local_offset;
+	return TRUE;
+}
+
+typedef struct {
+	gint32 offset;
+	CFmReceptionLogFunc func;
+	gpointer user_data;
+} CFmRadioLogQuery;
+
+static gboolean cfm_radio_reception_log_shift(const CFmReceptionRecord *rec, gpointer user_data)
+{
+	CFmRadioLogQuery *q = user_data;
+	CFmReceptionRecord shifted = *rec;
+	shifted.time += q->offset;
+	return q->func(&shifted, q->user_data);
+}
+
+/* Calls "func" for every reception log record between two times, in
+ * seconds since the epoch. Records are stored in system time; once a
+ * station has sent its clock, both the bounds and the reported times are
+ * in broadcast time instead, so logs from different units line up.
+ * Returns the number of records found. */
+guint cfm_radio_reception_log_query(CFmRadio* radio, guint32 from, guint32 to,
+	CFmReceptionLogFunc func, gpointer user_data)
+{
+	CFmRadioPrivate *priv = radio->priv;
+	CFmRadioLogQuery q;
+	g_return_val_if_fail(priv->reception_log, 0);
+	cfm_reception_log_flush(priv->reception_log);
+	if (!priv->has_clock_offset) {
+		return cfm_reception_log_query(priv->reception_log_file, from, to,
+			func, user_data);
+	}
+
+	q.offset = priv->clock_offset_ms / 1000;
+	q.func = func;
+	q.user_data = user_data;
+	from = CLAMP((gint64) from - q.offset, 0, G_MAXUINT32);
+	to = CLAMP((gint64) to - q.offset, 0, G_MAXUINT32);
+	return cfm_reception_log_query(priv->reception_log_file, from, to,
+		cfm_radio_reception_log_shift, &q);
+}
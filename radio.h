@@ -7,6 +7,10 @@
 
 #include <glib-object.h>
 
+#include "types.h"
+#include "band.h"
+#include "reception_log.h"
+
 #define CFM_TYPE_RADIO                  (cfm_radio_get_type ())
 #define CFM_RADIO(obj)                  (G_TYPE_CHECK_INSTANCE_CAST ((obj), CFM_TYPE_RADIO, CFmRadio))
 #define CFM_IS_RADIO(obj)               (G_TYPE_CHECK_INSTANCE_TYPE ((obj), CFM_TYPE_RADIO))
@@ -31,9 +35,31 @@ struct _CFmRadioClass
 
 GType cfm_radio_get_type(void) G_GNUC_CONST;
 CFmRadio* cfm_radio_new();
+CFmRadio* cfm_radio_new_with_backend(const gchar *backend, const gchar *device);
 
 void cfm_radio_seek_up(CFmRadio* radio);
 void cfm_radio_seek_down(CFmRadio* radio);
 
+void cfm_radio_sweep_start(CFmRadio* radio);
+void cfm_radio_sweep_cancel(CFmRadio* radio);
+gboolean cfm_radio_is_sweeping(CFmRadio* radio);
+const CFmSpectrumPoint* cfm_radio_get_spectrum(CFmRadio* radio, guint *len);
+
+const CFmBandPlan* cfm_radio_get_band_plan(CFmRadio* radio);
+
+void cfm_radio_set_station_offset(CFmRadio* radio, gulong freq, glong offset);
+
+gboolean cfm_radio_monitor_start(CFmRadio* radio, const gchar *device);
+void cfm_radio_monitor_stop(CFmRadio* radio);
+gboolean cfm_radio_is_monitoring(CFmRadio* radio);
+void cfm_radio_monitor_restart(CFmRadio* radio);
+const CFmSpectrumPoint* cfm_radio_monitor_get_spectrum(CFmRadio* radio, guint *len);
+const gchar* cfm_radio_monitor_get_ps(CFmRadio* radio, guint index);
+
+gboolean cfm_radio_get_clock_offset(CFmRadio* radio, gint64 *offset_ms, gint *local_offset);
+
+guint cfm_radio_reception_log_query(CFmRadio* radio, guint32 from, guint32 to,
+	CFmReceptionLogFunc func, gpointer user_data);
+
 #endif /* CFM_RADIO_H */
 
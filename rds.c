@@ -3,279 +3,184 @@
 
 #include "rds.h"
 
-/* This table comes from pyFMRadio source code. */
-static const gunichar rds_table[256] = {
-	0,	/* 0 */
-	0,	/* 1 */
-	0,	/* 2 */
-	0,	/* 3 */
-	0,	/* 4 */
-	0,	/* 5 */
-	0,	/* 6 */
-	0,	/* 7 */
-	0,	/* 8 */
-	0,	/* 9 */
-	0,	/* 10 */
-	0,	/* 11 */
-	0,	/* 12 */
-	0,	/* 13 */
-	0,	/* 14 */
-	0,	/* 15 */
-	0,	/* 16 */
-	0,	/* 17 */
-	0,	/* 18 */
-	0,	/* 19 */
-	0,	/* 20 */
-	0,	/* 21 */
-	0,	/* 22 */
-	0,	/* 23 */
-	0,	/* 24 */
-	0,	/* 25 */
-	0,	/* 26 */
-	0,	/* 27 */
-	0,	/* 28 */
-	0,	/* 29 */
-	0,	/* 30 */
-	0,	/* 31 */
-	32,	/* 32 */
-	33,	/* 33 */
-	34,	/* 34 */
-	35,	/* 35 */
-	164,	/* 36 */
-	37,	/* 37 */
-	38,	/* 38 */
-	39,	/* 39 */
-	40,	/* 40 */
-	41,	/* 41 */
-	42,	/* 42 */
-	43,	/* 43 */
-	44,	/* 44 */
-	45,	/* 45 */
-	46,	/* 46 */
-	47,	/* 47 */
-	48,	/* 48 */
-	49,	/* 49 */
-	50,	/* 50 */
-	51,	/* 51 */
-	52,	/* 52 */
-	53,	/* 53 */
-	54,	/* 54 */
-	55,	/* 55 */
-	56,	/* 56 */
-	57,	/* 57 */
-	58,	/* 58 */
-	59,	/* 59 */
-	60,	/* 60 */
-	61,	/* 61 */
-	62,	/* 62 */
-	63,	/* 63 */
-	64,	/* 64 */
-	65,	/* 65 */
-	66,	/* 66 */
-	67,	/* 67 */
-	68,	/* 68 */
-	69,	/* 69 */
-	70,	/* 70 */
-	71,	/* 71 */
-	72,	/* 72 */
-	73,	/* 73 */
-	74,	/* 74 */
-	75,	/* 75 */
-	76,	/* 76 */
-	77,	/* 77 */
-	78,	/* 78 */
-	79,	/* 79 */
-	80,	/* 80 */
-	81,	/* 81 */
-	82,	/* 82 */
-	83,	/* 83 */
-	84,	/* 84 */
-	85,	/* 85 */
-	86,	/* 86 */
-	87,	/* 87 */
-	88,	/* 88 */
-	89,	/* 89 */
-	90,	/* 90 */
-	91,	/* 91 */
-	92,	/* 92 */
-	93,	/* 93 */
-	32,	/* 94 */
-	32,	/* 95 */
-	32,	/* 96 */
-	97,	/* 97 */
-	98,	/* 98 */
-	99,	/* 99 */
-	100,	/* 100 */
-	101,	/* 101 */
-	102,	/* 102 */
-	103,	/* 103 */
-	104,	/* 104 */
-	105,	/* 105 */
-	106,	/* 106 */
-	107,	/* 107 */
-	108,	/* 108 */
-	109,	/* 109 */
-	110,	/* 110 */
-	111,	/* 111 */
-	112,	/* 112 */
-	113,	/* 113 */
-	114,	/* 114 */
-	115,	/* 115 */
-	116,	/* 116 */
-	117,	/* 117 */
-	118,	/* 118 */
-	119,	/* 119 */
-	120,	/* 120 */
-	121,	/* 121 */
-	122,	/* 122 */
-	123,	/* 123 */
-	124,	/* 124 */
-	125,	/* 125 */
-	32,	/* 126 */
-	32,	/* 127 */
-	225,	/* 128 */
-	224,	/* 129 */
-	233,	/* 130 */
-	232,	/* 131 */
-	237,	/* 132 */
-	236,	/* 133 */
-	243,	/* 134 */
-	242,	/* 135 */
-	250,	/* 136 */
-	249,	/* 137 */
-	209,	/* 138 */
-	199,	/* 139 */
-	350,	/* 140 */
-	223,	/* 141 */
-	161,	/* 142 */
-	306,	/* 143 */
-	226,	/* 144 */
-	228,	/* 145 */
-	234,	/* 146 */
-	235,	/* 147 */
-	238,	/* 148 */
-	239,	/* 149 */
-	244,	/* 150 */
-	246,	/* 151 */
-	251,	/* 152 */
-	252,	/* 153 */
-	241,	/* 154 */
-	231,	/* 155 */
-	351,	/* 156 */
-	287,	/* 157 */
-	63,	/* 158 */
-	307,	/* 159 */
-	170,	/* 160 */
-	945,	/* 161 */
-	169,	/* 162 */
-	8240,	/* 163 */
-	486,	/* 164 */
-	277,	/* 165 */
-	328,	/* 166 */
-	337,	/* 167 */
-	960,	/* 168 */
-	63,	/* 169 */
-	163,	/* 170 */
-	36,	/* 171 */
-	8592,	/* 172 */
-	8593,	/* 173 */
-	8594,	/* 174 */
-	8595,	/* 175 */
-	186,	/* 176 */
-	185,	/* 177 */
-	178,	/* 178 */
-	179,	/* 179 */
-	177,	/* 180 */
-	304,	/* 181 */
-	324,	/* 182 */
-	369,	/* 183 */
-	956,	/* 184 */
-	191,	/* 185 */
-	247,	/* 186 */
-	176,	/* 187 */
-	188,	/* 188 */
-	189,	/* 189 */
-	190,	/* 190 */
-	167,	/* 191 */
-	193,	/* 192 */
-	192,	/* 193 */
-	201,	/* 194 */
-	200,	/* 195 */
-	205,	/* 196 */
-	204,	/* 197 */
-	211,	/* 198 */
-	210,	/* 199 */
-	218,	/* 200 */
-	217,	/* 201 */
-	344,	/* 202 */
-	268,	/* 203 */
-	352,	/* 204 */
-	381,	/* 205 */
-	272,	/* 206 */
-	317,	/* 207 */
-	194,	/* 208 */
-	196,	/* 209 */
-	202,	/* 210 */
-	203,	/* 211 */
-	206,	/* 212 */
-	207,	/* 213 */
-	212,	/* 214 */
-	214,	/* 215 */
-	219,	/* 216 */
-	220,	/* 217 */
-	345,	/* 218 */
-	269,	/* 219 */
-	353,	/* 220 */
-	382,	/* 221 */
-	271,	/* 222 */
-	318,	/* 223 */
-	195,	/* 224 */
-	197,	/* 225 */
-	198,	/* 226 */
-	338,	/* 227 */
-	375,	/* 228 */
-	221,	/* 229 */
-	213,	/* 230 */
-	216,	/* 231 */
-	254,	/* 232 */
-	330,	/* 233 */
-	340,	/* 234 */
-	262,	/* 235 */
-	346,	/* 236 */
-	377,	/* 237 */
-	63,	/* 238 */
-	240,	/* 239 */
-	227,	/* 240 */
-	229,	/* 241 */
-	230,	/* 242 */
-	339,	/* 243 */
-	373,	/* 244 */
-	253,	/* 245 */
-	245,	/* 246 */
-	248,	/* 247 */
-	254,	/* 248 */
-	331,	/* 249 */
-	341,	/* 250 */
-	263,	/* 251 */
-	347,	/* 252 */
-	378,	/* 253 */
-	63,	/* 254 */
-	32,	/* 255 */
-};
+typedef struct {
+	guint8 len;
+	gchar str[RDS_UTF8_MAX_LEN];
+} RdsChar;
 
-gchar * rds_decode(const gchar *s)
+/* Generated at build time from data/codetables.utf8,
+ * which comes from pyFMRadio source code. */
+#include "rds_table.h"
+
+#define WORD_REP(c)       (~0UL / 0xFF * (c))
+#define WORD_HAS_ZERO(w)  (((w) - WORD_REP(0x01)) & ~(w) & WORD_REP(0x80))
+
+/* Sets the top bit of every byte in w that is not printable ASCII left
+ * alone by the RDS set, that is ' ' to '}' except '$', '^', '_' and '`'.
+ * Only the lowest flagged byte is exact; carries may flag the ones above. */
+static inline gulong rds_word_special(gulong w)
+{
+	return ((w | (w - WORD_REP(0x20)) | (w + WORD_REP(0x02))) & WORD_REP(0x80)) |
+	       WORD_HAS_ZERO(w ^ WORD_REP('$')) |
+	       WORD_HAS_ZERO((w ^ WORD_REP('^')) & WORD_REP(0xFE)) |
+	       WORD_HAS_ZERO(w ^ WORD_REP('`'));
+}
+
+/* Appends len bytes of c at *n if they fit, keeping one byte for the nul;
+ * only counts them if out is NULL. The output path of every charset. */
+static inline gboolean rds_put(gchar *out, gsize *n, gsize size,
+	const gchar *c, guint len)
+{
+	if (len == 0 || *n + len >= size) return FALSE;
+	if (out) {
+		gchar *o = out + *n;
+		switch (len) {
+		case 4: o[3] = c[3];
+		case 3: o[2] = c[2];
+		case 2: o[1] = c[1];
+		case 1: o[0] = c[0];
+		}
+	}
+	*n += len;
+	return TRUE;
+}
+
+/* Decodes up to the first control character, writing at most size - 1
+ * bytes to out, or just counting them if out is NULL. Returns the number
+ * of bytes. Plain ASCII, which is most of what stations send, is copied a
+ * word at a time, looking up only the characters in between. */
+static gsize rds_decode_run(const guchar *s, gsize len, gchar *out, gsize size)
+{
+	gsize i = 0, n = 0;
+
+	while (i < len) {
+		const RdsChar *c;
+
+		if (i + sizeof(gulong) <= len && n + sizeof(gulong) < size) {
+			gulong w, special;
+			guint plain;
+
+			memcpy(&w, s + i, sizeof(w));
+			if (out) memcpy(out + n, &w, sizeof(w));
+			special = rds_word_special(GULONG_FROM_LE(w));
+			plain = special ? __builtin_ctzl(special) / 8 : sizeof(w);
+			i += plain;
+			n += plain;
+			if (!special) continue;
+		}
+
+		c = &rds_table[s[i]];
+		if (!rds_put(out, &n, size, c->str, c->len)) break;
+		i++;
+	}
+
+	return n;
+}
+
+#define RDS_IS_CONTROL(u) ((u) < 0x20 || (u) == 0x7F)
+
+/* RDS2 and Enhanced RadioText in UTF-8. Bytes that do not start a valid
+ * sequence are taken as the basic set, which is what such a station would
+ * have sent before. */
+static gsize rds_decode_run_utf8(const guchar *s, gsize len, gchar *out, gsize size)
 {
-	guint l = strlen(s);
-	GString *b = g_string_sized_new(2 * l);
+	gsize i = 0, n = 0;
 
-	guchar *c = (guchar*) s;
-	while (*c) {
-		g_string_append_unichar(b, rds_table[*c]);
-		c++;
+	while (i < len) {
+		const gchar *p = (const gchar*) s + i;
+		const gunichar u = g_utf8_get_char_validated(p, len - i);
+		guint l;
+
+		if (u == (gunichar) -1 || u == (gunichar) -2) {
+			const RdsChar *c = &rds_table[s[i]];
+			if (!rds_put(out, &n, size, c->str, c->len)) break;
+			i++;
+			continue;
+		}
+		if (RDS_IS_CONTROL(u)) break;
+
+		l = g_utf8_next_char(p) - p;
+		if (!rds_put(out, &n, size, p, l)) break;
+		i += l;
 	}
 
-	gchar *r = b->str;
-	g_string_free(b, FALSE);
+	return n;
+}
+
+/* Enhanced RadioText in UCS-2, big endian pairs. Surrogates, which UCS-2
+ * does not have, are skipped. */
+static gsize rds_decode_run_ucs2(const guchar *s, gsize len, gchar *out, gsize size)
+{
+	gsize i, n = 0;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		const gunichar u = (s[i] << 8) | s[i + 1];
+		gchar c[RDS_UTF8_MAX_LEN];
+
+		if (RDS_IS_CONTROL(u)) break;
+		if (u >= 0xD800 && u < 0xE000) continue;
+		if (!rds_put(out, &n, size, c, g_unichar_to_utf8(u, c))) break;
+	}
+
+	return n;
+}
+
+static gsize rds_decode_charset_run(RdsCharset charset, const guchar *s,
+	gsize len, gchar *out, gsize size)
+{
+	switch (charset) {
+	case RDS_CHARSET_UTF8:
+		return rds_decode_run_utf8(s, len, out, size);
+	case RDS_CHARSET_UCS2:
+		return rds_decode_run_ucs2(s, len, out, size);
+	case RDS_CHARSET_BASIC:
+	default:
+		return rds_decode_run(s, len, out, size);
+	}
+}
+
+gchar * rds_decode(const gchar *s)
+{
+	const gsize l = strlen(s);
+	const gsize n = rds_decode_run((const guchar*) s, l, NULL, G_MAXSIZE);
+	gchar *r = g_malloc(n + 1);
+
+	rds_decode_run((const guchar*) s, l, r, n + 1);
+	r[n] = '\0';
+
 	return r;
 }
 
+/* Like rds_decode(), into a caller buffer, which is always nul terminated.
+ * The text is cut short rather than split in the middle of a character if
+ * it does not fit; RDS_UTF8_MAX_LEN * strlen(s) + 1 bytes are enough. */
+gsize rds_decode_to(const gchar *s, gchar *buf, gsize size)
+{
+	return rds_decode_charset_to(RDS_CHARSET_BASIC, s, strlen(s), buf, size);
+}
+
+/* Decodes len bytes of text in the given charset into a caller buffer, as
+ * rds_decode_to() does; the length is needed as UCS-2 text holds nuls.
+ * RDS_UTF8_MAX_LEN * len + 1 bytes are enough for any of them. */
+gsize rds_decode_charset_to(RdsCharset charset, const gchar *s, gsize len,
+	gchar *buf, gsize size)
+{
+	gsize n;
+
+	g_return_val_if_fail(size > 0, 0);
+
+	n = rds_decode_charset_run(charset, (const guchar*) s, len, buf, size);
+	buf[n] = '\0';
+
+	return n;
+}
+
+/* Modified Julian Day of 1970-01-01. */
+#define MJD_UNIX_EPOCH 40587
+
+/* Turns the clock time of group 4A, a Modified Julian Day and the UTC hour
+ * and minute, into seconds since the epoch. */
+gint64 rds_ct_to_unix(guint32 mjd, guint hour, guint minute)
+{
+	return ((gint64) mjd - MJD_UNIX_EPOCH) * 86400 + hour * 3600 + minute * 60;
+}
@@ -3,6 +3,22 @@
 
 #include <glib.h>
 
+/* Longest UTF-8 sequence a single RDS character turns into. */
+#define RDS_UTF8_MAX_LEN 3
+
+/* Character sets text can be sent in: the basic RDS set for PS and RT,
+ * and those Enhanced RadioText announces. */
+typedef enum {
+	RDS_CHARSET_BASIC,
+	RDS_CHARSET_UCS2,
+	RDS_CHARSET_UTF8
+} RdsCharset;
+
 gchar * rds_decode(const gchar *s);
+gsize rds_decode_to(const gchar *s, gchar *buf, gsize size);
+gsize rds_decode_charset_to(RdsCharset charset, const gchar *s, gsize len,
+	gchar *buf, gsize size);
+
+gint64 rds_ct_to_unix(guint32 mjd, guint hour, guint minute);
 
 #endif
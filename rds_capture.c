@@ -0,0 +1,115 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "rds_capture.h"
+
+/* The file is little endian: a CaptureHeader, then one CaptureRecord per
+ * read followed by its key and data. Strings longer than a record can hold
+ * are cut short; block reads are split over several records. */
+
+#define CAPTURE_MAGIC    0x524d4643 /* "CFMR" */
+#define CAPTURE_VERSION  1
+
+/* 3 byte blocks, as many as fit a record */
+#define RECORD_MAX_BLOCK_BYTES (G_MAXUINT16 - G_MAXUINT16 % 3)
+
+typedef struct {
+	guint32 magic;
+	guint16 version;
+	guint16 reserved;
+} CaptureHeader;
+
+typedef struct {
+	guint8 type;
+	guint8 key_len;
+	guint16 len;       /* Of the data after the key */
+	guint32 delta_us;  /* Since the previous record */
+} CaptureRecord;
+
+void cfm_rds_capture_begin(GByteArray *buf)
+{
+	CaptureHeader h;
+	h.magic = GUINT32_TO_LE(CAPTURE_MAGIC);
+	h.version = GUINT16_TO_LE(CAPTURE_VERSION);
+	h.reserved = 0;
+	g_byte_array_append(buf, (const guint8*) &h, sizeof(h));
+}
+
+void cfm_rds_capture_append(GByteArray *buf, CFmRdsCaptureType type, guint32 delta_us,
+	const gchar *key, const guint8 *data, gsize len)
+{
+	const gsize key_len = key ? MIN(strlen(key), G_MAXUINT8) : 0;
+
+	if (type == CFM_RDS_CAPTURE_STRING) {
+		len = MIN(len, G_MAXUINT16);
+	}
+
+	do {
+		/* Whole blocks only, so that every record can be decoded alone. */
+		const gsize n = MIN(len, RECORD_MAX_BLOCK_BYTES);
+		CaptureRecord r;
+
+		r.type = type;
+		r.key_len = key_len;
+		r.len = GUINT16_TO_LE(n);
+		r.delta_us = GUINT32_TO_LE(delta_us);
+		g_byte_array_append(buf, (const guint8*) &r, sizeof(r));
+		g_byte_array_append(buf, (const guint8*) key, key_len);
+		g_byte_array_append(buf, data, n);
+
+		data += n;
+		len -= n;
+		delta_us = 0;
+	} while (len > 0);
+}
+
+gboolean cfm_rds_replay_init(CFmRdsReplay *r, const guint8 *data, gsize len)
+{
+	CaptureHeader h;
+
+	if (len < sizeof(h)) return FALSE;
+	memcpy(&h, data, sizeof(h));
+	if (GUINT32_FROM_LE(h.magic) != CAPTURE_MAGIC ||
+	    GUINT16_FROM_LE(h.version) != CAPTURE_VERSION) {
+		return FALSE;
+	}
+
+	r->data = data;
+	r->len = len;
+	cfm_rds_replay_rewind(r);
+
+	return TRUE;
+}
+
+void cfm_rds_replay_rewind(CFmRdsReplay *r)
+{
+	r->pos = sizeof(CaptureHeader);
+	r->time_us = 0;
+}
+
+/* Returns FALSE at the end of the capture, or where it was cut short. */
+gboolean cfm_rds_replay_next(CFmRdsReplay *r, CFmRdsCaptureRecord *rec)
+{
+	CaptureRecord h;
+	gsize next;
+
+	if (r->pos + sizeof(h) > r->len) return FALSE;
+	memcpy(&h, r->data + r->pos, sizeof(h));
+	next = r->pos + sizeof(h) + h.key_len + GUINT16_FROM_LE(h.len);
+	if (next > r->len) return FALSE;
+
+	r->time_us += GUINT32_FROM_LE(h.delta_us);
+	rec->type = h.type;
+	rec->time_us = r->time_us;
+	rec->key = (const gchar*) r->data + r->pos + sizeof(h);
+	rec->key_len = h.key_len;
+	rec->data = r->data + r->pos + sizeof(h) + h.key_len;
+	rec->len = GUINT16_FROM_LE(h.len);
+	r->pos = next;
+
+	return TRUE;
+}
@@ -0,0 +1,44 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_RDS_CAPTURE_H_
+#define _CFM_RDS_CAPTURE_H_
+
+#include <glib.h>
+
+/* A recording of the RDS data a tuner handed out, as raw blocks or as the
+ * strings read back through read_rds, with the time each arrived. Written
+ * by cfmradio-rds-capture; replayed by the RDS benchmark and fuzzer. */
+
+typedef enum {
+	CFM_RDS_CAPTURE_BLOCKS = 1, /* As read from the radio device */
+	CFM_RDS_CAPTURE_STRING      /* As read_rds() returned it for key */
+} CFmRdsCaptureType;
+
+typedef struct {
+	CFmRdsCaptureType type;
+	guint64 time_us;     /* Since the capture started */
+	const gchar *key;    /* Not nul terminated; key_len bytes */
+	guint key_len;
+	const guint8 *data;
+	gsize len;
+} CFmRdsCaptureRecord;
+
+/* Walks a capture held in memory without copying or allocating. */
+typedef struct {
+	const guint8 *data;
+	gsize len;
+	gsize pos;
+	guint64 time_us;
+} CFmRdsReplay;
+
+void cfm_rds_capture_begin(GByteArray *buf);
+void cfm_rds_capture_append(GByteArray *buf, CFmRdsCaptureType type, guint32 delta_us,
+	const gchar *key, const guint8 *data, gsize len);
+
+gboolean cfm_rds_replay_init(CFmRdsReplay *r, const guint8 *data, gsize len);
+gboolean cfm_rds_replay_next(CFmRdsReplay *r, CFmRdsCaptureRecord *rec);
+void cfm_rds_replay_rewind(CFmRdsReplay *r);
+
+#endif /* _CFM_RDS_CAPTURE_H_ */
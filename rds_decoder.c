@@ -0,0 +1,440 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "rds_decoder.h"
+
+/* Turns the raw block stream of a standard V4L2 receiver into PI, PTY,
+ * PS, RT, CT, AF, the RadioText Plus artist and title and Enhanced
+ * RadioText, following IEC 62106. Blocks arrive already
+ * synchronized and error checked by the tuner; what is left to do here is
+ * putting groups together from blocks in the right order and dropping
+ * groups where a block was lost or uncorrectable. */
+
+#define AF_FILLER     205
+#define AF_COUNT_MIN  224
+#define AF_COUNT_MAX  249
+#define AF_LFMF       250 /* The code after it is an LF/MF frequency */
+#define AF_BASE       87500000
+#define AF_STEP       100000
+
+#define RT_END        0x0D
+
+#define RTPLUS_AID    0x4BD7
+#define RTPLUS_TITLE  1  /* ITEM.TITLE content type */
+#define RTPLUS_ARTIST 4  /* ITEM.ARTIST */
+
+#define ERT_AID       0x6552
+#define ERT_UTF8      0x0001 /* In the 3A message; UCS-2 otherwise */
+
+void cfm_rds_decoder_init(CFmRdsDecoder *d)
+{
+	memset(d, 0, sizeof(*d));
+	cfm_rds_text_init(&d->ps, CFM_RDS_PS_LEN);
+	cfm_rds_text_init(&d->rt, CFM_RDS_RT_LEN);
+	cfm_rds_text_init(&d->ert, CFM_RDS_ERT_LEN);
+	d->rt_ab = -1;
+	d->rtplus_toggle = -1;
+}
+
+/* Forgets the station, e.g. after tuning elsewhere; keeps statistics. */
+void cfm_rds_decoder_reset(CFmRdsDecoder *d)
+{
+	const guint blocks = d->blocks, errors = d->errors;
+	const guint groups = d->groups, sync_lost = d->sync_lost;
+
+	cfm_rds_decoder_init(d);
+	d->blocks = blocks;
+	d->errors = errors;
+	d->groups = groups;
+	d->sync_lost = sync_lost;
+}
+
+static guint cfm_rds_decoder_clear_station(CFmRdsDecoder *d)
+{
+	guint changed = 0;
+
+	if (d->ps.text[0]) changed |= CFM_RDS_CHANGED_PS;
+	if (d->rt.text[0]) changed |= CFM_RDS_CHANGED_RT;
+	if (d->n_af) changed |= CFM_RDS_CHANGED_AF;
+	if (d->pty) changed |= CFM_RDS_CHANGED_PTY;
+	if (d->artist[0] || d->title[0]) changed |= CFM_RDS_CHANGED_RTPLUS;
+	if (d->ert.text_len) changed |= CFM_RDS_CHANGED_ERT;
+
+	cfm_rds_text_init(&d->ps, CFM_RDS_PS_LEN);
+	cfm_rds_text_init(&d->rt, CFM_RDS_RT_LEN);
+	d->rt_ab = -1;
+	d->n_af = 0;
+	d->pty = 0;
+	d->rtplus_group = 0;
+	d->rtplus_toggle = -1;
+	memset(d->rtplus_artist, 0, sizeof(d->rtplus_artist));
+	memset(d->rtplus_title, 0, sizeof(d->rtplus_title));
+	d->artist[0] = '\0';
+	d->title[0] = '\0';
+	cfm_rds_text_init(&d->ert, CFM_RDS_ERT_LEN);
+	d->ert_group = 0;
+	d->ert_utf8 = FALSE;
+
+	return changed;
+}
+
+/* A new PI is only believed once it has been received twice in a row. */
+static guint cfm_rds_decoder_pi(CFmRdsDecoder *d, guint16 pi)
+{
+	if (pi == d->pi) {
+		d->pi_candidate = pi;
+		return 0;
+	}
+	if (pi != d->pi_candidate) {
+		d->pi_candidate = pi;
+		return 0;
+	}
+
+	d->pi = pi;
+	return CFM_RDS_CHANGED_PI | cfm_rds_decoder_clear_station(d);
+}
+
+static guint cfm_rds_decoder_af(CFmRdsDecoder *d, guint8 code)
+{
+	gulong freq;
+	guint i;
+
+	if (code == 0 || code >= AF_FILLER) {
+		return 0; /* Fillers and codes that are not frequencies */
+	}
+
+	freq = AF_BASE + code * AF_STEP;
+	for (i = 0; i < d->n_af; i++) {
+		if (d->af[i] == freq) return 0;
+	}
+	if (d->n_af >= CFM_RDS_MAX_AF) return 0;
+
+	d->af[d->n_af++] = freq;
+	return CFM_RDS_CHANGED_AF;
+}
+
+/* Method A sends the list two codes per group: a frequency count or the
+ * LF/MF marker comes first, paired with the frequency it applies to. */
+static guint cfm_rds_decoder_af_pair(CFmRdsDecoder *d, guint8 first, guint8 second)
+{
+	if (first == AF_LFMF) {
+		return 0; /* Not on the FM band */
+	} else if (first >= AF_COUNT_MIN && first <= AF_COUNT_MAX) {
+		return cfm_rds_decoder_af(d, second);
+	} else if (first > AF_FILLER) {
+		return 0; /* Unassigned, so the block is not to be trusted */
+	}
+	return cfm_rds_decoder_af(d, first) | cfm_rds_decoder_af(d, second);
+}
+
+static guint cfm_rds_decoder_group_0(CFmRdsDecoder *d, const guint16 *block,
+	gboolean version_b)
+{
+	const guint addr = block[1] & 0x3;
+	const gchar chars[2] = { block[3] >> 8, block[3] & 0xFF };
+	guint changed = 0;
+
+	if (!version_b) {
+		changed |= cfm_rds_decoder_af_pair(d, block[2] >> 8, block[2] & 0xFF);
+	}
+
+	if (cfm_rds_text_vote(&d->ps, addr * 2, chars, 2)) {
+		changed |= CFM_RDS_CHANGED_PS;
+	}
+
+	return changed;
+}
+
+/* Copies the part of the RadioText a tag points to into out, if that is
+ * different; tags reaching past the end of the text are not believed. */
+static gboolean cfm_rds_decoder_rtplus_extract(const CFmRdsDecoder *d,
+	const guint8 tag[2], gchar *out)
+{
+	const gchar *rt = d->rt.text;
+	guint start = tag[0], len = tag[1];
+
+	if (start + len > strlen(rt)) {
+		len = 0;
+	}
+	while (len > 0 && rt[start] == ' ') {
+		start++;
+		len--;
+	}
+	while (len > 0 && rt[start + len - 1] == ' ') {
+		len--;
+	}
+
+	if (strncmp(out, rt + start, len) == 0 && out[len] == '\0') {
+		return FALSE;
+	}
+	memcpy(out, rt + start, len);
+	out[len] = '\0';
+	return TRUE;
+}
+
+static guint cfm_rds_decoder_rtplus_update(CFmRdsDecoder *d)
+{
+	gboolean changed;
+
+	if (d->rt_stale) {
+		return 0; /* The tags may already be for the text to come */
+	}
+
+	changed = cfm_rds_decoder_rtplus_extract(d, d->rtplus_artist, d->artist);
+	changed |= cfm_rds_decoder_rtplus_extract(d, d->rtplus_title, d->title);
+
+	return changed ? CFM_RDS_CHANGED_RTPLUS : 0;
+}
+
+static guint cfm_rds_decoder_group_2(CFmRdsDecoder *d, const guint16 *block,
+	gboolean version_b)
+{
+	const guint addr = block[1] & 0xF;
+	const gint8 ab = (block[1] >> 4) & 0x1;
+	const guint width = version_b ? 2 : 4;
+	gchar chars[4];
+	guint i, n = width;
+
+	if (ab != d->rt_ab || version_b != d->rt_b) {
+		/* The station started a new text. */
+		d->rt_ab = ab;
+		d->rt_b = version_b;
+		d->rt_stale = TRUE;
+		cfm_rds_text_restart(&d->rt, 16 * width);
+	}
+
+	if (version_b) {
+		chars[0] = block[3] >> 8;
+		chars[1] = block[3] & 0xFF;
+	} else {
+		chars[0] = block[2] >> 8;
+		chars[1] = block[2] & 0xFF;
+		chars[2] = block[3] >> 8;
+		chars[3] = block[3] & 0xFF;
+	}
+
+	for (i = 0; i < width; i++) {
+		if (chars[i] == RT_END) {
+			cfm_rds_text_set_len(&d->rt, addr * width + i);
+			n = i;
+			break;
+		}
+	}
+
+	if (!cfm_rds_text_vote(&d->rt, addr * width, chars, n)) {
+		return 0;
+	}
+	d->rt_stale = FALSE;
+	return CFM_RDS_CHANGED_RT | cfm_rds_decoder_rtplus_update(d);
+}
+
+/* Open data applications announce here which group type they use. */
+static guint cfm_rds_decoder_group_3a(CFmRdsDecoder *d, const guint16 *block)
+{
+	const guint8 code = block[1] & 0x1F;
+	gboolean utf8;
+
+	/* Never one of the groups decoded here anyway */
+	if ((code >> 1) < 5) {
+		return 0;
+	}
+
+	switch (block[3]) {
+	case RTPLUS_AID:
+		d->rtplus_group = code;
+		break;
+	case ERT_AID:
+		d->ert_group = code;
+		utf8 = (block[2] & ERT_UTF8) != 0;
+		if (utf8 != d->ert_utf8) {
+			/* What was received so far means something else now */
+			d->ert_utf8 = utf8;
+			cfm_rds_text_init(&d->ert, CFM_RDS_ERT_LEN);
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* Four bytes per group at a 5 bit address; the text ends with a carriage
+ * return, which in UCS-2 takes both bytes of a pair. */
+static guint cfm_rds_decoder_group_ert(CFmRdsDecoder *d, const guint16 *block)
+{
+	const guint pos = (block[1] & 0x1F) * 4;
+	const gchar bytes[4] = {
+		block[2] >> 8, block[2] & 0xFF, block[3] >> 8, block[3] & 0xFF
+	};
+	const guint step = d->ert_utf8 ? 1 : 2;
+	guint i, n = 4;
+
+	for (i = 0; i < 4; i += step) {
+		if (bytes[i + step - 1] == RT_END && (step == 1 || bytes[i] == 0)) {
+			n = i;
+			cfm_rds_text_set_len(&d->ert, pos + n);
+			break;
+		}
+	}
+
+	return cfm_rds_text_vote(&d->ert, pos, bytes, n) ? CFM_RDS_CHANGED_ERT : 0;
+}
+
+/* Two tags per group, each a content type, a start and a length minus one.
+ * An item's tags may come spread over several groups; they hold until the
+ * item toggle changes, or are dropped while no item is running. */
+static guint cfm_rds_decoder_group_rtplus(CFmRdsDecoder *d, const guint16 *block)
+{
+	const gint8 toggle = (block[1] >> 4) & 0x1;
+	const gboolean running = (block[1] >> 3) & 0x1;
+	const guint8 tags[2][3] = {
+		{ ((block[1] & 0x7) << 3) | (block[2] >> 13),
+		  (block[2] >> 7) & 0x3F, ((block[2] >> 1) & 0x3F) + 1 },
+		{ ((block[2] & 0x1) << 5) | (block[3] >> 11),
+		  (block[3] >> 5) & 0x3F, (block[3] & 0x1F) + 1 }
+	};
+	guint8 artist[2], title[2];
+	guint i;
+
+	if (toggle == d->rtplus_toggle && running) {
+		memcpy(artist, d->rtplus_artist, sizeof(artist));
+		memcpy(title, d->rtplus_title, sizeof(title));
+	} else {
+		memset(artist, 0, sizeof(artist));
+		memset(title, 0, sizeof(title));
+	}
+	d->rtplus_toggle = toggle;
+
+	for (i = 0; i < 2 && running; i++) {
+		if (tags[i][0] == RTPLUS_ARTIST) {
+			memcpy(artist, &tags[i][1], sizeof(artist));
+		} else if (tags[i][0] == RTPLUS_TITLE) {
+			memcpy(title, &tags[i][1], sizeof(title));
+		}
+	}
+
+	if (memcmp(artist, d->rtplus_artist, sizeof(artist)) == 0 &&
+	    memcmp(title, d->rtplus_title, sizeof(title)) == 0) {
+		return 0; /* Sent again and again; nothing to do */
+	}
+	memcpy(d->rtplus_artist, artist, sizeof(artist));
+	memcpy(d->rtplus_title, title, sizeof(title));
+
+	return cfm_rds_decoder_rtplus_update(d);
+}
+
+static guint cfm_rds_decoder_group_4a(CFmRdsDecoder *d, const guint16 *block)
+{
+	const guint32 mjd = ((guint32) (block[1] & 0x3) << 15) | (block[2] >> 1);
+	const guint8 hour = ((block[2] & 0x1) << 4) | (block[3] >> 12);
+	const guint8 minute = (block[3] >> 6) & 0x3F;
+	const gint8 offset = (block[3] & 0x1F) * ((block[3] & 0x20) ? -1 : 1);
+
+	if (hour > 23 || minute > 59 || mjd == 0) {
+		return 0;
+	}
+
+	d->has_ct = TRUE;
+	d->ct_mjd = mjd;
+	d->ct_hour = hour;
+	d->ct_minute = minute;
+	d->ct_offset = offset;
+
+	return CFM_RDS_CHANGED_CT;
+}
+
+/* Decodes one complete, error free group. */
+guint cfm_rds_decoder_feed_group(CFmRdsDecoder *d, const guint16 block[4])
+{
+	const guint type = block[1] >> 12;
+	const gboolean version_b = (block[1] >> 11) & 0x1;
+	const guint8 pty = (block[1] >> 5) & 0x1F;
+	guint changed;
+
+	d->groups++;
+
+	changed = cfm_rds_decoder_pi(d, block[0]);
+	if (!d->pi || block[0] != d->pi) {
+		return changed; /* Not sure yet which station this is */
+	}
+
+	d->tp = (block[1] >> 10) & 0x1;
+	if (pty != d->pty) {
+		d->pty = pty;
+		changed |= CFM_RDS_CHANGED_PTY;
+	}
+
+	if (d->rtplus_group && ((type << 1) | version_b) == d->rtplus_group) {
+		return changed | cfm_rds_decoder_group_rtplus(d, block);
+	}
+	if (d->ert_group && ((type << 1) | version_b) == d->ert_group) {
+		return changed | cfm_rds_decoder_group_ert(d, block);
+	}
+
+	switch (type) {
+	case 0:
+		changed |= cfm_rds_decoder_group_0(d, block, version_b);
+		break;
+	case 2:
+		changed |= cfm_rds_decoder_group_2(d, block, version_b);
+		break;
+	case 3:
+		if (!version_b) changed |= cfm_rds_decoder_group_3a(d, block);
+		break;
+	case 4:
+		if (!version_b) changed |= cfm_rds_decoder_group_4a(d, block);
+		break;
+	}
+
+	return changed;
+}
+
+/* Feeds raw blocks, as read from a V4L2 radio device. Returns a mask of
+ * CFmRdsChanged for everything that changed. */
+guint cfm_rds_decoder_feed(CFmRdsDecoder *d, const guint8 *data, gsize len)
+{
+	guint changed = 0;
+	gsize i;
+
+	for (i = 0; i + CFM_RDS_BLOCK_SIZE <= len; i += CFM_RDS_BLOCK_SIZE) {
+		const guint16 value = data[i] | (data[i + 1] << 8);
+		const guint8 flags = data[i + 2];
+		guint id = flags & CFM_RDS_BLOCK_MSK;
+
+		d->blocks++;
+
+		if (id == CFM_RDS_BLOCK_C_ALT) {
+			id = CFM_RDS_BLOCK_C; /* Carries the PI again in B groups */
+		}
+		if ((flags & CFM_RDS_BLOCK_ERROR) || id == CFM_RDS_BLOCK_INVALID) {
+			d->errors++;
+			d->have = 0;
+			d->next = CFM_RDS_BLOCK_A;
+			continue;
+		}
+		if (id != d->next) {
+			if (d->have) d->sync_lost++;
+			d->have = 0;
+			if (id != CFM_RDS_BLOCK_A) {
+				d->next = CFM_RDS_BLOCK_A;
+				continue;
+			}
+		}
+
+		d->block[id] = value;
+		d->have |= 1 << id;
+		d->next = (id + 1) % 4;
+
+		if (id == CFM_RDS_BLOCK_D) {
+			if (d->have == 0xF) {
+				changed |= cfm_rds_decoder_feed_group(d, d->block);
+			}
+			d->have = 0;
+		}
+	}
+
+	return changed;
+}
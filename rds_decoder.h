@@ -0,0 +1,93 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_RDS_DECODER_H_
+#define _CFM_RDS_DECODER_H_
+
+#include <glib.h>
+
+#include "rds_text.h"
+
+/* The raw stream is a sequence of 3 byte blocks, laid out like V4L2's
+ * struct v4l2_rds_data: lsb, msb, then the block id and flags below. */
+#define CFM_RDS_BLOCK_SIZE       3
+#define CFM_RDS_BLOCK_MSK        0x07
+#define CFM_RDS_BLOCK_A          0
+#define CFM_RDS_BLOCK_B          1
+#define CFM_RDS_BLOCK_C          2
+#define CFM_RDS_BLOCK_D          3
+#define CFM_RDS_BLOCK_C_ALT      4
+#define CFM_RDS_BLOCK_INVALID    7
+#define CFM_RDS_BLOCK_CORRECTED  0x40
+#define CFM_RDS_BLOCK_ERROR      0x80
+
+#define CFM_RDS_PS_LEN   8
+#define CFM_RDS_RT_LEN   64
+#define CFM_RDS_ERT_LEN  128 /* Bytes, not characters */
+#define CFM_RDS_MAX_AF   25
+
+/* What a call to cfm_rds_decoder_feed() changed. */
+typedef enum {
+	CFM_RDS_CHANGED_PI  = 1 << 0,
+	CFM_RDS_CHANGED_PTY = 1 << 1,
+	CFM_RDS_CHANGED_PS  = 1 << 2,
+	CFM_RDS_CHANGED_RT  = 1 << 3,
+	CFM_RDS_CHANGED_CT  = 1 << 4,
+	CFM_RDS_CHANGED_AF  = 1 << 5,
+	CFM_RDS_CHANGED_RTPLUS = 1 << 6, /* artist or title */
+	CFM_RDS_CHANGED_ERT = 1 << 7
+} CFmRdsChanged;
+
+/* Decodes groups as they come in without allocating; meant to be embedded
+ * wherever it is used. PS and RT are in ps.text and rt.text, nul terminated
+ * and still in the RDS character set, see rds_decode(). */
+typedef struct {
+	/* Group being assembled */
+	guint16 block[4];
+	guint8 have;       /* Mask of the blocks received so far */
+	guint8 next;       /* Block expected next */
+
+	guint16 pi;        /* 0 until confirmed */
+	guint16 pi_candidate;
+	guint8 pty;
+	gboolean tp;
+
+	CFmRdsText ps;
+	CFmRdsText rt;
+	gint8 rt_ab;       /* Text A/B flag, -1 before the first one */
+	gboolean rt_b;     /* Received as 2B, 32 characters at most */
+	gboolean rt_stale; /* A new text was started but is not confirmed yet */
+
+	/* RadioText Plus: parts of the RadioText tagged as artist and title,
+	 * as start and length in rt.text, length 0 when not tagged. */
+	guint8 rtplus_group; /* Group type code carrying the tags, 0 if none */
+	gint8 rtplus_toggle; /* Item toggle, -1 before the first tags */
+	guint8 rtplus_artist[2], rtplus_title[2];
+	gchar artist[CFM_RDS_RT_LEN + 1];
+	gchar title[CFM_RDS_RT_LEN + 1];
+
+	/* Enhanced RadioText, in UTF-8 or UCS-2 as announced, so ert.text_len
+	 * bytes long; see rds_decode_charset_to(). */
+	guint8 ert_group;    /* Group type code carrying it, 0 if none */
+	gboolean ert_utf8;
+	CFmRdsText ert;
+
+	gboolean has_ct;
+	guint32 ct_mjd;    /* Modified Julian Day, UTC */
+	guint8 ct_hour, ct_minute;
+	gint8 ct_offset;   /* Local time offset, in half hours */
+
+	gulong af[CFM_RDS_MAX_AF];
+	guint n_af;
+
+	/* Statistics */
+	guint blocks, errors, groups, sync_lost;
+} CFmRdsDecoder;
+
+void cfm_rds_decoder_init(CFmRdsDecoder *d);
+void cfm_rds_decoder_reset(CFmRdsDecoder *d);
+guint cfm_rds_decoder_feed(CFmRdsDecoder *d, const guint8 *data, gsize len);
+guint cfm_rds_decoder_feed_group(CFmRdsDecoder *d, const guint16 block[4]);
+
+#endif /* _CFM_RDS_DECODER_H_ */
@@ -0,0 +1,117 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "rds_text.h"
+
+/* On a marginal signal some corrupt blocks still pass the checks, and
+ * drivers that assemble text themselves hand out whatever they have so
+ * far. Every position keeps the last character received there and how many
+ * times in a row it was; a text is only published, as a whole, once each of
+ * its positions, and its length, has been received the same way
+ * CFM_RDS_TEXT_VOTES times. Until then the previous text stays. */
+
+#define LEN_MASK(len) ((len) >= 64 ? G_MAXUINT64 : (G_GUINT64_CONSTANT(1) << (len)) - 1)
+
+void cfm_rds_text_init(CFmRdsText *t, guint len)
+{
+	cfm_rds_text_restart(t, len);
+	t->text[0] = '\0';
+	t->text_len = 0;
+}
+
+/* Whether the length and every position up to it have enough votes. */
+static gboolean cfm_rds_text_complete(const CFmRdsText *t)
+{
+	guint w;
+
+	if (t->len_votes < CFM_RDS_TEXT_VOTES) return FALSE;
+	for (w = 0; w * 64 < t->len; w++) {
+		const guint64 want = LEN_MASK(t->len - w * 64);
+		if ((t->confirmed[w] & want) != want) return FALSE;
+	}
+	return TRUE;
+}
+
+/* Forgets the votes, e.g. when the station signals a new RadioText, but
+ * keeps showing the last text until the next one is confirmed. */
+void cfm_rds_text_restart(CFmRdsText *t, guint len)
+{
+	memset(t->votes, 0, sizeof(t->votes));
+	memset(t->confirmed, 0, sizeof(t->confirmed));
+	t->len = MIN(len, CFM_RDS_TEXT_MAX);
+	t->len_votes = CFM_RDS_TEXT_VOTES;
+}
+
+/* Counts a length received for the text, e.g. from its end marker. */
+void cfm_rds_text_set_len(CFmRdsText *t, guint len)
+{
+	len = MIN(len, CFM_RDS_TEXT_MAX);
+	if (len == t->len) {
+		if (t->len_votes < CFM_RDS_TEXT_VOTES) t->len_votes++;
+	} else {
+		t->len = len;
+		t->len_votes = 1;
+	}
+}
+
+static gboolean cfm_rds_text_publish(CFmRdsText *t)
+{
+	if (t->len == 0 || !cfm_rds_text_complete(t)) {
+		return FALSE;
+	}
+	if (t->len == t->text_len && memcmp(t->text, t->cand, t->len) == 0) {
+		return FALSE;
+	}
+
+	memcpy(t->text, t->cand, t->len);
+	t->text[t->len] = '\0';
+	t->text_len = t->len;
+	return TRUE;
+}
+
+/* Counts n characters received starting at pos. Returns TRUE if that
+ * completed a different text, now in t->text. */
+gboolean cfm_rds_text_vote(CFmRdsText *t, guint pos, const gchar *chars, guint n)
+{
+	guint i;
+
+	for (i = 0; i < n && pos + i < CFM_RDS_TEXT_MAX; i++) {
+		const guint p = pos + i;
+		const guint64 bit = G_GUINT64_CONSTANT(1) << (p % 64);
+
+		if (t->votes[p] && t->cand[p] == chars[i]) {
+			if (t->votes[p] < CFM_RDS_TEXT_VOTES) t->votes[p]++;
+		} else {
+			t->cand[p] = chars[i];
+			t->votes[p] = 1;
+		}
+
+		if (t->votes[p] >= CFM_RDS_TEXT_VOTES) {
+			t->confirmed[p / 64] |= bit;
+		} else {
+			t->confirmed[p / 64] &= ~bit;
+		}
+	}
+
+	return cfm_rds_text_publish(t);
+}
+
+/* For drivers that hand out the whole text at once. */
+gboolean cfm_rds_text_vote_string(CFmRdsText *t, const gchar *s, guint n)
+{
+	if (n == 0) {
+		return FALSE; /* Nothing received yet, or lost; keep what we had */
+	}
+	cfm_rds_text_set_len(t, n);
+	return cfm_rds_text_vote(t, 0, s, n);
+}
+
+/* Whether a text is being received that is not confirmed yet. */
+gboolean cfm_rds_text_pending(const CFmRdsText *t)
+{
+	return t->len > 0 && !cfm_rds_text_complete(t);
+}
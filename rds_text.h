@@ -0,0 +1,33 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_RDS_TEXT_H_
+#define _CFM_RDS_TEXT_H_
+
+#include <glib.h>
+
+#define CFM_RDS_TEXT_MAX    128 /* Enhanced RadioText; RT is 64 */
+#define CFM_RDS_TEXT_VOTES  2  /* Times a character has to be received */
+
+/* Puts together a PS or RadioText from characters received repeatedly at
+ * each position, and only publishes it once every position agrees with
+ * itself. Embedded in its owner; nothing is allocated. */
+typedef struct {
+	guint8 len;        /* Characters expected */
+	guint8 len_votes;
+	gchar cand[CFM_RDS_TEXT_MAX];
+	guint8 votes[CFM_RDS_TEXT_MAX];
+	guint64 confirmed[CFM_RDS_TEXT_MAX / 64]; /* Positions with enough votes */
+	gchar text[CFM_RDS_TEXT_MAX + 1]; /* Last published, nul terminated */
+	guint8 text_len;   /* Of text, which may hold nuls in UCS-2 */
+} CFmRdsText;
+
+void cfm_rds_text_init(CFmRdsText *t, guint len);
+void cfm_rds_text_restart(CFmRdsText *t, guint len);
+void cfm_rds_text_set_len(CFmRdsText *t, guint len);
+gboolean cfm_rds_text_vote(CFmRdsText *t, guint pos, const gchar *chars, guint n);
+gboolean cfm_rds_text_vote_string(CFmRdsText *t, const gchar *s, guint n);
+gboolean cfm_rds_text_pending(const CFmRdsText *t);
+
+#endif /* _CFM_RDS_TEXT_H_ */
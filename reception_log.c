@@ -0,0 +1,389 @@
+/*
+ * GPL 2
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "reception_log.h"
+
+/* An append only time series of what the tuner received. The log file is
+ * a LogHeader followed by fixed size LogRecords, little endian, in the order
+ * they were written. Next to it, "<file>.idx" holds the time of the first
+ * record of every block of LOG_BLOCK_RECORDS records, so that a query can
+ * binary search the small index and then map only the tail of the log it
+ * needs. Once the log would grow past its maximum size, it and its index
+ * are renamed to "<file>.1" and "<file>.1.idx", replacing the previous
+ * ones, and a new log is started. */
+
+#define LOG_MAGIC    0x4c4d4643 /* "CFML" */
+#define LOG_VERSION  1
+
+#define LOG_BLOCK_RECORDS  256  /* One 4 KiB page of records */
+#define LOG_BUFFER_SIZE    4096
+
+#define RECORD_STEREO  (1 << 0)
+
+typedef struct {
+	guint32 magic;
+	guint16 version;
+	guint16 record_size;
+	guint32 block_records;
+	guint32 reserved;
+} LogHeader;
+
+typedef struct {
+	guint32 time;
+	guint32 freq;
+	guint16 signal;
+	guint16 pi;
+	guint8 flags;
+	guint8 reserved[3];
+} LogRecord;
+
+struct _CFmReceptionLog {
+	gchar *file, *index_file;
+	gsize max_size;
+	FILE *f, *idx;
+	guint32 count; /* Records in the current file */
+	guint32 last_time;
+};
+
+static gchar* cfm_reception_log_index_name(const gchar *file)
+{
+	return g_strconcat(file, ".idx", NULL);
+}
+
+static gboolean cfm_reception_log_header_ok(const LogHeader *h)
+{
+	return GUINT32_FROM_LE(h->magic) == LOG_MAGIC &&
+	       GUINT16_FROM_LE(h->version) == LOG_VERSION &&
+	       GUINT16_FROM_LE(h->record_size) == sizeof(LogRecord) &&
+	       GUINT32_FROM_LE(h->block_records) == LOG_BLOCK_RECORDS;
+}
+
+static gboolean cfm_reception_log_read_time(FILE *f, guint32 index, guint32 *time)
+{
+	LogRecord r;
+	if (fseek(f, sizeof(LogHeader) + (long) index * sizeof(LogRecord), SEEK_SET) != 0 ||
+	    fread(&r, sizeof(r), 1, f) != 1) {
+		return FALSE;
+	}
+	*time = GUINT32_FROM_LE(r.time);
+	return TRUE;
+}
+
+/* Regenerates the index when it does not match the log, e.g. because the
+ * program died before it was flushed. */
+static void cfm_reception_log_check_index(CFmReceptionLog *log)
+{
+	const guint32 blocks = (log->count + LOG_BLOCK_RECORDS - 1) / LOG_BLOCK_RECORDS;
+	struct stat st;
+	guint32 i, time;
+
+	if (fstat(fileno(log->idx), &st) == 0 && st.st_size == blocks * sizeof(guint32)) {
+		return;
+	}
+
+	g_debug("Rebuilding reception log index %s\n", log->index_file);
+	if (ftruncate(fileno(log->idx), 0) != 0) {
+		g_warning("Failed to truncate %s: %s\n", log->index_file, g_strerror(errno));
+	}
+	rewind(log->idx);
+	for (i = 0; i < blocks; i++) {
+		if (!cfm_reception_log_read_time(log->f, i * LOG_BLOCK_RECORDS, &time)) break;
+		time = GUINT32_TO_LE(time);
+		fwrite(&time, sizeof(time), 1, log->idx);
+	}
+}
+
+static gboolean cfm_reception_log_start(CFmReceptionLog *log)
+{
+	LogHeader h;
+	struct stat st;
+
+	log->count = 0;
+	log->last_time = 0;
+
+	log->f = g_fopen(log->file, "r+b");
+	if (log->f) {
+		setvbuf(log->f, NULL, _IOFBF, LOG_BUFFER_SIZE);
+		if (fread(&h, sizeof(h), 1, log->f) != 1 || !cfm_reception_log_header_ok(&h)) {
+			g_warning("Discarding unknown reception log %s\n", log->file);
+			fclose(log->f);
+			log->f = NULL;
+		}
+	}
+
+	if (log->f) {
+		fstat(fileno(log->f), &st);
+		log->count = (st.st_size - sizeof(LogHeader)) / sizeof(LogRecord);
+		/* Drop a record that was only partially written. */
+		if (st.st_size != sizeof(LogHeader) + log->count * sizeof(LogRecord) &&
+		    ftruncate(fileno(log->f), sizeof(LogHeader) + log->count * sizeof(LogRecord)) != 0) {
+			g_warning("Failed to truncate %s: %s\n", log->file, g_strerror(errno));
+		}
+		if (log->count > 0) {
+			cfm_reception_log_read_time(log->f, log->count - 1, &log->last_time);
+		}
+		log->idx = g_fopen(log->index_file, "r+b");
+	} else {
+		log->f = g_fopen(log->file, "w+b");
+		if (!log->f) {
+			g_warning("Failed to create reception log %s: %s\n",
+				log->file, g_strerror(errno));
+			return FALSE;
+		}
+		setvbuf(log->f, NULL, _IOFBF, LOG_BUFFER_SIZE);
+		h.magic = GUINT32_TO_LE(LOG_MAGIC);
+		h.version = GUINT16_TO_LE(LOG_VERSION);
+		h.record_size = GUINT16_TO_LE(sizeof(LogRecord));
+		h.block_records = GUINT32_TO_LE(LOG_BLOCK_RECORDS);
+		h.reserved = 0;
+		fwrite(&h, sizeof(h), 1, log->f);
+	}
+
+	if (!log->idx) {
+		log->idx = g_fopen(log->index_file, "w+b");
+		if (!log->idx) {
+			g_warning("Failed to create reception log index %s: %s\n",
+				log->index_file, g_strerror(errno));
+			fclose(log->f);
+			log->f = NULL;
+			return FALSE;
+		}
+	}
+	cfm_reception_log_check_index(log);
+
+	fseek(log->f, 0, SEEK_END);
+	fseek(log->idx, 0, SEEK_END);
+
+	return TRUE;
+}
+
+static void cfm_reception_log_stop(CFmReceptionLog *log)
+{
+	if (log->f) {
+		fclose(log->f);
+		log->f = NULL;
+	}
+	if (log->idx) {
+		fclose(log->idx);
+		log->idx = NULL;
+	}
+}
+
+static void cfm_reception_log_rotate(CFmReceptionLog *log)
+{
+	gchar *old_file = g_strconcat(log->file, ".1", NULL);
+	gchar *old_index = cfm_reception_log_index_name(old_file);
+	const guint32 last_time = log->last_time;
+
+	cfm_reception_log_stop(log);
+	g_rename(log->file, old_file);
+	g_rename(log->index_file, old_index);
+	g_free(old_file);
+	g_free(old_index);
+
+	g_debug("Rotated reception log %s\n", log->file);
+	cfm_reception_log_start(log);
+	log->last_time = last_time;
+}
+
+/* Appends to "file" if it already is a reception log. */
+CFmReceptionLog* cfm_reception_log_open(const gchar *file, gsize max_size)
+{
+	CFmReceptionLog *log;
+	gchar *dir;
+
+	g_return_val_if_fail(max_size > sizeof(LogHeader) + sizeof(LogRecord), NULL);
+
+	dir = g_path_get_dirname(file);
+	g_mkdir_with_parents(dir, 0755);
+	g_free(dir);
+
+	log = g_slice_new0(CFmReceptionLog);
+	log->file = g_strdup(file);
+	log->index_file = cfm_reception_log_index_name(file);
+	log->max_size = max_size;
+
+	if (!cfm_reception_log_start(log)) {
+		cfm_reception_log_close(log);
+		return NULL;
+	}
+
+	return log;
+}
+
+void cfm_reception_log_close(CFmReceptionLog *log)
+{
+	if (!log) return;
+	cfm_reception_log_stop(log);
+	g_free(log->file);
+	g_free(log->index_file);
+	g_slice_free(CFmReceptionLog, log);
+}
+
+/* Only writes to the stdio buffers; they reach the disk every
+ * LOG_BUFFER_SIZE bytes or on cfm_reception_log_flush(). */
+void cfm_reception_log_append(CFmReceptionLog *log, const CFmReceptionRecord *rec)
+{
+	LogRecord r;
+	guint32 time;
+
+	if (sizeof(LogHeader) + (log->count + 1) * sizeof(LogRecord) > log->max_size) {
+		cfm_reception_log_rotate(log);
+	}
+	if (!log->f) return;
+
+	/* Queries rely on time never going backwards within a log. */
+	time = MAX(rec->time, log->last_time);
+
+	if (log->count % LOG_BLOCK_RECORDS == 0) {
+		guint32 t = GUINT32_TO_LE(time);
+		fwrite(&t, sizeof(t), 1, log->idx);
+	}
+
+	r.time = GUINT32_TO_LE(time);
+	r.freq = GUINT32_TO_LE(rec->freq);
+	r.signal = GUINT16_TO_LE(rec->signal);
+	r.pi = GUINT16_TO_LE(rec->pi);
+	r.flags = rec->stereo ? RECORD_STEREO : 0;
+	memset(r.reserved, 0, sizeof(r.reserved));
+
+	if (fwrite(&r, sizeof(r), 1, log->f) != 1) {
+		g_warning("Failed to write reception log, stopping\n");
+		cfm_reception_log_stop(log);
+		return;
+	}
+
+	log->count++;
+	log->last_time = time;
+}
+
+void cfm_reception_log_flush(CFmReceptionLog *log)
+{
+	if (!log->f) return;
+	fflush(log->f);
+	fflush(log->idx);
+}
+
+/* Returns the first block that may contain records at or after "from". */
+static guint32 cfm_reception_log_find_block(const gchar *file, guint32 from)
+{
+	gchar *index_file = cfm_reception_log_index_name(file);
+	gchar *data;
+	gsize len;
+	const guint32 *times;
+	guint32 lo, hi;
+
+	if (!g_file_get_contents(index_file, &data, &len, NULL)) {
+		g_free(index_file);
+		return 0; /* Scan the whole log then */
+	}
+	g_free(index_file);
+
+	/* Last block starting at or before "from". */
+	times = (const guint32*) data;
+	lo = 0;
+	hi = len / sizeof(guint32);
+	while (hi - lo > 1) {
+		guint32 mid = lo + (hi - lo) / 2;
+		if (GUINT32_FROM_LE(times[mid]) <= from) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	g_free(data);
+	return lo;
+}
+
+static gboolean cfm_reception_log_query_file(const gchar *file,
+	guint32 from, guint32 to, CFmReceptionLogFunc func, gpointer user_data,
+	guint *n)
+{
+	const long page = sysconf(_SC_PAGESIZE);
+	gboolean more = TRUE;
+	LogHeader h;
+	struct stat st;
+	guint32 count, start, i;
+	off_t offset, map_offset;
+	size_t map_len;
+	guint8 *map;
+	const LogRecord *r;
+	int fd;
+
+	fd = g_open(file, O_RDONLY, 0);
+	if (fd == -1) return TRUE;
+
+	if (fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+	    !cfm_reception_log_header_ok(&h)) {
+		close(fd);
+		return TRUE;
+	}
+
+	count = (st.st_size - sizeof(LogHeader)) / sizeof(LogRecord);
+	start = cfm_reception_log_find_block(file, from) * LOG_BLOCK_RECORDS;
+	if (start >= count) {
+		close(fd);
+		return TRUE;
+	}
+
+	offset = sizeof(LogHeader) + (off_t) start * sizeof(LogRecord);
+	map_offset = offset - offset % page;
+	map_len = sizeof(LogHeader) + (off_t) count * sizeof(LogRecord) - map_offset;
+	map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, map_offset);
+	close(fd);
+	if (map == MAP_FAILED) {
+		g_warning("Failed to map reception log %s: %s\n", file, g_strerror(errno));
+		return TRUE;
+	}
+	madvise(map, map_len, MADV_SEQUENTIAL);
+
+	r = (const LogRecord*) (map + (offset - map_offset));
+	for (i = start; i < count && more; i++, r++) {
+		CFmReceptionRecord rec;
+		rec.time = GUINT32_FROM_LE(r->time);
+		if (rec.time < from) continue;
+		if (rec.time > to) {
+			more = FALSE;
+			break;
+		}
+		rec.freq = GUINT32_FROM_LE(r->freq);
+		rec.signal = GUINT16_FROM_LE(r->signal);
+		rec.pi = GUINT16_FROM_LE(r->pi);
+		rec.stereo = (r->flags & RECORD_STEREO) ? TRUE : FALSE;
+		(*n)++;
+		more = func(&rec, user_data);
+	}
+
+	munmap(map, map_len);
+	return more;
+}
+
+/* Calls "func" for every record logged between "from" and "to", both
+ * inclusive, oldest first, including those in the rotated out log. Only the
+ * pages holding the requested window are read. Returns the number of
+ * records passed to "func". */
+guint cfm_reception_log_query(const gchar *file, guint32 from, guint32 to,
+	CFmReceptionLogFunc func, gpointer user_data)
+{
+	gchar *old_file = g_strconcat(file, ".1", NULL);
+	guint n = 0;
+
+	if (cfm_reception_log_query_file(old_file, from, to, func, user_data, &n)) {
+		cfm_reception_log_query_file(file, from, to, func, user_data, &n);
+	}
+
+	g_free(old_file);
+	return n;
+}
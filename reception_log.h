@@ -0,0 +1,31 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_RECEPTION_LOG_H_
+#define _CFM_RECEPTION_LOG_H_
+
+#include <glib.h>
+
+typedef struct _CFmReceptionLog CFmReceptionLog;
+
+typedef struct {
+	guint32 time;   /* Seconds since the epoch */
+	gulong freq;
+	guint16 signal;
+	guint16 pi;     /* 0 if none was received */
+	gboolean stereo;
+} CFmReceptionRecord;
+
+/* Return FALSE to stop the query early. */
+typedef gboolean (*CFmReceptionLogFunc)(const CFmReceptionRecord *rec, gpointer user_data);
+
+CFmReceptionLog* cfm_reception_log_open(const gchar *file, gsize max_size);
+void cfm_reception_log_close(CFmReceptionLog *log);
+void cfm_reception_log_append(CFmReceptionLog *log, const CFmReceptionRecord *rec);
+void cfm_reception_log_flush(CFmReceptionLog *log);
+
+guint cfm_reception_log_query(const gchar *file, guint32 from, guint32 to,
+	CFmReceptionLogFunc func, gpointer user_data);
+
+#endif /* _CFM_RECEPTION_LOG_H_ */
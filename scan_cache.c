@@ -0,0 +1,322 @@
+/*
+ * GPL 2
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "scan_cache.h"
+
+#define CACHE_MAGIC    0x534d4643 /* "CFMS" */
+#define CACHE_VERSION  3
+
+#define ENTRY_STATION    (1 << 0)
+#define ENTRY_HARVESTED  (1 << 1) /* Listened to for RDS, pi is 0 if none */
+
+/* On disk everything is little endian: a header followed by one entry per
+ * channel of the grid, lowest frequency first. */
+typedef struct {
+	guint32 magic;
+	guint16 version;
+	guint16 entry_size;
+	guint32 range_low;
+	guint32 range_high;
+	guint32 step;
+	guint32 count;
+} CacheHeader;
+
+typedef struct {
+	guint16 signal;
+	guint16 flags;
+	guint32 last_seen; /* Seconds since the epoch, 0 if never measured. */
+	guint16 stddev;    /* Of the samples the signal is the mean of */
+	guint16 samples;
+	guint16 pi;
+	guint8 pty;
+	guint8 reserved;
+	gchar ps[CFM_SCAN_CACHE_PS_LEN]; /* In UTF-8, nul terminated */
+} CacheEntry;
+
+struct _CFmScanCache {
+	gchar *file;
+	gulong range_low, range_high;
+	gulong first, step;
+	guint count;
+	CacheEntry *entries;
+	gboolean dirty;
+};
+
+static gchar* cfm_scan_cache_build_filename(const CFmBandPlan *plan,
+	gulong range_low, gulong range_high)
+{
+	gchar name[64];
+	g_snprintf(name, sizeof(name), "scan-%s-%lu-%lu.bin", plan->id,
+		range_low, range_high);
+	return g_build_filename(g_get_user_cache_dir(), "cfmradio", name, NULL);
+}
+
+static void cfm_scan_cache_load(CFmScanCache *cache)
+{
+	gchar *data;
+	gsize len;
+	const CacheHeader *h;
+	const CacheEntry *e;
+	guint i;
+
+	if (!g_file_get_contents(cache->file, &data, &len, NULL)) {
+		return; /* No cache yet */
+	}
+
+	h = (const CacheHeader*) data;
+	if (len < sizeof(CacheHeader) ||
+	    GUINT32_FROM_LE(h->magic) != CACHE_MAGIC ||
+	    GUINT16_FROM_LE(h->version) != CACHE_VERSION ||
+	    GUINT16_FROM_LE(h->entry_size) != sizeof(CacheEntry) ||
+	    GUINT32_FROM_LE(h->range_low) != cache->range_low ||
+	    GUINT32_FROM_LE(h->range_high) != cache->range_high ||
+	    GUINT32_FROM_LE(h->step) != cache->step ||
+	    GUINT32_FROM_LE(h->count) != cache->count ||
+	    len < sizeof(CacheHeader) + cache->count * sizeof(CacheEntry)) {
+		g_debug("Ignoring stale scan cache %s\n", cache->file);
+		g_free(data);
+		return;
+	}
+
+	e = (const CacheEntry*) (data + sizeof(CacheHeader));
+	for (i = 0; i < cache->count; i++) {
+		cache->entries[i].signal = GUINT16_FROM_LE(e[i].signal);
+		cache->entries[i].flags = GUINT16_FROM_LE(e[i].flags);
+		cache->entries[i].last_seen = GUINT32_FROM_LE(e[i].last_seen);
+		cache->entries[i].stddev = GUINT16_FROM_LE(e[i].stddev);
+		cache->entries[i].samples = GUINT16_FROM_LE(e[i].samples);
+		cache->entries[i].pi = GUINT16_FROM_LE(e[i].pi);
+		cache->entries[i].pty = e[i].pty;
+		memcpy(cache->entries[i].ps, e[i].ps, sizeof(e[i].ps));
+		cache->entries[i].ps[CFM_SCAN_CACHE_PS_LEN - 1] = '\0';
+	}
+
+	g_free(data);
+}
+
+/* One entry per channel of the plan that falls within the tuner range. */
+CFmScanCache* cfm_scan_cache_open(const CFmBandPlan *plan,
+	gulong range_low, gulong range_high)
+{
+	CFmScanCache *cache;
+	guint first, last;
+
+	g_return_val_if_fail(range_high > range_low, NULL);
+	if (!cfm_band_plan_clip(plan, range_low, range_high, &first, &last)) {
+		g_warning("Band plan %s is outside the tuner range\n", plan->id);
+		return NULL;
+	}
+
+	cache = g_slice_new0(CFmScanCache);
+	cache->file = cfm_scan_cache_build_filename(plan, range_low, range_high);
+	cache->range_low = range_low;
+	cache->range_high = range_high;
+	cache->step = plan->spacing;
+	cache->first = cfm_band_plan_channel(plan, first);
+	cache->count = last - first + 1;
+	cache->entries = g_new0(CacheEntry, cache->count);
+
+	cfm_scan_cache_load(cache);
+
+	return cache;
+}
+
+void cfm_scan_cache_free(CFmScanCache *cache)
+{
+	if (!cache) return;
+	g_free(cache->file);
+	g_free(cache->entries);
+	g_slice_free(CFmScanCache, cache);
+}
+
+gboolean cfm_scan_cache_save(CFmScanCache *cache)
+{
+	GError *error = NULL;
+	gsize len = sizeof(CacheHeader) + cache->count * sizeof(CacheEntry);
+	gchar *data, *dir;
+	CacheHeader *h;
+	CacheEntry *e;
+	gboolean ok;
+	guint i;
+
+	if (!cache->dirty) return TRUE;
+
+	data = g_malloc(len);
+	h = (CacheHeader*) data;
+	h->magic = GUINT32_TO_LE(CACHE_MAGIC);
+	h->version = GUINT16_TO_LE(CACHE_VERSION);
+	h->entry_size = GUINT16_TO_LE(sizeof(CacheEntry));
+	h->range_low = GUINT32_TO_LE(cache->range_low);
+	h->range_high = GUINT32_TO_LE(cache->range_high);
+	h->step = GUINT32_TO_LE(cache->step);
+	h->count = GUINT32_TO_LE(cache->count);
+
+	e = (CacheEntry*) (data + sizeof(CacheHeader));
+	for (i = 0; i < cache->count; i++) {
+		e[i].signal = GUINT16_TO_LE(cache->entries[i].signal);
+		e[i].flags = GUINT16_TO_LE(cache->entries[i].flags);
+		e[i].last_seen = GUINT32_TO_LE(cache->entries[i].last_seen);
+		e[i].stddev = GUINT16_TO_LE(cache->entries[i].stddev);
+		e[i].samples = GUINT16_TO_LE(cache->entries[i].samples);
+		e[i].pi = GUINT16_TO_LE(cache->entries[i].pi);
+		e[i].pty = cache->entries[i].pty;
+		e[i].reserved = 0;
+		memcpy(e[i].ps, cache->entries[i].ps, sizeof(e[i].ps));
+	}
+
+	dir = g_path_get_dirname(cache->file);
+	g_mkdir_with_parents(dir, 0755);
+	g_free(dir);
+
+	ok = g_file_set_contents(cache->file, data, len, &error);
+	if (!ok) {
+		g_warning("Failed to store scan cache: %s\n", error->message);
+		g_error_free(error);
+	} else {
+		cache->dirty = FALSE;
+	}
+
+	g_free(data);
+	return ok;
+}
+
+gboolean cfm_scan_cache_is_empty(CFmScanCache *cache)
+{
+	guint i;
+	for (i = 0; i < cache->count; i++) {
+		if (cache->entries[i].last_seen) return FALSE;
+	}
+	return TRUE;
+}
+
+static gint cfm_scan_cache_index(CFmScanCache *cache, gulong freq)
+{
+	gulong i;
+	if (freq + cache->step / 2 < cache->first) return -1;
+	i = (freq + cache->step / 2 - cache->first) / cache->step;
+	return i < cache->count ? (gint) i : -1;
+}
+
+/* Whether freq is on a channel of the band plan the tuner can reach. */
+gboolean cfm_scan_cache_has_channel(CFmScanCache *cache, gulong freq)
+{
+	return cfm_scan_cache_index(cache, freq) >= 0;
+}
+
+/* What was harvested from a station stays until it is gone. */
+void cfm_scan_cache_update(CFmScanCache *cache, gulong freq, guint signal, gboolean station)
+{
+	gint i = cfm_scan_cache_index(cache, freq);
+	g_return_if_fail(i >= 0);
+
+	cache->entries[i].signal = MIN(signal, G_MAXUINT16);
+	if (station) {
+		cache->entries[i].flags |= ENTRY_STATION;
+	} else {
+		cache->entries[i].flags = 0;
+		cache->entries[i].pi = 0;
+		cache->entries[i].pty = 0;
+		cache->entries[i].ps[0] = '\0';
+	}
+	cache->entries[i].last_seen = time(NULL);
+	cache->entries[i].stddev = 0;
+	cache->entries[i].samples = 1;
+	cache->dirty = TRUE;
+}
+
+void cfm_scan_cache_update_stats(CFmScanCache *cache, gulong freq,
+	const CFmDwellStats *stats, gboolean station)
+{
+	gint i = cfm_scan_cache_index(cache, freq);
+	g_return_if_fail(i >= 0);
+
+	cfm_scan_cache_update(cache, freq, lrint(stats->mean), station);
+	cache->entries[i].stddev = MIN(lrint(cfm_dwell_stats_stddev(stats)), G_MAXUINT16);
+	cache->entries[i].samples = MIN(stats->n, G_MAXUINT16);
+}
+
+/* Returns whether freq was last seen carrying a station. */
+gboolean cfm_scan_cache_get_stats(CFmScanCache *cache, gulong freq,
+	guint *signal, guint *stddev, guint *samples)
+{
+	gint i = cfm_scan_cache_index(cache, freq);
+	const CacheEntry *e;
+	g_return_val_if_fail(i >= 0, FALSE);
+
+	e = &cache->entries[i];
+	if (signal) *signal = e->signal;
+	if (stddev) *stddev = e->stddev;
+	if (samples) *samples = e->samples;
+	return (e->flags & ENTRY_STATION) ? TRUE : FALSE;
+}
+
+/* Stores what a station sent while the scan listened to it: pi 0 and an
+ * empty ps if nothing. */
+void cfm_scan_cache_update_rds(CFmScanCache *cache, gulong freq,
+	guint16 pi, guint8 pty, const gchar *ps)
+{
+	gint i = cfm_scan_cache_index(cache, freq);
+	g_return_if_fail(i >= 0);
+
+	cache->entries[i].flags |= ENTRY_HARVESTED;
+	cache->entries[i].pi = pi;
+	cache->entries[i].pty = pty;
+	g_strlcpy(cache->entries[i].ps, ps, sizeof(cache->entries[i].ps));
+	cache->dirty = TRUE;
+}
+
+/* Returns whether freq was listened to for RDS since it was last found
+ * empty; ps must hold CFM_SCAN_CACHE_PS_LEN bytes. */
+gboolean cfm_scan_cache_get_rds(CFmScanCache *cache, gulong freq,
+	guint16 *pi, guint8 *pty, gchar *ps)
+{
+	gint i = cfm_scan_cache_index(cache, freq);
+	const CacheEntry *e;
+	g_return_val_if_fail(i >= 0, FALSE);
+
+	e = &cache->entries[i];
+	if (pi) *pi = e->pi;
+	if (pty) *pty = e->pty;
+	if (ps) memcpy(ps, e->ps, CFM_SCAN_CACHE_PS_LEN);
+	return (e->flags & ENTRY_HARVESTED) ? TRUE : FALSE;
+}
+
+/* Marks every channel in [from, to) as measured with no station, which is
+ * what a hardware seek tells us about the channels it skipped over. */
+void cfm_scan_cache_update_range(CFmScanCache *cache, gulong from, gulong to, guint signal)
+{
+	gulong freq;
+	for (freq = from; freq < to; freq += cache->step) {
+		gint i = cfm_scan_cache_index(cache, freq);
+		if (i >= 0) {
+			cfm_scan_cache_update(cache, freq, signal, FALSE);
+			cache->entries[i].samples = 0; /* Only seeked over */
+		}
+	}
+}
+
+/* Returns the channels an incremental rescan should revisit: every known
+ * station plus every channel not measured within the last max_age seconds. */
+gulong* cfm_scan_cache_get_rescan_list(CFmScanCache *cache, guint max_age, guint *len)
+{
+	const guint32 now = time(NULL);
+	gulong *list = g_new(gulong, cache->count);
+	guint i, n = 0;
+
+	for (i = 0; i < cache->count; i++) {
+		const CacheEntry *e = &cache->entries[i];
+		if ((e->flags & ENTRY_STATION) || e->last_seen + max_age < now) {
+			list[n++] = cache->first + i * cache->step;
+		}
+	}
+
+	*len = n;
+	return list;
+}
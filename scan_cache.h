@@ -0,0 +1,39 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_SCAN_CACHE_H_
+#define _CFM_SCAN_CACHE_H_
+
+#include <glib.h>
+
+#include "band.h"
+#include "dwell.h"
+
+/* Room for a PS of 8 characters converted to UTF-8, and the nul */
+#define CFM_SCAN_CACHE_PS_LEN 32
+
+typedef struct _CFmScanCache CFmScanCache;
+
+CFmScanCache* cfm_scan_cache_open(const CFmBandPlan *plan,
+	gulong range_low, gulong range_high);
+void cfm_scan_cache_free(CFmScanCache *cache);
+gboolean cfm_scan_cache_save(CFmScanCache *cache);
+
+gboolean cfm_scan_cache_is_empty(CFmScanCache *cache);
+gboolean cfm_scan_cache_has_channel(CFmScanCache *cache, gulong freq);
+void cfm_scan_cache_update(CFmScanCache *cache, gulong freq, guint signal, gboolean station);
+void cfm_scan_cache_update_stats(CFmScanCache *cache, gulong freq,
+	const CFmDwellStats *stats, gboolean station);
+void cfm_scan_cache_update_range(CFmScanCache *cache, gulong from, gulong to, guint signal);
+void cfm_scan_cache_update_rds(CFmScanCache *cache, gulong freq,
+	guint16 pi, guint8 pty, const gchar *ps);
+
+gboolean cfm_scan_cache_get_stats(CFmScanCache *cache, gulong freq,
+	guint *signal, guint *stddev, guint *samples);
+gboolean cfm_scan_cache_get_rds(CFmScanCache *cache, gulong freq,
+	guint16 *pi, guint8 *pty, gchar *ps);
+
+gulong* cfm_scan_cache_get_rescan_list(CFmScanCache *cache, guint max_age, guint *len);
+
+#endif /* _CFM_SCAN_CACHE_H_ */
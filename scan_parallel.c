@@ -0,0 +1,247 @@
+/*
+ * GPL 2
+ */
+
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+
+#include "scan_parallel.h"
+#include "tuner_backend.h"
+
+/* Splits the band into one sub-band per receiver and seeks through all of
+ * them at once, one thread per receiver. Each thread only ever touches its
+ * own backend and its own result array; the main loop merges them when the
+ * last one is done. */
+
+typedef struct {
+	CFmParallelScan *scan;
+	CFmTunerBackend *backend;
+	gulong low, high;
+	GArray *stations;
+	GThread *thread;
+} ScanWorker;
+
+struct _CFmParallelScan {
+	CFmParallelScanFunc func;
+	gpointer user_data;
+	const CFmBandPlan *plan;
+	CFmDwellConfig dwell;
+	gulong range_low, range_high;
+
+	ScanWorker *workers;
+	guint n_workers;
+
+	volatile gint pending;
+	volatile gint cancelled;
+	guint idle;
+};
+
+static void scan_worker_add(ScanWorker *w, gulong freq)
+{
+	const CFmDwellConfig *dwell = &w->scan->dwell;
+	CFmDwellResult result = CFM_DWELL_UNDECIDED;
+	CFmDwellStats stats;
+	CFmTunerStatus status;
+	CFmSpectrumPoint p;
+	guint stereo = 0;
+
+	cfm_dwell_stats_reset(&stats);
+	while (result == CFM_DWELL_UNDECIDED) {
+		g_usleep(dwell->interval_ms * 1000);
+		if (!cfm_tuner_backend_get_status(w->backend, &status)) return;
+		cfm_dwell_stats_add(&stats, status.signal);
+		if (status.stereo) stereo++;
+		result = cfm_dwell_decide(dwell, &stats);
+	}
+	if (result != CFM_DWELL_STATION) return;
+
+	p.freq = freq;
+	p.signal = MIN(lrint(stats.mean), G_MAXUINT16);
+	p.stereo = stereo * 2 > stats.n;
+	g_array_append_val(w->stations, p);
+}
+
+static gboolean cfm_parallel_scan_done(gpointer data);
+
+static gpointer scan_worker_run(gpointer data)
+{
+	ScanWorker *w = data;
+	CFmParallelScan *scan = w->scan;
+	const gulong step = scan->plan->spacing;
+	gulong freq, prev = 0;
+
+	/* Start one channel early so a station right on the edge is not
+	 * skipped by the first seek. */
+	freq = w->low > scan->range_low ? w->low - step : w->low;
+	if (w->low <= w->high) {
+		cfm_tuner_backend_tune(w->backend, freq);
+		if (freq == scan->range_low) {
+			scan_worker_add(w, freq);
+		}
+	}
+
+	while (w->low <= w->high && !g_atomic_int_get(&scan->cancelled)) {
+		if (!cfm_tuner_backend_seek(w->backend, TRUE)) break;
+		freq = cfm_tuner_backend_get_frequency(w->backend);
+		if (freq <= prev || freq > w->high) break;
+		if (freq >= w->low) {
+			scan_worker_add(w, freq);
+		}
+		if (freq + step > w->high) break;
+		prev = freq;
+	}
+
+	if (g_atomic_int_dec_and_test(&scan->pending)) {
+		scan->idle = g_idle_add(cfm_parallel_scan_done, scan);
+	}
+
+	return NULL;
+}
+
+static void cfm_parallel_scan_join(CFmParallelScan *scan)
+{
+	guint i;
+	for (i = 0; i < scan->n_workers; i++) {
+		ScanWorker *w = &scan->workers[i];
+		if (w->thread) {
+			g_thread_join(w->thread);
+			w->thread = NULL;
+		}
+	}
+}
+
+static void cfm_parallel_scan_free(CFmParallelScan *scan)
+{
+	guint i;
+	for (i = 0; i < scan->n_workers; i++) {
+		ScanWorker *w = &scan->workers[i];
+		cfm_tuner_backend_free(w->backend);
+		if (w->stations) g_array_free(w->stations, TRUE);
+	}
+	g_free(scan->workers);
+	g_slice_free(CFmParallelScan, scan);
+}
+
+static gboolean cfm_parallel_scan_done(gpointer data)
+{
+	CFmParallelScan *scan = data;
+	GArray *all;
+	guint i;
+
+	cfm_parallel_scan_join(scan);
+	scan->idle = 0;
+
+	/* Sub-bands are disjoint, in ascending order, and each one was seeked
+	 * upwards, so concatenating them already gives a sorted list. */
+	all = g_array_new(FALSE, FALSE, sizeof(CFmSpectrumPoint));
+	for (i = 0; i < scan->n_workers; i++) {
+		GArray *s = scan->workers[i].stations;
+		g_array_append_vals(all, s->data, s->len);
+	}
+
+	scan->func(scan, (CFmSpectrumPoint*) all->data, all->len,
+		scan->range_low, scan->range_high, scan->user_data);
+
+	g_array_free(all, TRUE);
+	cfm_parallel_scan_free(scan);
+
+	return FALSE;
+}
+
+/** Opens every device with the given backend and starts scanning.
+ *  Devices that fail to open are skipped; returns NULL if none could be
+ *  opened. The scan frees itself after calling func. */
+CFmParallelScan* cfm_parallel_scan_start(const gchar *backend,
+	gchar **devices, const CFmBandPlan *plan, const CFmDwellConfig *dwell,
+	CFmParallelScanFunc func, gpointer user_data)
+{
+	CFmParallelScan *scan;
+	guint i, n = 0, n_devices, first, last, width;
+	gulong low = 0, high = G_MAXULONG;
+
+	g_return_val_if_fail(devices != NULL && func != NULL, NULL);
+
+	g_return_val_if_fail(g_thread_supported(), NULL);
+
+	n_devices = g_strv_length(devices);
+	scan = g_slice_new0(CFmParallelScan);
+	scan->func = func;
+	scan->user_data = user_data;
+	scan->plan = plan;
+	scan->dwell = *dwell;
+	scan->workers = g_new0(ScanWorker, n_devices);
+
+	for (i = 0; i < n_devices; i++) {
+		CFmTunerBackend *b = cfm_tuner_backend_new(backend);
+		if (!b) break;
+		if (!cfm_tuner_backend_open(b, devices[i])) {
+			g_warning("Skipping scan tuner %s\n", devices[i]);
+			cfm_tuner_backend_free(b);
+			continue;
+		}
+		cfm_tuner_backend_power(b, FALSE);
+		/* Only scan what every receiver can tune to. */
+		low = MAX(low, b->range_low);
+		high = MIN(high, b->range_high);
+		scan->workers[n++].backend = b;
+	}
+	scan->n_workers = n;
+
+	if (n == 0 || high <= low ||
+	    !cfm_band_plan_clip(plan, low, high, &first, &last)) {
+		cfm_parallel_scan_free(scan);
+		return NULL;
+	}
+
+	scan->range_low = cfm_band_plan_channel(plan, first);
+	scan->range_high = cfm_band_plan_channel(plan, last);
+
+	/* Sub-band edges are kept on the channel grid. */
+	width = (last - first + n) / n;
+	for (i = 0; i < n; i++) {
+		ScanWorker *w = &scan->workers[i];
+		guint lo = first + i * width;
+		w->scan = scan;
+		w->low = cfm_band_plan_channel(plan, lo);
+		w->high = cfm_band_plan_channel(plan, MIN(lo + width - 1, last));
+		w->stations = g_array_new(FALSE, FALSE, sizeof(CFmSpectrumPoint));
+	}
+
+	g_debug("Parallel scan of %lu-%lu on %u tuners\n",
+		scan->range_low, scan->range_high, n);
+
+	scan->pending = n;
+	for (i = 0; i < n; i++) {
+		ScanWorker *w = &scan->workers[i];
+		GError *error = NULL;
+		w->thread = g_thread_create(scan_worker_run, w, TRUE, &error);
+		if (!w->thread) {
+			g_warning("Failed to start scan thread: %s\n", error->message);
+			g_error_free(error);
+			if (g_atomic_int_dec_and_test(&scan->pending)) {
+				scan->idle = g_idle_add(cfm_parallel_scan_done, scan);
+			}
+		}
+	}
+
+	return scan;
+}
+
+/** Stops every worker and frees the scan without calling func.
+ *  Must not be used once func has been called. */
+void cfm_parallel_scan_cancel(CFmParallelScan *scan)
+{
+	g_atomic_int_set(&scan->cancelled, TRUE);
+	/* Waits for the seek each worker might be in the middle of. */
+	cfm_parallel_scan_join(scan);
+	if (scan->idle) {
+		g_source_remove(scan->idle);
+	}
+	cfm_parallel_scan_free(scan);
+}
+
+guint cfm_parallel_scan_get_n_workers(CFmParallelScan *scan)
+{
+	return scan->n_workers;
+}
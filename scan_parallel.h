@@ -0,0 +1,28 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_SCAN_PARALLEL_H_
+#define _CFM_SCAN_PARALLEL_H_
+
+#include <glib.h>
+
+#include "types.h"
+#include "band.h"
+#include "dwell.h"
+
+typedef struct _CFmParallelScan CFmParallelScan;
+
+/** Called from the main loop once every worker is done.
+ *  stations is sorted by frequency and only valid during the call. */
+typedef void (*CFmParallelScanFunc)(CFmParallelScan *scan,
+	const CFmSpectrumPoint *stations, guint len,
+	gulong range_low, gulong range_high, gpointer user_data);
+
+CFmParallelScan* cfm_parallel_scan_start(const gchar *backend,
+	gchar **devices, const CFmBandPlan *plan, const CFmDwellConfig *dwell,
+	CFmParallelScanFunc func, gpointer user_data);
+void cfm_parallel_scan_cancel(CFmParallelScan *scan);
+guint cfm_parallel_scan_get_n_workers(CFmParallelScan *scan);
+
+#endif /* _CFM_SCAN_PARALLEL_H_ */
@@ -0,0 +1,153 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "station_db.h"
+#include "station_db_format.h"
+
+/* The file is mapped as it is and searched in place, so opening it costs
+ * the same however many stations it holds. */
+
+struct _CFmStationDb {
+	GMappedFile *file;
+	const StationDbEntry *by_pi;
+	const StationDbEntry *by_freq;
+	guint count;
+	const gchar *names;
+	guint32 names_size;
+};
+
+CFmStationDb* cfm_station_db_open(const gchar *file)
+{
+	GError *error = NULL;
+	GMappedFile *mapped;
+	const StationDbHeader *h;
+	const gchar *data;
+	gsize len, count, names_size;
+	CFmStationDb *db;
+
+	mapped = g_mapped_file_new(file, FALSE, &error);
+	if (!mapped) {
+		g_debug("No station database: %s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	data = g_mapped_file_get_contents(mapped);
+	len = g_mapped_file_get_length(mapped);
+	h = (const StationDbHeader*) data;
+	if (len < sizeof(StationDbHeader) ||
+	    GUINT32_FROM_LE(h->magic) != STATION_DB_MAGIC ||
+	    GUINT16_FROM_LE(h->version) != STATION_DB_VERSION ||
+	    GUINT16_FROM_LE(h->entry_size) != sizeof(StationDbEntry)) {
+		g_warning("%s is not a station database\n", file);
+		g_mapped_file_free(mapped);
+		return NULL;
+	}
+
+	count = GUINT32_FROM_LE(h->count);
+	names_size = GUINT32_FROM_LE(h->names_size);
+	if (count > (len - sizeof(StationDbHeader)) / (2 * sizeof(StationDbEntry)) ||
+	    names_size == 0 ||
+	    len != sizeof(StationDbHeader) + 2 * count * sizeof(StationDbEntry) + names_size ||
+	    data[len - 1] != '\0') {
+		g_warning("Station database %s is truncated\n", file);
+		g_mapped_file_free(mapped);
+		return NULL;
+	}
+
+	db = g_slice_new(CFmStationDb);
+	db->file = mapped;
+	db->count = count;
+	db->by_pi = (const StationDbEntry*) (data + sizeof(StationDbHeader));
+	db->by_freq = db->by_pi + count;
+	db->names = (const gchar*) (db->by_freq + count);
+	db->names_size = names_size;
+
+	return db;
+}
+
+void cfm_station_db_free(CFmStationDb *db)
+{
+	g_mapped_file_free(db->file);
+	g_slice_free(CFmStationDb, db);
+}
+
+static const gchar* cfm_station_db_name(CFmStationDb *db, const StationDbEntry *e)
+{
+	const guint32 name = GUINT32_FROM_LE(e->name);
+	return name < db->names_size ? db->names + name : NULL;
+}
+
+static guint16 cfm_station_db_freq(gulong freq)
+{
+	return MIN((freq + STATION_DB_FREQ_UNIT / 2) / STATION_DB_FREQ_UNIT, G_MAXUINT16);
+}
+
+/* Index of the first entry whose first sort key is not below "key". */
+static guint cfm_station_db_lower_bound(const StationDbEntry *entries, guint count,
+	guint16 key, gboolean by_pi)
+{
+	guint lo = 0, hi = count;
+	while (lo < hi) {
+		const guint mid = lo + (hi - lo) / 2;
+		const guint16 k = GUINT16_FROM_LE(by_pi ? entries[mid].pi : entries[mid].freq);
+		if (k < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* The name of the station with this PI, preferring the entry closest to
+ * "freq", as the same PI may be listed with different names per region. */
+const gchar* cfm_station_db_lookup_pi(CFmStationDb *db, guint16 pi, gulong freq)
+{
+	const guint16 f = cfm_station_db_freq(freq);
+	const StationDbEntry *best = NULL;
+	guint best_dist = G_MAXUINT;
+	guint i;
+
+	g_return_val_if_fail(db != NULL, NULL);
+	if (!pi) return NULL;
+
+	i = cfm_station_db_lower_bound(db->by_pi, db->count, pi, TRUE);
+	for (; i < db->count && GUINT16_FROM_LE(db->by_pi[i].pi) == pi; i++) {
+		const guint16 ef = GUINT16_FROM_LE(db->by_pi[i].freq);
+		const guint dist = ef ? ABS((gint) ef - (gint) f) : G_MAXUINT - 1;
+		if (dist < best_dist) {
+			best = &db->by_pi[i];
+			best_dist = dist;
+		}
+	}
+
+	return best ? cfm_station_db_name(db, best) : NULL;
+}
+
+/* The name of the station on "freq", only if every entry for it agrees:
+ * without a PI there is no telling apart stations sharing a frequency. */
+const gchar* cfm_station_db_lookup_freq(CFmStationDb *db, gulong freq)
+{
+	const guint16 f = cfm_station_db_freq(freq);
+	guint32 name = G_MAXUINT32;
+	guint i;
+
+	g_return_val_if_fail(db != NULL, NULL);
+	if (!f) return NULL;
+
+	i = cfm_station_db_lower_bound(db->by_freq, db->count, f, FALSE);
+	for (; i < db->count && GUINT16_FROM_LE(db->by_freq[i].freq) == f; i++) {
+		const guint32 n = GUINT32_FROM_LE(db->by_freq[i].name);
+		if (name != G_MAXUINT32 && n != name) {
+			return NULL;
+		}
+		name = n;
+	}
+
+	return name != G_MAXUINT32 ? cfm_station_db_name(db, &db->by_freq[i - 1]) : NULL;
+}
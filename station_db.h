@@ -0,0 +1,21 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_STATION_DB_H_
+#define _CFM_STATION_DB_H_
+
+#include <glib.h>
+
+/* A read only list of known stations, built by data/make-station-db from a
+ * CSV file, that names a station before its RDS PS has been received. */
+
+typedef struct _CFmStationDb CFmStationDb;
+
+CFmStationDb* cfm_station_db_open(const gchar *file);
+void cfm_station_db_free(CFmStationDb *db);
+
+const gchar* cfm_station_db_lookup_pi(CFmStationDb *db, guint16 pi, gulong freq);
+const gchar* cfm_station_db_lookup_freq(CFmStationDb *db, gulong freq);
+
+#endif /* _CFM_STATION_DB_H_ */
@@ -0,0 +1,34 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_STATION_DB_FORMAT_H_
+#define _CFM_STATION_DB_FORMAT_H_
+
+#include <glib.h>
+
+/* Shared by station_db.c and data/make-station-db.c. Everything is little
+ * endian: a header, the entries sorted by PI and then frequency, the same
+ * entries again sorted by frequency and then PI, and finally the names,
+ * each ending in a NUL, the last byte of the file included. Identical names
+ * are only stored once. */
+
+#define STATION_DB_MAGIC    0x444d4643 /* "CFMD" */
+#define STATION_DB_VERSION  1
+#define STATION_DB_FREQ_UNIT 10000     /* Hz */
+
+typedef struct {
+	guint32 magic;
+	guint16 version;
+	guint16 entry_size;
+	guint32 count;
+	guint32 names_size;
+} StationDbHeader;
+
+typedef struct {
+	guint16 pi;    /* 0 if not known */
+	guint16 freq;  /* In STATION_DB_FREQ_UNIT, 0 if not known */
+	guint32 name;  /* Offset into the names */
+} StationDbEntry;
+
+#endif /* _CFM_STATION_DB_FORMAT_H_ */
@@ -0,0 +1,69 @@
+/*
+ * GPL 2
+ */
+
+#include <glib.h>
+
+#include "stereo_control.h"
+
+/* Exponential smoothing factor per sample. */
+#define SMOOTHING        0.25
+
+/* Stereo is dropped below the lower thresholds and only brought back above
+ * the higher ones, so a signal hovering around one value does not flap. */
+#define MONO_RSSI        0.20
+#define MONO_PILOT       0.40
+#define STEREO_RSSI      0.30
+#define STEREO_PILOT     0.80
+
+/* Minimum time between two switches. */
+#define HOLD_MS          3000
+/* Time given to a freshly tuned station before deciding anything. */
+#define SETTLE_MS        1000
+
+void cfm_stereo_control_init(CFmStereoControl *c, gint64 now)
+{
+	c->stereo = TRUE;
+	cfm_stereo_control_reset(c, now);
+}
+
+/* Forgets the history, e.g. after tuning somewhere else, but keeps the
+ * current decision until enough new samples have been seen. */
+void cfm_stereo_control_reset(CFmStereoControl *c, gint64 now)
+{
+	c->primed = FALSE;
+	c->rssi = 0.0;
+	c->pilot = 0.0;
+	c->last_switch = now - HOLD_MS + SETTLE_MS;
+}
+
+/* Returns TRUE if c->stereo changed. */
+gboolean cfm_stereo_control_feed(CFmStereoControl *c, guint signal,
+	gboolean pilot, gint64 now)
+{
+	const gdouble rssi = signal / 65535.0;
+	gboolean want;
+
+	if (c->primed) {
+		c->rssi += SMOOTHING * (rssi - c->rssi);
+		c->pilot += SMOOTHING * ((pilot ? 1.0 : 0.0) - c->pilot);
+	} else {
+		c->rssi = rssi;
+		c->pilot = pilot ? 1.0 : 0.0;
+		c->primed = TRUE;
+	}
+
+	if (c->stereo) {
+		want = !(c->rssi < MONO_RSSI || c->pilot < MONO_PILOT);
+	} else {
+		want = c->rssi > STEREO_RSSI && c->pilot > STEREO_PILOT;
+	}
+
+	if (want == c->stereo || now - c->last_switch < HOLD_MS) {
+		return FALSE;
+	}
+
+	c->stereo = want;
+	c->last_switch = now;
+	return TRUE;
+}
@@ -0,0 +1,25 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_STEREO_CONTROL_H_
+#define _CFM_STEREO_CONTROL_H_
+
+#include <glib.h>
+
+/* Decides whether the tuner should decode stereo or fall back to mono from
+ * a stream of signal strength / stereo pilot samples. */
+typedef struct {
+	gboolean stereo;
+	gboolean primed;
+	gdouble rssi;   /* Smoothed, 0 to 1 */
+	gdouble pilot;  /* Smoothed fraction of samples with a pilot */
+	gint64 last_switch; /* ms */
+} CFmStereoControl;
+
+void cfm_stereo_control_init(CFmStereoControl *c, gint64 now);
+void cfm_stereo_control_reset(CFmStereoControl *c, gint64 now);
+gboolean cfm_stereo_control_feed(CFmStereoControl *c, guint signal,
+	gboolean pilot, gint64 now);
+
+#endif /* _CFM_STEREO_CONTROL_H_ */
@@ -8,6 +8,7 @@
 #include <cairo.h>
 
 #include "tuner.h"
+#include "band.h"
 
 G_DEFINE_TYPE(CFmTuner, cfm_tuner, GTK_TYPE_DRAWING_AREA);
 
@@ -17,13 +18,18 @@ G_DEFINE_TYPE(CFmTuner, cfm_tuner, GTK_TYPE_DRAWING_AREA);
 #define ABS_RANGE_HIGH 140000000
 
 #define SCALE_TENTH_MHZ_PIXELS 15.0
+#define SCALE_HZ_PIXELS (SCALE_TENTH_MHZ_PIXELS / 100000.0)
 #define LABELS_FONT_SPEC "Nokia Sans 18"
+#define SPECTRUM_BAR_WIDTH 9.0
 
 struct _CFmTunerPrivate {
 	gulong range_low, range_high;
 	gulong freq;
+	const CFmBandPlan *band;
 	gboolean dragging;
 	gdouble drag_start_x;
+	CFmSpectrumPoint *spectrum;
+	guint spectrum_len;
 };
 
 enum {
@@ -31,6 +37,7 @@ enum {
 	PROP_FREQUENCY,
 	PROP_RANGE_LOW,
 	PROP_RANGE_HIGH,
+	PROP_BAND,
 	PROP_LAST
 };
 
@@ -44,45 +51,85 @@ enum {
 static GParamSpec *properties[PROP_LAST];
 static guint signals[SIGNAL_LAST];
 
-static void cfm_tuner_draw(CFmTuner *self, cairo_t *cr)
+static inline double cfm_tuner_freq_to_x(CFmTuner *self, double w, gulong freq)
+{
+	const double offset = (double)freq - (double)self->priv->freq;
+	return w / 2 + offset * SCALE_HZ_PIXELS;
+}
+
+static void cfm_tuner_draw_spectrum(CFmTuner *self, cairo_t *cr)
 {
+	CFmTunerPrivate *priv = self->priv;
 	const GtkAllocation *size = &( GTK_WIDGET(self)->allocation );
 	const double w = size->width, h = size->height;
-	const double midx = w / 2;
-	const double cur_f = self->priv->freq / 100000.0; // Tenths of a Mhz
-	const double left_f = cur_f - (midx / SCALE_TENTH_MHZ_PIXELS);
+	const double top = 0.3 * h;
+	guint i;
+
+	for (i = 0; i < priv->spectrum_len; i++) {
+		const CFmSpectrumPoint *p = &priv->spectrum[i];
+		const double x = cfm_tuner_freq_to_x(self, w, p->freq);
+		double bar_h;
+		if (p->signal == 0) continue;
+		if (x < -SPECTRUM_BAR_WIDTH || x > w + SPECTRUM_BAR_WIDTH) continue;
+		bar_h = (h - top) * (p->signal / 65535.0);
+		if (p->stereo) {
+			cairo_set_source_rgba(cr, 0.2, 0.8, 0.2, 0.6);
+		} else {
+			cairo_set_source_rgba(cr, 0.9, 0.7, 0.1, 0.6);
+		}
+		cairo_rectangle(cr, x - SPECTRUM_BAR_WIDTH / 2, h - bar_h,
+			SPECTRUM_BAR_WIDTH, bar_h);
+		cairo_fill(cr);
+	}
+}
 
-	double left_f_int;
-	double left_f_frac = modf(left_f, &left_f_int);
+static void cfm_tuner_draw(CFmTuner *self, cairo_t *cr)
+{
+	CFmTunerPrivate *priv = self->priv;
+	const CFmBandPlan *band = priv->band;
+	const GtkAllocation *size = &( GTK_WIDGET(self)->allocation );
+	const double w = size->width, h = size->height;
+	const double half_span = (w / 2) / SCALE_HZ_PIXELS;
+	const double left_f = MAX(priv->freq - half_span, 0.0);
+	const double right_f = priv->freq + half_span;
 
 	static gchar text[12];
 	PangoLayout *layout = pango_cairo_create_layout(cr);
 	PangoFontDescription *desc = pango_font_description_from_string(LABELS_FONT_SPEC);
-	double x = (1.0 - left_f_frac) * SCALE_TENTH_MHZ_PIXELS;
-	gulong f = left_f_int + 1;
+	gulong mhz;
+	guint i;
+	cfm_tuner_draw_spectrum(self, cr);
 	cairo_set_source_rgb(cr, 1, 1, 1);
 	pango_layout_set_font_description(layout, desc);
 	pango_font_description_free(desc);
-	while (x <= w) {
-		if (f % 10 == 0) {
-			gint tw, th;
-			sprintf(text, "%lu", f / 10);
-			pango_layout_set_text(layout, text, -1);
-			pango_cairo_update_layout(cr, layout);
-			pango_layout_get_size(layout, &tw, &th);
-			cairo_move_to(cr, x - (tw / (PANGO_SCALE * 2)), 0.0);
-			pango_cairo_show_layout(cr, layout);
-			cairo_move_to(cr, x, 0.3 * h);
-			cairo_line_to(cr, x, 0.7 * h);
-		} else {
-			cairo_move_to(cr, x, 0.4 * h);
-			cairo_line_to(cr, x, 0.55 * h);
-		}
+
+	/* A short tick on every channel of the band plan... */
+	for (i = cfm_band_plan_index(band, left_f); i < band->count; i++) {
+		const gulong f = cfm_band_plan_channel(band, i);
+		const double x = cfm_tuner_freq_to_x(self, w, f);
+		if (f > right_f) break;
+		if (f % 1000000 == 0) continue;
+		cairo_move_to(cr, x, 0.4 * h);
+		cairo_line_to(cr, x, 0.55 * h);
 		cairo_stroke(cr);
-		x += SCALE_TENTH_MHZ_PIXELS;
-		f += 1;
 	}
 
+	/* ...and a long, labelled one on every whole MHz. */
+	for (mhz = ceil(left_f / 1000000.0); mhz * 1000000.0 <= right_f; mhz++) {
+		const double x = cfm_tuner_freq_to_x(self, w, mhz * 1000000);
+		gint tw, th;
+		sprintf(text, "%lu", mhz);
+		pango_layout_set_text(layout, text, -1);
+		pango_cairo_update_layout(cr, layout);
+		pango_layout_get_size(layout, &tw, &th);
+		cairo_move_to(cr, x - (tw / (PANGO_SCALE * 2)), 0.0);
+		pango_cairo_show_layout(cr, layout);
+		cairo_move_to(cr, x, 0.3 * h);
+		cairo_line_to(cr, x, 0.7 * h);
+		cairo_stroke(cr);
+	}
+
+	g_object_unref(layout);
 
 	cairo_set_source_rgb(cr, 1, 0, 0);
 	cairo_move_to(cr, w / 2, 0.25 * h);
@@ -97,6 +144,23 @@ static void cfm_tuner_redraw(CFmTuner *tuner)
 	gdk_window_invalidate_region(window, region, TRUE);
 }
 
+static void cfm_tuner_redraw_point(CFmTuner *tuner, const CFmSpectrumPoint *p)
+{
+	GtkWidget *widget = GTK_WIDGET(tuner);
+	const GtkAllocation *size = &widget->allocation;
+	const double x = cfm_tuner_freq_to_x(tuner, size->width, p->freq);
+	GdkRectangle rect;
+
+	if (!gtk_widget_get_window(widget)) return;
+	if (x < -SPECTRUM_BAR_WIDTH || x > size->width + SPECTRUM_BAR_WIDTH) return;
+
+	rect.x = floor(x - SPECTRUM_BAR_WIDTH / 2) - 1;
+	rect.y = 0;
+	rect.width = SPECTRUM_BAR_WIDTH + 2;
+	rect.height = size->height;
+	gdk_window_invalidate_rect(gtk_widget_get_window(widget), &rect, FALSE);
+}
+
 static void cfm_tuner_realize(GtkWidget *widget)
 {
 	GTK_WIDGET_CLASS(cfm_tuner_parent_class)->realize(widget);
@@ -124,7 +188,7 @@ static gboolean cfm_tuner_button_release(GtkWidget *widget, GdkEventButton *even
 
 	if (priv->dragging) {
 		priv->dragging = FALSE;
-		priv->freq = lrint(priv->freq / 100000.0) * 100000; /* Round it. */
+		priv->freq = cfm_band_plan_round(priv->band, priv->freq);
 		cfm_tuner_redraw(self);
 		g_signal_emit(G_OBJECT(self), signals[SIGNAL_FREQUENCY_TUNED], 0, NULL);
 	}
@@ -138,8 +202,8 @@ static gboolean cfm_tuner_motion_notify(GtkWidget *widget, GdkEventMotion *event
 	CFmTunerPrivate *priv = self->priv;
 
 	if (priv->dragging) {
-		gdouble moved = (priv->drag_start_x - event->x) / SCALE_TENTH_MHZ_PIXELS;
-		priv->freq += moved * 100000.0;
+		gdouble moved = (priv->drag_start_x - event->x) / SCALE_HZ_PIXELS;
+		priv->freq += moved;
 		if (priv->freq < priv->range_low) {
 			priv->freq = priv->range_low;
 		} else if (priv->freq > priv->range_high) {
@@ -190,6 +254,13 @@ static void cfm_tuner_set_property(GObject *object, guint property_id,
 		self->priv->range_high = g_value_get_ulong(value);
 		cfm_tuner_redraw(self);
 		break;
+	case PROP_BAND: {
+		const CFmBandPlan *band = cfm_band_plan_get(g_value_get_string(value));
+		g_return_if_fail(band != NULL);
+		self->priv->band = band;
+		cfm_tuner_redraw(self);
+		break;
+	}
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
 		break;
@@ -210,6 +281,9 @@ static void cfm_tuner_get_property(GObject *object, guint property_id,
 	case PROP_RANGE_HIGH:
 		g_value_set_ulong(value, self->priv->range_high);
 		break;
+	case PROP_BAND:
+		g_value_set_string(value, self->priv->band->id);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
 		break;
@@ -221,6 +295,7 @@ static void cfm_tuner_init(CFmTuner *self)
 	CFmTunerPrivate *priv;
 
 	self->priv = priv = CFM_TUNER_GET_PRIVATE(self);
+	priv->band = cfm_band_plan_get_default();
 }
 
 static void cfm_tuner_dispose(GObject *object)
@@ -229,6 +304,8 @@ static void cfm_tuner_dispose(GObject *object)
 
 static void cfm_tuner_finalize(GObject *object)
 {
+	CFmTuner *self = CFM_TUNER(object);
+	g_free(self->priv->spectrum);
 }
 
 static void cfm_tuner_class_init(CFmTunerClass *klass)
@@ -274,6 +351,14 @@ static void cfm_tuner_class_init(CFmTunerClass *klass)
 	properties[PROP_RANGE_HIGH] = param_spec;
 	g_object_class_install_property(gobject_class, PROP_RANGE_HIGH, param_spec);
 
+	param_spec = g_param_spec_string("band",
+	                                 "Band plan",
+	                                 "Channel grid drawn on the scale and snapped to",
+	                                 CFM_BAND_PLAN_DEFAULT,
+	                                 G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+	properties[PROP_BAND] = param_spec;
+	g_object_class_install_property(gobject_class, PROP_BAND, param_spec);
+
 	signals[SIGNAL_FREQUENCY_CHANGED] = g_signal_new("frequency-changed",
 		G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL, 
 		g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
@@ -287,3 +372,28 @@ CFmTuner* cfm_tuner_new()
 	return g_object_new(CFM_TYPE_TUNER, NULL);
 }
 
+
+void cfm_tuner_set_spectrum(CFmTuner *self, const CFmSpectrumPoint *points, guint len)
+{
+	CFmTunerPrivate *priv = self->priv;
+
+	g_free(priv->spectrum);
+	priv->spectrum = len ? g_memdup(points, len * sizeof(CFmSpectrumPoint)) : NULL;
+	priv->spectrum_len = len;
+
+	if (gtk_widget_get_window(GTK_WIDGET(self))) {
+		cfm_tuner_redraw(self);
+	}
+}
+
+/* Replaces a single point and only invalidates the column it is drawn at,
+ * so that a sweep in progress does not repaint the whole scale. */
+void cfm_tuner_update_spectrum(CFmTuner *self, guint index, const CFmSpectrumPoint *point)
+{
+	CFmTunerPrivate *priv = self->priv;
+
+	g_return_if_fail(index < priv->spectrum_len);
+
+	priv->spectrum[index] = *point;
+	cfm_tuner_redraw_point(self, point);
+}
@@ -7,6 +7,8 @@
 
 #include <gtk/gtk.h>
 
+#include "types.h"
+
 #define CFM_TYPE_TUNER                  (cfm_tuner_get_type ())
 #define CFM_TUNER(obj)                  (G_TYPE_CHECK_INSTANCE_CAST ((obj), CFM_TYPE_TUNER, CFmTuner))
 #define CFM_IS_TUNER(obj)               (G_TYPE_CHECK_INSTANCE_TYPE ((obj), CFM_TYPE_TUNER))
@@ -32,5 +34,8 @@ struct _CFmTunerClass
 GType cfm_tuner_get_type(void) G_GNUC_CONST;
 CFmTuner* cfm_tuner_new();
 
+void cfm_tuner_set_spectrum(CFmTuner *self, const CFmSpectrumPoint *points, guint len);
+void cfm_tuner_update_spectrum(CFmTuner *self, guint index, const CFmSpectrumPoint *point);
+
 #endif /* __CFM_TUNER_H__ */
 
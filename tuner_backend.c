@@ -0,0 +1,146 @@
+/*
+ * GPL 2
+ */
+
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "tuner_backend.h"
+
+gint64 cfm_monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+gint64 cfm_monotonic_ms(void)
+{
+	return cfm_monotonic_us() / 1000;
+}
+
+CFmTunerBackend* cfm_tuner_backend_new(const gchar *name)
+{
+	if (!name || strcmp(name, "v4l2") == 0) {
+		return cfm_tuner_v4l2_new();
+	} else if (strcmp(name, "sim") == 0) {
+		return cfm_tuner_sim_new();
+	} else if (strcmp(name, "replay") == 0) {
+		return cfm_tuner_replay_new();
+	}
+
+	g_warning("Unknown tuner backend '%s'\n", name);
+	return NULL;
+}
+
+void cfm_tuner_backend_free(CFmTunerBackend *b)
+{
+	if (!b) return;
+	cfm_tuner_backend_close(b);
+	b->ops->free(b);
+}
+
+gboolean cfm_tuner_backend_open(CFmTunerBackend *b, const gchar *device)
+{
+	g_return_val_if_fail(!b->is_open, FALSE);
+	b->is_open = b->ops->open(b, device);
+	if (b->is_open) {
+		g_debug("Tuner '%s' detected (from %lu to %lu)\n", b->ops->name,
+			b->range_low, b->range_high);
+	}
+	return b->is_open;
+}
+
+void cfm_tuner_backend_close(CFmTunerBackend *b)
+{
+	if (!b->is_open) return;
+	b->ops->close(b);
+	b->is_open = FALSE;
+}
+
+gboolean cfm_tuner_backend_is_open(CFmTunerBackend *b)
+{
+	return b && b->is_open;
+}
+
+gboolean cfm_tuner_backend_power(CFmTunerBackend *b, gboolean enable)
+{
+	g_return_val_if_fail(b->is_open, FALSE);
+	return b->ops->power(b, enable);
+}
+
+gboolean cfm_tuner_backend_tune(CFmTunerBackend *b, gulong freq)
+{
+	g_return_val_if_fail(b->is_open, FALSE);
+	return b->ops->tune(b, freq);
+}
+
+gulong cfm_tuner_backend_get_frequency(CFmTunerBackend *b)
+{
+	g_return_val_if_fail(b->is_open, 0);
+	return b->ops->get_frequency(b);
+}
+
+gboolean cfm_tuner_backend_seek(CFmTunerBackend *b, gboolean upward)
+{
+	g_return_val_if_fail(b->is_open, FALSE);
+	return b->ops->seek(b, upward);
+}
+
+gboolean cfm_tuner_backend_get_status(CFmTunerBackend *b, CFmTunerStatus *status)
+{
+	g_return_val_if_fail(b->is_open, FALSE);
+	return b->ops->get_status(b, status);
+}
+
+gchar* cfm_tuner_backend_read_rds(CFmTunerBackend *b, const gchar *key)
+{
+	g_return_val_if_fail(b->is_open, NULL);
+	return b->ops->read_rds(b, key);
+}
+
+/* Always leaves buf nul terminated; avoids allocating on backends that
+ * can read RDS straight into it. */
+gssize cfm_tuner_backend_read_rds_into(CFmTunerBackend *b, const gchar *key,
+	gchar *buf, gsize len)
+{
+	gchar *r;
+	gsize n;
+
+	g_return_val_if_fail(b->is_open && len > 0, -1);
+	if (b->ops->read_rds_into) {
+		return b->ops->read_rds_into(b, key, buf, len);
+	}
+
+	r = b->ops->read_rds(b, key);
+	if (!r) {
+		buf[0] = '\0';
+		return -1;
+	}
+	n = g_strlcpy(buf, r, len);
+	g_free(r);
+	return MIN(n, len - 1);
+}
+
+/* Returns -1 if the backend cannot tell when RDS changes; it then has to
+ * be polled. */
+int cfm_tuner_backend_get_rds_fd(CFmTunerBackend *b, const gchar *key)
+{
+	g_return_val_if_fail(b->is_open, -1);
+	return b->ops->get_rds_fd ? b->ops->get_rds_fd(b, key) : -1;
+}
+
+gssize cfm_tuner_backend_read_rds_blocks(CFmTunerBackend *b, guint8 *buf, gsize len)
+{
+	g_return_val_if_fail(b->is_open, -1);
+	return b->ops->read_rds_blocks ? b->ops->read_rds_blocks(b, buf, len) : -1;
+}
+
+/* Forces mono decoding when stereo is FALSE; the stereo flag reported by
+ * get_status keeps following the received pilot either way. */
+gboolean cfm_tuner_backend_set_audmode(CFmTunerBackend *b, gboolean stereo)
+{
+	g_return_val_if_fail(b->is_open, FALSE);
+	return b->ops->set_audmode(b, stereo);
+}
@@ -0,0 +1,84 @@
+/*
+ * GPL 2
+ */
+
+#ifndef _CFM_TUNER_BACKEND_H_
+#define _CFM_TUNER_BACKEND_H_
+
+#include <glib.h>
+
+typedef struct _CFmTunerBackend    CFmTunerBackend;
+typedef struct _CFmTunerBackendOps CFmTunerBackendOps;
+
+/* Pseudo RDS key for get_rds_fd(): the raw block stream instead of the
+ * decoded strings. */
+#define CFM_TUNER_RDS_BLOCKS "rds_blocks"
+
+typedef struct {
+	guint signal;     /* 0 (worse) to 65535 (best) */
+	gboolean stereo;  /* Stereo pilot detected */
+	gint afc;         /* Automatic frequency control offset, if known */
+} CFmTunerStatus;
+
+/* Everything CFmRadio needs from the hardware. Frequencies are always in Hz;
+ * converting to driver units is up to each implementation. All operations
+ * block until the hardware has completed them. */
+struct _CFmTunerBackendOps {
+	const gchar *name;
+	gboolean (*open)(CFmTunerBackend *b, const gchar *device);
+	void (*close)(CFmTunerBackend *b);
+	void (*free)(CFmTunerBackend *b);
+	gboolean (*power)(CFmTunerBackend *b, gboolean enable);
+	gboolean (*tune)(CFmTunerBackend *b, gulong freq);
+	gulong (*get_frequency)(CFmTunerBackend *b);
+	gboolean (*seek)(CFmTunerBackend *b, gboolean upward);
+	gboolean (*get_status)(CFmTunerBackend *b, CFmTunerStatus *status);
+	gchar* (*read_rds)(CFmTunerBackend *b, const gchar *key);
+	gboolean (*set_audmode)(CFmTunerBackend *b, gboolean stereo);
+	/* Optional: like read_rds, into a caller buffer; returns the length
+	 * read or -1. Falls back to read_rds when missing. */
+	gssize (*read_rds_into)(CFmTunerBackend *b, const gchar *key, gchar *buf, gsize len);
+	/* Optional: a descriptor that polls with POLLPRI once key changes. */
+	int (*get_rds_fd)(CFmTunerBackend *b, const gchar *key);
+	/* Optional: raw RDS blocks as in struct v4l2_rds_data, without
+	 * blocking; returns the bytes read, 0 if none are pending, or -1. */
+	gssize (*read_rds_blocks)(CFmTunerBackend *b, guint8 *buf, gsize len);
+};
+
+/* Implementations embed this as their first member. */
+struct _CFmTunerBackend {
+	const CFmTunerBackendOps *ops;
+	gboolean is_open;
+	gboolean precise;
+	gulong range_low, range_high;
+};
+
+CFmTunerBackend* cfm_tuner_backend_new(const gchar *name);
+CFmTunerBackend* cfm_tuner_v4l2_new(void);
+CFmTunerBackend* cfm_tuner_sim_new(void);
+CFmTunerBackend* cfm_tuner_replay_new(void);
+CFmTunerBackend* cfm_tuner_trace_new(CFmTunerBackend *inner, const gchar *file);
+
+void cfm_tuner_backend_free(CFmTunerBackend *b);
+
+gboolean cfm_tuner_backend_open(CFmTunerBackend *b, const gchar *device);
+void cfm_tuner_backend_close(CFmTunerBackend *b);
+gboolean cfm_tuner_backend_is_open(CFmTunerBackend *b);
+
+gboolean cfm_tuner_backend_power(CFmTunerBackend *b, gboolean enable);
+gboolean cfm_tuner_backend_tune(CFmTunerBackend *b, gulong freq);
+gulong cfm_tuner_backend_get_frequency(CFmTunerBackend *b);
+gboolean cfm_tuner_backend_seek(CFmTunerBackend *b, gboolean upward);
+gboolean cfm_tuner_backend_get_status(CFmTunerBackend *b, CFmTunerStatus *status);
+gchar* cfm_tuner_backend_read_rds(CFmTunerBackend *b, const gchar *key);
+gssize cfm_tuner_backend_read_rds_into(CFmTunerBackend *b, const gchar *key,
+	gchar *buf, gsize len);
+int cfm_tuner_backend_get_rds_fd(CFmTunerBackend *b, const gchar *key);
+gssize cfm_tuner_backend_read_rds_blocks(CFmTunerBackend *b, guint8 *buf, gsize len);
+gboolean cfm_tuner_backend_set_audmode(CFmTunerBackend *b, gboolean stereo);
+
+/* Monotonic time for timing tuner operations and deadlines. */
+gint64 cfm_monotonic_us(void);
+gint64 cfm_monotonic_ms(void);
+
+#endif /* _CFM_TUNER_BACKEND_H_ */
@@ -0,0 +1,255 @@
+/*
+ * GPL 2
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "tuner_backend.h"
+
+/* A simulated tuner with a fixed, deterministic band so that scanning, RDS
+ * and UI code can be exercised and timed on any machine. The "device" passed
+ * to open is a comma separated option list, e.g.
+ *   "tune=20,seek=250,status=2,rds=1,ps-delay=1200"
+ * where every value is a latency in milliseconds. */
+
+#define SIM_RANGE_LOW    87500000
+#define SIM_RANGE_HIGH  108000000
+#define SIM_SEEK_STEP      100000
+#define SIM_SEEK_THRESHOLD (65536 / 3)
+#define SIM_STATION_WIDTH  150000 /* Hz from the carrier until signal is gone */
+
+typedef struct {
+	gulong freq;
+	guint strength;
+	gboolean stereo;
+	const gchar *pi, *ps, *rt;
+} SimStation;
+
+static const SimStation sim_stations[] = {
+	{  88300000, 52000, TRUE,  "E211", "RNE 1   ", "Radio Nacional" },
+	{  90500000, 30000, FALSE, "E212", "RNE 5   ", "Todo noticias" },
+	{  93900000, 61000, TRUE,  "E2C1", "CADENA S", "Hoy por hoy" },
+	{  96100000, 18000, FALSE, "E2C5", "LOCAL FM", "" },
+	{  99800000, 58000, TRUE,  "E213", "RNE 3   ", "Siglo 21" },
+	{ 102700000, 44000, TRUE,  "E2D4", "KISS FM ", "Kiss FM - Solo exitos" },
+	{ 105400000, 25000, TRUE,  "E2E1", "ROCK FM ", "" },
+	{ 107300000, 63000, TRUE,  "E2C2", "40 PRINC", "Del 40 al 1" },
+};
+
+typedef struct {
+	CFmTunerBackend parent;
+	gboolean powered;
+	gulong freq;
+	gint64 tuned_at;  /* Monotonic ms */
+	guint lat_tune, lat_seek, lat_status, lat_rds;
+	guint ps_delay;
+} CFmTunerSim;
+
+static inline CFmTunerSim* SIM(CFmTunerBackend *b)
+{
+	return (CFmTunerSim*) b;
+}
+
+static void sim_sleep(guint ms)
+{
+	if (ms) g_usleep(ms * 1000);
+}
+
+/* A deterministic noise floor, so that empty channels are not all zero. */
+static guint sim_noise(gulong freq)
+{
+	guint32 h = freq / 1000;
+	h ^= h >> 13;
+	h *= 0x5bd1e995;
+	h ^= h >> 15;
+	return h % 4000;
+}
+
+static const SimStation* sim_station_at(gulong freq, guint *signal)
+{
+	const SimStation *best = NULL;
+	guint best_signal = sim_noise(freq);
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(sim_stations); i++) {
+		const SimStation *s = &sim_stations[i];
+		gulong d = freq > s->freq ? freq - s->freq : s->freq - freq;
+		guint sig;
+		if (d >= SIM_STATION_WIDTH) continue;
+		sig = s->strength * (SIM_STATION_WIDTH - d) / SIM_STATION_WIDTH;
+		if (sig > best_signal) {
+			best_signal = sig;
+			best = s;
+		}
+	}
+
+	*signal = best_signal;
+	return best;
+}
+
+static void sim_parse_options(CFmTunerSim *self, const gchar *options)
+{
+	gchar **opts, **o;
+
+	if (!options) return;
+
+	opts = g_strsplit(options, ",", 0);
+	for (o = opts; *o; o++) {
+		gchar *eq = strchr(*o, '=');
+		guint val;
+		if (!eq) continue;
+		*eq = '\0';
+		val = atoi(eq + 1);
+		if (strcmp(*o, "tune") == 0) self->lat_tune = val;
+		else if (strcmp(*o, "seek") == 0) self->lat_seek = val;
+		else if (strcmp(*o, "status") == 0) self->lat_status = val;
+		else if (strcmp(*o, "rds") == 0) self->lat_rds = val;
+		else if (strcmp(*o, "ps-delay") == 0) self->ps_delay = val;
+		else g_warning("Unknown simulated tuner option '%s'\n", *o);
+	}
+	g_strfreev(opts);
+}
+
+static gboolean cfm_tuner_sim_open(CFmTunerBackend *b, const gchar *device)
+{
+	CFmTunerSim *self = SIM(b);
+
+	sim_parse_options(self, device);
+
+	b->precise = TRUE;
+	b->range_low = SIM_RANGE_LOW;
+	b->range_high = SIM_RANGE_HIGH;
+	self->freq = SIM_RANGE_LOW;
+	self->tuned_at = cfm_monotonic_ms();
+
+	return TRUE;
+}
+
+static void cfm_tuner_sim_close(CFmTunerBackend *b)
+{
+	SIM(b)->powered = FALSE;
+}
+
+static void cfm_tuner_sim_free(CFmTunerBackend *b)
+{
+	g_slice_free(CFmTunerSim, SIM(b));
+}
+
+static gboolean cfm_tuner_sim_power(CFmTunerBackend *b, gboolean enable)
+{
+	SIM(b)->powered = enable;
+	return TRUE;
+}
+
+static gboolean cfm_tuner_sim_tune(CFmTunerBackend *b, gulong freq)
+{
+	CFmTunerSim *self = SIM(b);
+	g_return_val_if_fail(freq >= b->range_low && freq <= b->range_high, FALSE);
+	sim_sleep(self->lat_tune);
+	self->freq = freq;
+	self->tuned_at = cfm_monotonic_ms();
+	return TRUE;
+}
+
+static gulong cfm_tuner_sim_get_frequency(CFmTunerBackend *b)
+{
+	return SIM(b)->freq;
+}
+
+/* Like most hardware, stops at the band edge when nothing is found. */
+static gboolean cfm_tuner_sim_seek(CFmTunerBackend *b, gboolean upward)
+{
+	CFmTunerSim *self = SIM(b);
+	gulong freq = self->freq;
+	guint signal;
+
+	sim_sleep(self->lat_seek);
+
+	for (;;) {
+		if (upward) {
+			if (freq + SIM_SEEK_STEP > b->range_high) break;
+			freq += SIM_SEEK_STEP;
+		} else {
+			if (freq < b->range_low + SIM_SEEK_STEP) break;
+			freq -= SIM_SEEK_STEP;
+		}
+		sim_station_at(freq, &signal);
+		if (signal > SIM_SEEK_THRESHOLD) break;
+	}
+
+	self->freq = freq;
+	self->tuned_at = cfm_monotonic_ms();
+	return TRUE;
+}
+
+static gboolean cfm_tuner_sim_get_status(CFmTunerBackend *b, CFmTunerStatus *status)
+{
+	CFmTunerSim *self = SIM(b);
+	const SimStation *s;
+
+	sim_sleep(self->lat_status);
+
+	s = sim_station_at(self->freq, &status->signal);
+	status->stereo = s && s->stereo && status->signal > s->strength / 2;
+	status->afc = s ? ((glong) s->freq - (glong) self->freq) / 1000 : 0;
+
+	return TRUE;
+}
+
+static gchar* cfm_tuner_sim_read_rds(CFmTunerBackend *b, const gchar *key)
+{
+	CFmTunerSim *self = SIM(b);
+	const SimStation *s;
+	guint signal;
+
+	sim_sleep(self->lat_rds);
+
+	s = sim_station_at(self->freq, &signal);
+	if (!s || signal < s->strength / 2) {
+		return g_strdup("");
+	}
+
+	if (strcmp(key, "rds_pi") == 0) {
+		return g_strdup(s->pi);
+	} else if (cfm_monotonic_ms() - self->tuned_at < self->ps_delay) {
+		return g_strdup(""); /* Nothing received yet */
+	} else if (strcmp(key, "rds_ps") == 0) {
+		return g_strdup(s->ps);
+	} else if (strcmp(key, "rds_rt") == 0) {
+		return g_strdup(s->rt);
+	}
+
+	return NULL;
+}
+
+/* Forced mono only changes what is heard, which is not simulated; the
+ * stereo flag get_status reports keeps following the pilot, as it does
+ * on real receivers. */
+static gboolean cfm_tuner_sim_set_audmode(CFmTunerBackend *b, gboolean stereo)
+{
+	return TRUE;
+}
+
+static const CFmTunerBackendOps cfm_tuner_sim_ops = {
+	.name = "sim",
+	.open = cfm_tuner_sim_open,
+	.close = cfm_tuner_sim_close,
+	.free = cfm_tuner_sim_free,
+	.power = cfm_tuner_sim_power,
+	.tune = cfm_tuner_sim_tune,
+	.get_frequency = cfm_tuner_sim_get_frequency,
+	.seek = cfm_tuner_sim_seek,
+	.get_status = cfm_tuner_sim_get_status,
+	.read_rds = cfm_tuner_sim_read_rds,
+	.set_audmode = cfm_tuner_sim_set_audmode
+};
+
+CFmTunerBackend* cfm_tuner_sim_new(void)
+{
+	CFmTunerSim *self = g_slice_new0(CFmTunerSim);
+	self->parent.ops = &cfm_tuner_sim_ops;
+	self->ps_delay = 1000;
+	return &self->parent;
+}
@@ -0,0 +1,669 @@
+/*
+ * GPL 2
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "tuner_backend.h"
+
+/* Two backends sharing one file format:
+ *  - "trace" wraps another backend and appends every call made to it,
+ *    with its result, timestamp and latency, to a file.
+ *  - "replay" answers calls from such a file instead of the hardware.
+ *    The "device" is the trace path, optionally followed by ",realtime"
+ *    to also reproduce the recorded latencies.
+ *
+ * The file is little endian: a TraceHeader, then one TraceRecord per call
+ * followed by its payload. */
+
+#define TRACE_MAGIC    0x544d4643 /* "CFMT" */
+#define TRACE_VERSION  1
+
+#define RDS_VALUE_NULL 0xFFFF
+
+typedef enum {
+	TRACE_OPEN = 1,      /* u32 range_low, u32 range_high, u8 precise */
+	TRACE_CLOSE,         /* - */
+	TRACE_POWER,         /* u8 enable */
+	TRACE_TUNE,          /* u32 freq */
+	TRACE_GET_FREQUENCY, /* u32 freq */
+	TRACE_SEEK,          /* u8 upward */
+	TRACE_GET_STATUS,    /* u32 signal, i32 afc, u8 stereo */
+	TRACE_READ_RDS,      /* u8 key_len, key, u16 value_len, value */
+	TRACE_SET_AUDMODE,   /* u8 stereo */
+	TRACE_READ_RDS_BLOCKS /* blocks, as read from the device */
+} TraceOp;
+
+typedef struct {
+	guint32 magic;
+	guint16 version;
+	guint16 reserved;
+} TraceHeader;
+
+typedef struct {
+	guint8 op;
+	guint8 ok;
+	guint16 len;       /* Of the payload that follows */
+	guint32 delta_us;  /* Since the previous record started */
+	guint32 latency_us;
+} TraceRecord;
+
+/* ---- Recording ---- */
+
+typedef struct {
+	CFmTunerBackend parent;
+	CFmTunerBackend *inner;
+	FILE *f;
+	gint64 last_us;
+	gint64 start_us;   /* Of the call being recorded */
+	GByteArray *payload;
+} CFmTunerTrace;
+
+static inline CFmTunerTrace* TRACE(CFmTunerBackend *b)
+{
+	return (CFmTunerTrace*) b;
+}
+
+static void trace_begin(CFmTunerTrace *self)
+{
+	g_byte_array_set_size(self->payload, 0);
+	self->start_us = cfm_monotonic_us();
+}
+
+static void trace_put_u8(CFmTunerTrace *self, guint8 v)
+{
+	g_byte_array_append(self->payload, &v, 1);
+}
+
+static void trace_put_u16(CFmTunerTrace *self, guint16 v)
+{
+	v = GUINT16_TO_LE(v);
+	g_byte_array_append(self->payload, (guint8*) &v, 2);
+}
+
+static void trace_put_u32(CFmTunerTrace *self, guint32 v)
+{
+	v = GUINT32_TO_LE(v);
+	g_byte_array_append(self->payload, (guint8*) &v, 4);
+}
+
+static void trace_end(CFmTunerTrace *self, TraceOp op, gboolean ok)
+{
+	const gint64 now = cfm_monotonic_us();
+	TraceRecord r;
+
+	if (!self->f) return;
+
+	r.op = op;
+	r.ok = ok ? 1 : 0;
+	r.len = GUINT16_TO_LE(self->payload->len);
+	r.delta_us = GUINT32_TO_LE(MIN(self->start_us - self->last_us, G_MAXUINT32));
+	r.latency_us = GUINT32_TO_LE(MIN(now - self->start_us, G_MAXUINT32));
+	self->last_us = self->start_us;
+
+	if (fwrite(&r, sizeof(r), 1, self->f) != 1 ||
+	    fwrite(self->payload->data, 1, self->payload->len, self->f) != self->payload->len) {
+		g_warning("Failed to write tuner trace, stopping\n");
+		fclose(self->f);
+		self->f = NULL;
+	}
+}
+
+static gboolean cfm_tuner_trace_open(CFmTunerBackend *b, const gchar *device)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gboolean ok;
+
+	trace_begin(self);
+	ok = cfm_tuner_backend_open(self->inner, device);
+	b->precise = self->inner->precise;
+	b->range_low = self->inner->range_low;
+	b->range_high = self->inner->range_high;
+	trace_put_u32(self, b->range_low);
+	trace_put_u32(self, b->range_high);
+	trace_put_u8(self, b->precise);
+	trace_end(self, TRACE_OPEN, ok);
+
+	return ok;
+}
+
+static void cfm_tuner_trace_close(CFmTunerBackend *b)
+{
+	CFmTunerTrace *self = TRACE(b);
+	trace_begin(self);
+	cfm_tuner_backend_close(self->inner);
+	trace_end(self, TRACE_CLOSE, TRUE);
+	if (self->f) fflush(self->f);
+}
+
+static void cfm_tuner_trace_free(CFmTunerBackend *b)
+{
+	CFmTunerTrace *self = TRACE(b);
+	cfm_tuner_backend_free(self->inner);
+	if (self->f) fclose(self->f);
+	g_byte_array_free(self->payload, TRUE);
+	g_slice_free(CFmTunerTrace, self);
+}
+
+static gboolean cfm_tuner_trace_power(CFmTunerBackend *b, gboolean enable)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gboolean ok;
+	trace_begin(self);
+	ok = cfm_tuner_backend_power(self->inner, enable);
+	trace_put_u8(self, enable);
+	trace_end(self, TRACE_POWER, ok);
+	return ok;
+}
+
+static gboolean cfm_tuner_trace_tune(CFmTunerBackend *b, gulong freq)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gboolean ok;
+	trace_begin(self);
+	ok = cfm_tuner_backend_tune(self->inner, freq);
+	trace_put_u32(self, freq);
+	trace_end(self, TRACE_TUNE, ok);
+	return ok;
+}
+
+static gulong cfm_tuner_trace_get_frequency(CFmTunerBackend *b)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gulong freq;
+	trace_begin(self);
+	freq = cfm_tuner_backend_get_frequency(self->inner);
+	trace_put_u32(self, freq);
+	trace_end(self, TRACE_GET_FREQUENCY, freq != 0);
+	return freq;
+}
+
+static gboolean cfm_tuner_trace_seek(CFmTunerBackend *b, gboolean upward)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gboolean ok;
+	trace_begin(self);
+	ok = cfm_tuner_backend_seek(self->inner, upward);
+	trace_put_u8(self, upward);
+	trace_end(self, TRACE_SEEK, ok);
+	return ok;
+}
+
+static gboolean cfm_tuner_trace_get_status(CFmTunerBackend *b, CFmTunerStatus *status)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gboolean ok;
+	trace_begin(self);
+	ok = cfm_tuner_backend_get_status(self->inner, status);
+	if (ok) {
+		trace_put_u32(self, status->signal);
+		trace_put_u32(self, (guint32) status->afc);
+		trace_put_u8(self, status->stereo);
+	}
+	trace_end(self, TRACE_GET_STATUS, ok);
+	return ok;
+}
+
+static gchar* cfm_tuner_trace_read_rds(CFmTunerBackend *b, const gchar *key)
+{
+	CFmTunerTrace *self = TRACE(b);
+	const gsize key_len = MIN(strlen(key), G_MAXUINT8);
+	gchar *value;
+	trace_begin(self);
+	value = cfm_tuner_backend_read_rds(self->inner, key);
+	trace_put_u8(self, key_len);
+	g_byte_array_append(self->payload, (const guint8*) key, key_len);
+	if (value) {
+		const gsize value_len = MIN(strlen(value), RDS_VALUE_NULL - 1);
+		trace_put_u16(self, value_len);
+		g_byte_array_append(self->payload, (const guint8*) value, value_len);
+	} else {
+		trace_put_u16(self, RDS_VALUE_NULL);
+	}
+	trace_end(self, TRACE_READ_RDS, value != NULL);
+	return value;
+}
+
+/* Recorded the same way as read_rds, so replay can answer either. */
+static gssize cfm_tuner_trace_read_rds_into(CFmTunerBackend *b, const gchar *key,
+	gchar *buf, gsize len)
+{
+	CFmTunerTrace *self = TRACE(b);
+	const gsize key_len = MIN(strlen(key), G_MAXUINT8);
+	gssize n;
+	trace_begin(self);
+	n = cfm_tuner_backend_read_rds_into(self->inner, key, buf, len);
+	trace_put_u8(self, key_len);
+	g_byte_array_append(self->payload, (const guint8*) key, key_len);
+	if (n >= 0) {
+		const gsize value_len = MIN((gsize) n, RDS_VALUE_NULL - 1);
+		trace_put_u16(self, value_len);
+		g_byte_array_append(self->payload, (const guint8*) buf, value_len);
+	} else {
+		trace_put_u16(self, RDS_VALUE_NULL);
+	}
+	trace_end(self, TRACE_READ_RDS, n >= 0);
+	return n;
+}
+
+static int cfm_tuner_trace_get_rds_fd(CFmTunerBackend *b, const gchar *key)
+{
+	return cfm_tuner_backend_get_rds_fd(TRACE(b)->inner, key);
+}
+
+/* Empty reads are not recorded; the caller keeps reading until one is. */
+static gssize cfm_tuner_trace_read_rds_blocks(CFmTunerBackend *b, guint8 *buf, gsize len)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gssize n;
+	trace_begin(self);
+	n = cfm_tuner_backend_read_rds_blocks(self->inner, buf, MIN(len, G_MAXUINT16));
+	if (n == 0) return 0;
+	if (n > 0) {
+		g_byte_array_append(self->payload, buf, n);
+	}
+	trace_end(self, TRACE_READ_RDS_BLOCKS, n > 0);
+	return n;
+}
+
+static gboolean cfm_tuner_trace_set_audmode(CFmTunerBackend *b, gboolean stereo)
+{
+	CFmTunerTrace *self = TRACE(b);
+	gboolean ok;
+	trace_begin(self);
+	ok = cfm_tuner_backend_set_audmode(self->inner, stereo);
+	trace_put_u8(self, stereo);
+	trace_end(self, TRACE_SET_AUDMODE, ok);
+	return ok;
+}
+
+static const CFmTunerBackendOps cfm_tuner_trace_ops = {
+	.name = "trace",
+	.open = cfm_tuner_trace_open,
+	.close = cfm_tuner_trace_close,
+	.free = cfm_tuner_trace_free,
+	.power = cfm_tuner_trace_power,
+	.tune = cfm_tuner_trace_tune,
+	.get_frequency = cfm_tuner_trace_get_frequency,
+	.seek = cfm_tuner_trace_seek,
+	.get_status = cfm_tuner_trace_get_status,
+	.read_rds = cfm_tuner_trace_read_rds,
+	.set_audmode = cfm_tuner_trace_set_audmode,
+	.read_rds_into = cfm_tuner_trace_read_rds_into,
+	.get_rds_fd = cfm_tuner_trace_get_rds_fd,
+	.read_rds_blocks = cfm_tuner_trace_read_rds_blocks
+};
+
+/** Records everything done to inner, which must not be opened yet, into
+ *  file. Takes ownership of inner. */
+CFmTunerBackend* cfm_tuner_trace_new(CFmTunerBackend *inner, const gchar *file)
+{
+	CFmTunerTrace *self;
+	TraceHeader h;
+
+	g_return_val_if_fail(inner != NULL && !inner->is_open, inner);
+
+	self = g_slice_new0(CFmTunerTrace);
+	self->parent.ops = &cfm_tuner_trace_ops;
+	self->inner = inner;
+	self->payload = g_byte_array_new();
+	self->last_us = cfm_monotonic_us();
+
+	self->f = fopen(file, "wb");
+	if (!self->f) {
+		g_warning("Cannot write tuner trace to %s\n", file);
+	} else {
+		h.magic = GUINT32_TO_LE(TRACE_MAGIC);
+		h.version = GUINT16_TO_LE(TRACE_VERSION);
+		h.reserved = 0;
+		fwrite(&h, sizeof(h), 1, self->f);
+	}
+
+	return &self->parent;
+}
+
+/* ---- Replay ---- */
+
+typedef struct {
+	CFmTunerBackend parent;
+	gchar *data;
+	gsize len;
+	gsize pos;         /* Of the next record not consumed yet */
+	TraceRecord cur;   /* Copy of the last one matched, aligned */
+	gboolean realtime;
+	gulong freq;
+	gsize blocks_pos;  /* Of the next block read not served yet */
+	int rds_pipe[2];   /* Readable while there are blocks to serve */
+} CFmTunerReplay;
+
+static inline CFmTunerReplay* REPLAY(CFmTunerBackend *b)
+{
+	return (CFmTunerReplay*) b;
+}
+
+static guint16 replay_u16(const guint8 *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static guint32 replay_u32(const guint8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+/* Finds the next record for op, at or after the current position, whose
+ * payload starts with prefix; calls made in a different order than when
+ * recording (timers firing differently, say) just skip over the rest. */
+static void replay_signal_blocks(CFmTunerReplay *self);
+
+static const TraceRecord* replay_next(CFmTunerReplay *self, TraceOp op,
+	const guint8 *prefix, gsize prefix_len, const guint8 **payload)
+{
+	gsize pos = self->pos;
+
+	while (pos + sizeof(TraceRecord) <= self->len) {
+		const guint8 *p = (const guint8*) self->data + pos + sizeof(TraceRecord);
+		TraceRecord r;
+		gsize len, next;
+
+		memcpy(&r, self->data + pos, sizeof(r));
+		len = GUINT16_FROM_LE(r.len);
+		next = pos + sizeof(TraceRecord) + len;
+		if (next > self->len) break; /* Truncated */
+
+		if (r.op == op && len >= prefix_len &&
+		    (prefix_len == 0 || memcmp(p, prefix, prefix_len) == 0)) {
+			self->pos = next;
+			self->cur = r;
+			if (self->realtime) {
+				g_usleep(GUINT32_FROM_LE(r.latency_us));
+			}
+			*payload = p;
+			replay_signal_blocks(self);
+			return &self->cur;
+		}
+
+		pos = next;
+	}
+
+	return NULL;
+}
+
+/* Block reads are served from their own cursor, so that the RDS watch
+ * can drain them without skipping the records of other calls; a read is
+ * due once the calls recorded before it have been replayed. */
+static gboolean replay_next_blocks(CFmTunerReplay *self, gboolean consume,
+	TraceRecord *r, const guint8 **payload)
+{
+	gsize pos = self->blocks_pos;
+
+	while (pos + sizeof(TraceRecord) <= self->len) {
+		gsize next;
+
+		memcpy(r, self->data + pos, sizeof(*r));
+		next = pos + sizeof(TraceRecord) + GUINT16_FROM_LE(r->len);
+		if (next > self->len) break; /* Truncated */
+
+		if (r->op == TRACE_READ_RDS_BLOCKS) {
+			*payload = (const guint8*) self->data + pos + sizeof(TraceRecord);
+			self->blocks_pos = consume ? next : pos;
+			return TRUE;
+		} else if (pos >= self->pos) {
+			break; /* Not recorded yet at this point */
+		}
+
+		pos = next;
+	}
+
+	self->blocks_pos = pos;
+	return FALSE;
+}
+
+static void replay_signal_blocks(CFmTunerReplay *self)
+{
+	TraceRecord r;
+	const guint8 *p;
+	const guint8 c = 0;
+
+	if (self->rds_pipe[1] != -1 && replay_next_blocks(self, FALSE, &r, &p)) {
+		if (write(self->rds_pipe[1], &c, 1) < 0) {
+			/* Full; it is readable already */
+		}
+	}
+}
+
+static gboolean cfm_tuner_replay_open(CFmTunerBackend *b, const gchar *device)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	GError *error = NULL;
+	gchar **opts;
+	const TraceHeader *h;
+	const TraceRecord *r;
+	const guint8 *p;
+
+	if (!device) {
+		g_warning("No tuner trace given to replay\n");
+		return FALSE;
+	}
+
+	opts = g_strsplit(device, ",", 2);
+	self->realtime = opts[1] && strcmp(opts[1], "realtime") == 0;
+	if (!g_file_get_contents(opts[0], &self->data, &self->len, &error)) {
+		g_warning("Cannot read tuner trace: %s\n", error->message);
+		g_error_free(error);
+		g_strfreev(opts);
+		return FALSE;
+	}
+	g_strfreev(opts);
+
+	h = (const TraceHeader*) self->data;
+	if (self->len < sizeof(TraceHeader) ||
+	    GUINT32_FROM_LE(h->magic) != TRACE_MAGIC ||
+	    GUINT16_FROM_LE(h->version) != TRACE_VERSION) {
+		g_warning("Not a tuner trace: %s\n", device);
+		return FALSE;
+	}
+	self->pos = sizeof(TraceHeader);
+	self->blocks_pos = self->pos;
+
+	r = replay_next(self, TRACE_OPEN, NULL, 0, &p);
+	if (!r || !r->ok || GUINT16_FROM_LE(r->len) < 9) {
+		g_warning("Tuner trace %s has no successful open\n", device);
+		return FALSE;
+	}
+
+	b->range_low = replay_u32(p);
+	b->range_high = replay_u32(p + 4);
+	b->precise = p[8];
+	self->freq = b->range_low;
+
+	return TRUE;
+}
+
+static void cfm_tuner_replay_close(CFmTunerBackend *b)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	if (self->rds_pipe[0] != -1) {
+		close(self->rds_pipe[0]);
+		close(self->rds_pipe[1]);
+		self->rds_pipe[0] = self->rds_pipe[1] = -1;
+	}
+	g_free(self->data);
+	self->data = NULL;
+	self->len = 0;
+}
+
+static void cfm_tuner_replay_free(CFmTunerBackend *b)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	g_free(self->data);
+	g_slice_free(CFmTunerReplay, self);
+}
+
+static gboolean cfm_tuner_replay_power(CFmTunerBackend *b, gboolean enable)
+{
+	const guint8 arg = enable ? 1 : 0;
+	const TraceRecord *r;
+	const guint8 *p;
+	r = replay_next(REPLAY(b), TRACE_POWER, &arg, 1, &p);
+	return r ? r->ok : TRUE;
+}
+
+static gboolean cfm_tuner_replay_tune(CFmTunerBackend *b, gulong freq)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	const guint32 arg = GUINT32_TO_LE(freq);
+	const TraceRecord *r;
+	const guint8 *p;
+	self->freq = freq;
+	r = replay_next(self, TRACE_TUNE, (const guint8*) &arg, 4, &p);
+	return r ? r->ok : TRUE;
+}
+
+static gulong cfm_tuner_replay_get_frequency(CFmTunerBackend *b)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	const TraceRecord *r;
+	const guint8 *p;
+	r = replay_next(self, TRACE_GET_FREQUENCY, NULL, 0, &p);
+	if (r && GUINT16_FROM_LE(r->len) >= 4) {
+		self->freq = replay_u32(p);
+	}
+	return self->freq;
+}
+
+static gboolean cfm_tuner_replay_seek(CFmTunerBackend *b, gboolean upward)
+{
+	const guint8 arg = upward ? 1 : 0;
+	const TraceRecord *r;
+	const guint8 *p;
+	r = replay_next(REPLAY(b), TRACE_SEEK, &arg, 1, &p);
+	return r ? r->ok : FALSE;
+}
+
+static gboolean cfm_tuner_replay_get_status(CFmTunerBackend *b, CFmTunerStatus *status)
+{
+	const TraceRecord *r;
+	const guint8 *p;
+	r = replay_next(REPLAY(b), TRACE_GET_STATUS, NULL, 0, &p);
+	if (!r || !r->ok || GUINT16_FROM_LE(r->len) < 9) {
+		return FALSE;
+	}
+	status->signal = replay_u32(p);
+	status->afc = (gint32) replay_u32(p + 4);
+	status->stereo = p[8];
+	return TRUE;
+}
+
+static gchar* cfm_tuner_replay_read_rds(CFmTunerBackend *b, const gchar *key)
+{
+	const gsize key_len = MIN(strlen(key), G_MAXUINT8);
+	guint8 prefix[1 + G_MAXUINT8];
+	const TraceRecord *r;
+	const guint8 *p;
+	guint16 value_len;
+
+	prefix[0] = key_len;
+	memcpy(prefix + 1, key, key_len);
+	r = replay_next(REPLAY(b), TRACE_READ_RDS, prefix, key_len + 1, &p);
+	if (!r || GUINT16_FROM_LE(r->len) < key_len + 3) {
+		return NULL;
+	}
+
+	value_len = replay_u16(p + 1 + key_len);
+	if (value_len == RDS_VALUE_NULL ||
+	    GUINT16_FROM_LE(r->len) < key_len + 3 + value_len) {
+		return NULL;
+	}
+	return g_strndup((const gchar*) p + 3 + key_len, value_len);
+}
+
+/* Traces recorded against a tuner with a raw block stream get one too, so
+ * that they are decoded the same way when replayed. */
+static int cfm_tuner_replay_get_rds_fd(CFmTunerBackend *b, const gchar *key)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	gsize pos;
+
+	if (strcmp(key, CFM_TUNER_RDS_BLOCKS) != 0) return -1;
+	if (self->rds_pipe[0] != -1) return self->rds_pipe[0];
+
+	for (pos = sizeof(TraceHeader); pos + sizeof(TraceRecord) <= self->len; ) {
+		TraceRecord r;
+		memcpy(&r, self->data + pos, sizeof(r));
+		if (r.op == TRACE_READ_RDS_BLOCKS) break;
+		pos += sizeof(TraceRecord) + GUINT16_FROM_LE(r.len);
+	}
+	if (pos + sizeof(TraceRecord) > self->len) return -1;
+
+	if (pipe(self->rds_pipe) < 0) {
+		g_warning("Unable to create RDS pipe: %s\n", g_strerror(errno));
+		self->rds_pipe[0] = self->rds_pipe[1] = -1;
+		return -1;
+	}
+	fcntl(self->rds_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(self->rds_pipe[1], F_SETFL, O_NONBLOCK);
+	replay_signal_blocks(self);
+
+	return self->rds_pipe[0];
+}
+
+static gssize cfm_tuner_replay_read_rds_blocks(CFmTunerBackend *b, guint8 *buf, gsize len)
+{
+	CFmTunerReplay *self = REPLAY(b);
+	TraceRecord r;
+	const guint8 *p;
+	guint8 drain[64];
+	gsize n;
+
+	if (self->rds_pipe[0] == -1) return -1;
+	if (!replay_next_blocks(self, TRUE, &r, &p)) {
+		while (read(self->rds_pipe[0], drain, sizeof(drain)) > 0) {
+			/* Until replay_next() makes more due */
+		}
+		return 0;
+	}
+	if (!r.ok) return -1;
+
+	n = MIN(GUINT16_FROM_LE(r.len), len);
+	memcpy(buf, p, n);
+	return n;
+}
+
+static gboolean cfm_tuner_replay_set_audmode(CFmTunerBackend *b, gboolean stereo)
+{
+	const guint8 arg = stereo ? 1 : 0;
+	const TraceRecord *r;
+	const guint8 *p;
+	r = replay_next(REPLAY(b), TRACE_SET_AUDMODE, &arg, 1, &p);
+	return r ? r->ok : TRUE;
+}
+
+static const CFmTunerBackendOps cfm_tuner_replay_ops = {
+	.name = "replay",
+	.open = cfm_tuner_replay_open,
+	.close = cfm_tuner_replay_close,
+	.free = cfm_tuner_replay_free,
+	.power = cfm_tuner_replay_power,
+	.tune = cfm_tuner_replay_tune,
+	.get_frequency = cfm_tuner_replay_get_frequency,
+	.seek = cfm_tuner_replay_seek,
+	.get_status = cfm_tuner_replay_get_status,
+	.read_rds = cfm_tuner_replay_read_rds,
+	.set_audmode = cfm_tuner_replay_set_audmode,
+	.get_rds_fd = cfm_tuner_replay_get_rds_fd,
+	.read_rds_blocks = cfm_tuner_replay_read_rds_blocks
+};
+
+CFmTunerBackend* cfm_tuner_replay_new(void)
+{
+	CFmTunerReplay *self = g_slice_new0(CFmTunerReplay);
+	self->parent.ops = &cfm_tuner_replay_ops;
+	self->rds_pipe[0] = self->rds_pipe[1] = -1;
+	return &self->parent;
+}
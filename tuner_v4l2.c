@@ -0,0 +1,379 @@
+/*
+ * GPL 2
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <linux/videodev2.h>
+#include <glib.h>
+
+#include "tuner_backend.h"
+
+#define SYSFS_NODE_PATH	"/sys/class/i2c-adapter/i2c-3/3-0022"
+
+/* Attributes kept open while the tuner is, so that reading them is a
+ * single pread() and they can be polled for changes. */
+static const gchar * const sysfs_rds_keys[] = { "rds_pi", "rds_ps", "rds_rt" };
+#define SYSFS_RDS_KEYS G_N_ELEMENTS(sysfs_rds_keys)
+
+typedef struct {
+	CFmTunerBackend parent;
+	int fd;
+	gboolean has_sysfs;
+	int rds_fd[SYSFS_RDS_KEYS];
+	gboolean has_rds_blocks;
+} CFmTunerV4l2;
+
+static inline CFmTunerV4l2* V4L2(CFmTunerBackend *b)
+{
+	return (CFmTunerV4l2*) b;
+}
+
+static int cfm_tuner_v4l2_rds_index(const gchar *key)
+{
+	guint i;
+	for (i = 0; i < SYSFS_RDS_KEYS; i++) {
+		if (strcmp(key, sysfs_rds_keys[i]) == 0) return i;
+	}
+	return -1;
+}
+
+static void cfm_tuner_v4l2_open_sysfs(CFmTunerV4l2 *self)
+{
+	guint i;
+	for (i = 0; i < SYSFS_RDS_KEYS; i++) {
+		gchar *file = g_strdup_printf("%s/%s", SYSFS_NODE_PATH, sysfs_rds_keys[i]);
+		self->rds_fd[i] = open(file, O_RDONLY);
+		if (self->rds_fd[i] == -1) {
+			g_warning("Unable to open sysfs key %s: %s\n", sysfs_rds_keys[i],
+				g_strerror(errno));
+		}
+		g_free(file);
+	}
+}
+
+/* The sysfs RDS attributes belong to one chip; a second receiver, such as
+ * one the monitor sweeps with, must not pass them off as its own. */
+static gboolean cfm_tuner_v4l2_owns_sysfs(CFmTunerV4l2 *self)
+{
+	struct stat st;
+	gchar *link, *node, *ours;
+	gboolean owns;
+
+	if (!g_file_test(SYSFS_NODE_PATH, G_FILE_TEST_IS_DIR) ||
+	    fstat(self->fd, &st) < 0 || !S_ISCHR(st.st_mode)) {
+		return FALSE;
+	}
+
+	link = g_strdup_printf("/sys/dev/char/%u:%u/device",
+		major(st.st_rdev), minor(st.st_rdev));
+	node = realpath(SYSFS_NODE_PATH, NULL);
+	ours = realpath(link, NULL);
+	owns = node && ours && strcmp(node, ours) == 0;
+
+	free(node);
+	free(ours);
+	g_free(link);
+	return owns;
+}
+
+static gboolean cfm_tuner_v4l2_open(CFmTunerBackend *b, const gchar *device)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_capability cap = { { 0 } };
+	struct v4l2_tuner tuner = { 0 };
+	int res;
+
+	self->fd = open(device, O_RDONLY);
+	if (self->fd == -1) {
+		perror("Open radio tuner");
+		return FALSE;
+	}
+
+	tuner.index = 0;
+	res = ioctl(self->fd, VIDIOC_G_TUNER, &tuner);
+	if (res < 0) {
+		perror("VIDIOC_G_TUNER");
+		goto fail;
+	}
+
+	if (tuner.type != V4L2_TUNER_RADIO) {
+		g_warning("Not a radio tuner\n");
+		goto fail;
+	}
+
+	b->precise = (tuner.capability & V4L2_TUNER_CAP_LOW) ? TRUE : FALSE;
+
+	if (b->precise) {
+		b->range_low = tuner.rangelow * 62.5;
+		b->range_high = tuner.rangehigh * 62.5;
+	} else {
+		b->range_low = tuner.rangelow * 62500;
+		b->range_high = tuner.rangehigh * 62500;
+	}
+
+	/* Standard drivers deliver raw RDS blocks through read(). */
+	if (ioctl(self->fd, VIDIOC_QUERYCAP, &cap) == 0) {
+		self->has_rds_blocks = (cap.capabilities & V4L2_CAP_RDS_CAPTURE) ? TRUE : FALSE;
+	}
+#ifdef V4L2_CID_RDS_RECEPTION
+	if (self->has_rds_blocks) {
+		/* Off by default on some drivers; those without it just fail. */
+		struct v4l2_control vctrl = { V4L2_CID_RDS_RECEPTION, 1 };
+		ioctl(self->fd, VIDIOC_S_CTRL, &vctrl);
+	}
+#endif
+
+	/* Only the N900 driver exports RDS through sysfs. */
+	self->has_sysfs = cfm_tuner_v4l2_owns_sysfs(self);
+	if (self->has_sysfs) {
+		cfm_tuner_v4l2_open_sysfs(self);
+	}
+
+	return TRUE;
+
+fail:
+	close(self->fd);
+	self->fd = -1;
+	return FALSE;
+}
+
+static void cfm_tuner_v4l2_close(CFmTunerBackend *b)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	guint i;
+	for (i = 0; i < SYSFS_RDS_KEYS; i++) {
+		if (self->rds_fd[i] != -1) {
+			close(self->rds_fd[i]);
+			self->rds_fd[i] = -1;
+		}
+	}
+	if (self->fd != -1) {
+		close(self->fd);
+		self->fd = -1;
+	}
+}
+
+static void cfm_tuner_v4l2_free(CFmTunerBackend *b)
+{
+	g_slice_free(CFmTunerV4l2, V4L2(b));
+}
+
+static gboolean cfm_tuner_v4l2_power(CFmTunerBackend *b, gboolean enable)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_control vctrl;
+	int res;
+
+	vctrl.id = V4L2_CID_AUDIO_MUTE;
+	vctrl.value = enable ? 0 : 1;
+	res = ioctl(self->fd, VIDIOC_S_CTRL, &vctrl);
+
+	if (res < 0) {
+		perror("VIDIOC_S_CTRL");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean cfm_tuner_v4l2_tune(CFmTunerBackend *b, gulong freq)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_frequency t_freq = { 0 };
+	t_freq.tuner = 0;
+	t_freq.type = V4L2_TUNER_RADIO;
+	t_freq.frequency = b->precise ? freq / 62.5 : freq / 62500;
+	int res = ioctl(self->fd, VIDIOC_S_FREQUENCY, &t_freq);
+	g_warn_if_fail(res == 0);
+	return res == 0;
+}
+
+static gulong cfm_tuner_v4l2_get_frequency(CFmTunerBackend *b)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_frequency t_freq = { 0 };
+	t_freq.tuner = 0;
+	int res = ioctl(self->fd, VIDIOC_G_FREQUENCY, &t_freq);
+	g_return_val_if_fail(res == 0, 0);
+	return b->precise ? t_freq.frequency * 62.5 : t_freq.frequency * 62500;
+}
+
+static gboolean cfm_tuner_v4l2_seek(CFmTunerBackend *b, gboolean upward)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_hw_freq_seek t_freq_seek = { 0 };
+	t_freq_seek.tuner = 0;
+	t_freq_seek.type = V4L2_TUNER_RADIO;
+	t_freq_seek.seek_upward = upward;
+	int res = ioctl(self->fd, VIDIOC_S_HW_FREQ_SEEK, &t_freq_seek);
+	g_warn_if_fail(res == 0);
+	return res == 0;
+}
+
+static gboolean cfm_tuner_v4l2_get_status(CFmTunerBackend *b, CFmTunerStatus *status)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_tuner tuner = { 0 };
+	tuner.index = 0;
+	int res = ioctl(self->fd, VIDIOC_G_TUNER, &tuner);
+	g_return_val_if_fail(res == 0, FALSE);
+	status->signal = tuner.signal;
+	status->stereo = (tuner.rxsubchans & V4L2_TUNER_SUB_STEREO) ? TRUE : FALSE;
+	status->afc = tuner.afc;
+	return TRUE;
+}
+
+static gchar* cfm_tuner_v4l2_read_sysfs(CFmTunerV4l2 *self, const gchar *key)
+{
+	GError *error = NULL;
+	gchar *file, *r = NULL;
+
+	file = g_strdup_printf("%s/%s", SYSFS_NODE_PATH, key);
+
+	if (!g_file_get_contents(file, &r, NULL, &error)) {
+		g_warning("Unable to read sysfs key %s: %s\n", key, error->message);
+		g_error_free(error);
+	}
+
+	g_free(file);
+
+	return r;
+}
+
+static gssize cfm_tuner_v4l2_read_rds_into(CFmTunerBackend *b, const gchar *key,
+	gchar *buf, gsize len)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	const int i = cfm_tuner_v4l2_rds_index(key);
+	gssize n;
+
+	buf[0] = '\0';
+	if (!self->has_sysfs) return -1;
+
+	if (i < 0 || self->rds_fd[i] == -1) {
+		gchar *r = cfm_tuner_v4l2_read_sysfs(self, key);
+		if (!r) return -1;
+		n = MIN(g_strlcpy(buf, r, len), len - 1);
+		g_free(r);
+		return n;
+	}
+
+	/* Reading from the start also rearms poll() on sysfs attributes. */
+	n = pread(self->rds_fd[i], buf, len - 1, 0);
+	if (n < 0) {
+		g_warning("Unable to read sysfs key %s: %s\n", key, g_strerror(errno));
+		return -1;
+	}
+	buf[n] = '\0';
+
+	return n;
+}
+
+static gchar* cfm_tuner_v4l2_read_rds(CFmTunerBackend *b, const gchar *key)
+{
+	gchar buf[256];
+	gssize n = cfm_tuner_v4l2_read_rds_into(b, key, buf, sizeof(buf));
+	return n < 0 ? NULL : g_strndup(buf, n);
+}
+
+static int cfm_tuner_v4l2_get_rds_fd(CFmTunerBackend *b, const gchar *key)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	int i;
+
+	if (strcmp(key, CFM_TUNER_RDS_BLOCKS) == 0) {
+		return self->has_rds_blocks ? self->fd : -1;
+	}
+
+	i = cfm_tuner_v4l2_rds_index(key);
+	return i < 0 ? -1 : self->rds_fd[i];
+}
+
+/* The device is not opened non blocking, since that would also make
+ * hardware seeks fail with EAGAIN; poll first instead, and only make this
+ * one read non blocking, since some drivers (vivid) always poll readable
+ * and would otherwise sleep in read() until the next block comes. */
+static gssize cfm_tuner_v4l2_read_rds_blocks(CFmTunerBackend *b, guint8 *buf, gsize len)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct pollfd pfd = { .fd = self->fd, .events = POLLIN };
+	int flags, err;
+	gssize n;
+
+	if (!self->has_rds_blocks) return -1;
+	if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN)) return 0;
+
+	flags = fcntl(self->fd, F_GETFL);
+	fcntl(self->fd, F_SETFL, flags | O_NONBLOCK);
+	n = read(self->fd, buf, len - len % sizeof(struct v4l2_rds_data));
+	err = errno;
+	fcntl(self->fd, F_SETFL, flags);
+	if (n < 0) {
+		if (err == EAGAIN || err == EINTR) return 0;
+		g_warning("Unable to read RDS blocks: %s\n", g_strerror(err));
+		return -1;
+	}
+
+	return n;
+}
+
+static gboolean cfm_tuner_v4l2_set_audmode(CFmTunerBackend *b, gboolean stereo)
+{
+	CFmTunerV4l2 *self = V4L2(b);
+	struct v4l2_tuner tuner = { 0 };
+	int res;
+
+	tuner.index = 0;
+	res = ioctl(self->fd, VIDIOC_G_TUNER, &tuner);
+	g_return_val_if_fail(res == 0, FALSE);
+
+	tuner.audmode = stereo ? V4L2_TUNER_MODE_STEREO : V4L2_TUNER_MODE_MONO;
+	res = ioctl(self->fd, VIDIOC_S_TUNER, &tuner);
+	if (res < 0) {
+		perror("VIDIOC_S_TUNER");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static const CFmTunerBackendOps cfm_tuner_v4l2_ops = {
+	.name = "v4l2",
+	.open = cfm_tuner_v4l2_open,
+	.close = cfm_tuner_v4l2_close,
+	.free = cfm_tuner_v4l2_free,
+	.power = cfm_tuner_v4l2_power,
+	.tune = cfm_tuner_v4l2_tune,
+	.get_frequency = cfm_tuner_v4l2_get_frequency,
+	.seek = cfm_tuner_v4l2_seek,
+	.get_status = cfm_tuner_v4l2_get_status,
+	.read_rds = cfm_tuner_v4l2_read_rds,
+	.set_audmode = cfm_tuner_v4l2_set_audmode,
+	.read_rds_into = cfm_tuner_v4l2_read_rds_into,
+	.get_rds_fd = cfm_tuner_v4l2_get_rds_fd,
+	.read_rds_blocks = cfm_tuner_v4l2_read_rds_blocks
+};
+
+CFmTunerBackend* cfm_tuner_v4l2_new(void)
+{
+	CFmTunerV4l2 *self = g_slice_new0(CFmTunerV4l2);
+	guint i;
+	self->parent.ops = &cfm_tuner_v4l2_ops;
+	self->fd = -1;
+	for (i = 0; i < SYSFS_RDS_KEYS; i++) {
+		self->rds_fd[i] = -1;
+	}
+	return &self->parent;
+}
@@ -17,6 +17,14 @@ typedef enum {
 GType cfm_radio_output_get_type(void) G_GNUC_CONST;
 #define CFM_TYPE_RADIO_OUTPUT (cfm_radio_output_get_type())
 
+/* One measured channel of a band sweep. Kept small so that a whole band fits
+ * in a couple of kilobytes. */
+typedef struct {
+	guint32 freq;
+	guint16 signal;
+	guint16 stereo;
+} CFmSpectrumPoint;
+
 G_END_DECLS
 
 #endif /* CFM_TYPES_H */